@@ -0,0 +1,294 @@
+// bench.cpp
+//
+// Headless benchmark of the editing hot paths.
+// Replays keystroke scripts through Windows that draw to nothing, and
+// reports throughput and per-keystroke latency. Then times finding
+// regex matches on long lines, failing if it grows faster than they do.
+//
+// usage:
+//   jpedit-bench                    built-in scripts on generated files
+//   jpedit-bench FILE SCRIPT...     the given scripts on the given file
+//
+// A script is replayed character by character: line breaks are Enter,
+// and <UP> <DOWN> <LEFT> <RIGHT> <HOME> <END> <PGUP> <PGDN> <BS> <DEL>
+// stand for those keys.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <ncurses.h>
+
+#include "Window_manager.h"
+#include "Window.h"
+#include "Buffer.h"
+#include "Regex.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// size of the pretend terminal.
+const int screen_height = 50;
+const int screen_width = 160;
+
+// a file to edit, and where in it to start.
+struct Corpus {
+  std::string name;
+  std::string path;
+  Buffer::size_type start;
+};
+
+// a named sequence of keys.
+struct Script {
+  std::string name;
+  std::vector<int> keys;
+};
+
+// write lines lines of filler text, with one line of long_line
+// characters in the middle if long_line is not 0.
+// returns the offset of the middle of the file.
+Buffer::size_type make_corpus(const std::string &path, int lines,
+                              Buffer::size_type long_line)
+{
+  std::ofstream out(path, std::ios::binary);
+  Buffer::size_type written = 0;
+  Buffer::size_type middle = 0;
+  for (int i = 0; i < lines; ++i) {
+    if (i == lines / 2) {
+      middle = written;
+      if (long_line > 0) {
+        std::string line(long_line, 'x');
+        out << line << '\n';
+        middle += long_line / 2;
+        written += long_line + 1;
+        continue;
+      }
+    }
+    std::ostringstream line;
+    line << "line " << i << ": the quick brown fox jumps over the lazy dog";
+    out << line.str() << '\n';
+    written += line.str().size() + 1;
+  }
+  return middle;
+}
+
+// keys for the given script text.
+std::vector<int> parse_script(const std::string &text)
+{
+  static const struct {
+    const char *name;
+    int key;
+  } names[] = {
+    { "<UP>", KEY_UP }, { "<DOWN>", KEY_DOWN },
+    { "<LEFT>", KEY_LEFT }, { "<RIGHT>", KEY_RIGHT },
+    { "<HOME>", KEY_HOME }, { "<END>", KEY_END },
+    { "<PGUP>", KEY_PPAGE }, { "<PGDN>", KEY_NPAGE },
+    { "<BS>", KEY_BACKSPACE }, { "<DEL>", KEY_DC },
+  };
+  std::vector<int> keys;
+  for (std::string::size_type i = 0; i < text.size(); ) {
+    bool named = false;
+    for (const auto &n : names) {
+      if (text.compare(i, std::char_traits<char>::length(n.name),
+                       n.name) == 0) {
+        keys.push_back(n.key);
+        i += std::char_traits<char>::length(n.name);
+        named = true;
+        break;
+      }
+    }
+    if (!named) {
+      keys.push_back(static_cast<unsigned char>(text[i]));
+      ++i;
+    }
+  }
+  return keys;
+}
+
+// the built-in scripts, one per kind of edit.
+std::vector<Script> builtin_scripts()
+{
+  const int count = 20000;
+  std::vector<Script> scripts(5);
+
+  scripts[0].name = "insert";
+  const std::string typing = "the quick brown fox jumps over the lazy dog ";
+  for (int i = 0; i < count; ++i) {
+    scripts[0].keys.push_back(typing[i % typing.size()]);
+  }
+
+  scripts[1].name = "delete";
+  scripts[1].keys.assign(count, KEY_DC);
+
+  scripts[2].name = "enter";
+  scripts[2].keys.assign(count, '\n');
+
+  scripts[3].name = "backspace";
+  scripts[3].keys.assign(count, KEY_BACKSPACE);
+
+  scripts[4].name = "motion";
+  const int moves[] = {
+    KEY_DOWN, KEY_RIGHT, KEY_RIGHT, KEY_END, KEY_UP, KEY_LEFT, KEY_HOME,
+    KEY_NPAGE, KEY_DOWN, KEY_DOWN, KEY_PPAGE, KEY_UP,
+  };
+  for (int i = 0; i < count; ++i) {
+    scripts[4].keys.push_back(moves[i % (sizeof(moves) / sizeof(moves[0]))]);
+  }
+  return scripts;
+}
+
+// nanoseconds at the given fraction of the way through sorted times.
+long long percentile(const std::vector<long long> &sorted, double fraction)
+{
+  if (sorted.empty()) {
+    return 0;
+  }
+  auto i = static_cast<std::vector<long long>::size_type>(
+      fraction * (sorted.size() - 1) + 0.5);
+  return sorted[i];
+}
+
+// replay script on a fresh Window over corpus, and print a row of
+// results, including what the Buffer's arena ended up holding.
+void run(const Corpus &corpus, const Script &script)
+{
+  auto load_start = Clock::now();
+  Window_manager wm(corpus.path, screen_height, screen_width);
+  auto load_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      Clock::now() - load_start).count();
+  wm.get_buffer(0).do_goto_offset(corpus.start);
+  Window &win = **wm.selected;
+  // draw the first screen, as the editor would, before timing keys.
+  win.replay_key(KEY_HOME);
+
+  std::vector<long long> times;
+  times.reserve(script.keys.size());
+  auto all_start = Clock::now();
+  for (int key : script.keys) {
+    auto start = Clock::now();
+    win.replay_key(key);
+    times.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now() - start).count());
+  }
+  auto all_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      Clock::now() - all_start).count();
+
+  std::sort(begin(times), end(times));
+  double keys_per_sec = all_ns > 0 ? times.size() * 1e9 / all_ns : 0;
+  const Arena::Stats &memory = wm.get_buffer(0).memory();
+  std::printf("%-10s %-10s %8zu %10.2f %12.0f %10.2f %10.2f %10.2f "
+              "%10zu %10zu\n",
+              corpus.name.c_str(), script.name.c_str(), times.size(),
+              load_ns / 1e6, keys_per_sec,
+              percentile(times, 0.50) / 1e3,
+              percentile(times, 0.99) / 1e3,
+              (times.empty() ? 0 : times.back()) / 1e3,
+              memory.reserved >> 10, memory.allocations);
+}
+
+// find every match of pattern on lines of a's, each twice as long as
+// the last, and print how long it takes. a*b|a matches each a alone,
+// but its a* goes on to the end of the line every time: it once took
+// time growing with the square of the line.
+// returns false if a line is not matched an a at a time, or the time
+// grows much faster than the line.
+bool run_regex(const std::string &pattern)
+{
+  Regex regex(pattern);
+  Regex::Matcher matcher(regex);
+  bool ok = true;
+  double first_ms = 0;
+  double last_ms = 0;
+  const std::string::size_type shortest = 100000;
+  const int doublings = 3;
+  for (int k = 0; k < doublings; ++k) {
+    std::string line(shortest << k, 'a');
+    std::vector<Regex::Match> found;
+    auto start = Clock::now();
+    matcher.find_all(line.data(), line.size(), 0, found);
+    last_ms = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now() - start).count() / 1e6;
+    if (k == 0) {
+      first_ms = last_ms;
+    }
+    bool right = found.size() == line.size();
+    std::printf("%-10s %-10s %8zu %10.2f%s\n", "regex", pattern.c_str(),
+                line.size(), last_ms, right ? "" : "  wrong matches");
+    ok = ok && right;
+  }
+  // 4 times the line: 4 times as long if linear, 16 if square.
+  if (last_ms > 8 * std::max(first_ms, 1.0)) {
+    std::printf("%-10s %-10s grows faster than the line\n", "regex",
+                pattern.c_str());
+    ok = false;
+  }
+  return ok;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+  std::vector<Corpus> corpora;
+  std::vector<Script> scripts;
+
+  if (argc > 2) {
+    Corpus c = { argv[1], argv[1], 0 };
+    corpora.push_back(c);
+    for (int i = 2; i < argc; ++i) {
+      std::ifstream in(argv[i], std::ios::binary);
+      if (!in) {
+        std::cerr << "cannot read script " << argv[i] << std::endl;
+        return 1;
+      }
+      std::string text((std::istreambuf_iterator<char>(in)),
+                       std::istreambuf_iterator<char>());
+      Script s = { argv[i], parse_script(text) };
+      scripts.push_back(s);
+    }
+  } else if (argc == 2) {
+    std::cerr << "usage: " << argv[0] << " [FILE SCRIPT...]" << std::endl;
+    return 1;
+  } else {
+    const std::string dir = "/tmp/jpedit-bench-";
+    Corpus small = { "small", dir + "small.txt", 0 };
+    small.start = make_corpus(small.path, 1000, 0);
+    Corpus large = { "large", dir + "large.txt", 0 };
+    large.start = make_corpus(large.path, 500000, 0);
+    Corpus long_line = { "long-line", dir + "long-line.txt", 0 };
+    long_line.start = make_corpus(long_line.path, 100, 8 << 20);
+    corpora.push_back(small);
+    corpora.push_back(large);
+    corpora.push_back(long_line);
+    scripts = builtin_scripts();
+  }
+
+  std::printf("%-10s %-10s %8s %10s %12s %10s %10s %10s %10s %10s\n",
+              "file", "script", "keys", "load ms", "keys/s",
+              "p50 us", "p99 us", "max us", "arena KiB", "allocs");
+  for (const auto &corpus : corpora) {
+    for (const auto &script : scripts) {
+      run(corpus, script);
+    }
+  }
+
+  if (argc <= 2) {
+    for (const auto &corpus : corpora) {
+      std::remove(corpus.path.c_str());
+    }
+  }
+
+  std::printf("\n%-10s %-10s %8s %10s\n", "file", "pattern", "chars",
+              "find ms");
+  bool ok = true;
+  for (const char *pattern : { "a", "a*b|a" }) {
+    ok = run_regex(pattern) && ok;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+// Arena.cpp
+//
+// Memory for everything one Buffer allocates while editing.
+
+#include <cstdio>
+#include <new>
+#include <string>
+
+#include "Arena.h"
+
+// one line summary.
+std::string Arena::Stats::describe() const
+{
+  char line[200];
+  std::snprintf(line, sizeof(line),
+                "%zu blocks, %zu KiB reserved, %zu KiB in use, "
+                "%zu allocations (%zu reused)",
+                blocks, reserved >> 10, in_use >> 10, allocations, reused);
+  return line;
+}
+
+// constructor:
+// takes memory from the system block_size bytes at a time.
+Arena::Arena(std::size_t block_size_ /* = 64 << 10 */) :
+  block_size(block_size_ < max_small ? max_small : block_size_),
+  large(nullptr), next(nullptr), end(nullptr), counts()
+{
+  for (auto &list : free_lists) {
+    list = nullptr;
+  }
+}
+
+// frees every block.
+Arena::~Arena()
+{
+  for (auto block : blocks) {
+    ::operator delete(block);
+  }
+  while (large != nullptr) {
+    Large *block = large;
+    large = block->next;
+    ::operator delete(block);
+  }
+}
+
+// give back size bytes at p, as allocated.
+// small sizes are reused by later allocations of the same size;
+// large ones are returned to the system.
+void Arena::recycle(void *p, std::size_t size)
+{
+  if (p == nullptr) {
+    return;
+  }
+  if (size == 0) {
+    size = 1;
+  }
+  if (size > max_small) {
+    // the header in front of the block says where it is in the list.
+    Large *block = static_cast<Large *>(p) - 1;
+    if (block->prev != nullptr) {
+      block->prev->next = block->next;
+    } else {
+      large = block->next;
+    }
+    if (block->next != nullptr) {
+      block->next->prev = block->prev;
+    }
+    ::operator delete(block);
+    --counts.blocks;
+    counts.reserved -= size;
+    counts.in_use -= size;
+    return;
+  }
+  size = (size + grain - 1) / grain * grain;
+  counts.in_use -= size;
+  Free *f = static_cast<Free *>(p);
+  Free *&list = free_list(size);
+  f->next = list;
+  list = f;
+}
+
+// start a new block for small allocations.
+// whatever was left of the last one is abandoned.
+void Arena::new_block()
+{
+  // operator new returns memory aligned for any type.
+  next = static_cast<char *>(::operator new(block_size));
+  end = next + block_size;
+  blocks.push_back(next);
+  ++counts.blocks;
+  counts.reserved += block_size;
+}
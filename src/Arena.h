@@ -0,0 +1,200 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+// Arena.h
+//
+// Memory for everything one Buffer allocates while editing.
+// Small objects are carved out of large blocks and recycled through
+// free lists by size; large ones get blocks of their own. Everything
+// is freed at once when the Arena goes, so closing a Buffer costs a
+// handful of frees however long it was edited.
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+class Arena {
+  public:
+    // what the Arena holds, for seeing how well it does.
+    struct Stats {
+      // memory taken from the system, in blocks.
+      std::size_t blocks;
+      std::size_t reserved;
+
+      // memory handed out and not given back.
+      std::size_t in_use;
+
+      // calls to allocate, and how many of them reused recycled memory.
+      std::size_t allocations;
+      std::size_t reused;
+
+      // one line summary.
+      std::string describe() const;
+    };
+
+    // constructor:
+    // takes memory from the system block_size bytes at a time.
+    explicit Arena(std::size_t block_size_ = 64 << 10);
+
+    // frees every block.
+    ~Arena();
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    // size bytes aligned to align (a power of 2, at most 16).
+    void *allocate(std::size_t size,
+                   std::size_t align = alignof(std::max_align_t));
+
+    // give back size bytes at p, as allocated.
+    // small sizes are reused by later allocations of the same size;
+    // large ones are returned to the system.
+    void recycle(void *p, std::size_t size);
+
+    // what the Arena holds.
+    const Stats &stats() const;
+
+  private:
+    // a freed small allocation, waiting to be reused.
+    struct Free {
+      Free *next;
+    };
+
+    // header in front of a large allocation, linking it into the list
+    // of them so it can be freed without a search.
+    // sized so the memory after it keeps the block's alignment.
+    struct alignas(std::max_align_t) Large {
+      Large *prev;
+      Large *next;
+    };
+
+    // small sizes are rounded up to a multiple of this.
+    static const std::size_t grain = 16;
+
+    // largest size kept on free lists; anything bigger than this gets
+    // a block of its own.
+    static const std::size_t max_small = 256;
+
+    // free list for size, which is at most max_small.
+    Free *&free_list(std::size_t size);
+
+    // start a new block for small allocations.
+    void new_block();
+
+    std::size_t block_size;
+
+    // blocks carved into small allocations.
+    std::vector<char *> blocks;
+
+    // large allocations, each its own block, most recent first.
+    Large *large;
+
+    // unused part of the current block.
+    char *next;
+    char *end;
+
+    Free *free_lists[max_small / grain];
+    Stats counts;
+};
+
+// allocator for standard containers, taking memory from an Arena.
+// with no Arena, takes memory from the heap.
+template <typename T>
+class Arena_allocator {
+  public:
+    using value_type = T;
+
+    explicit Arena_allocator(Arena *arena_ = nullptr) : arena(arena_) { }
+
+    template <typename U>
+    Arena_allocator(const Arena_allocator<U> &other) : arena(other.arena) { }
+
+    T *allocate(std::size_t n)
+    {
+      if (arena == nullptr) {
+        return static_cast<T *>(::operator new(n * sizeof(T)));
+      }
+      return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *p, std::size_t n)
+    {
+      if (arena == nullptr) {
+        ::operator delete(p);
+      } else {
+        arena->recycle(p, n * sizeof(T));
+      }
+    }
+
+    template <typename U>
+    bool operator==(const Arena_allocator<U> &other) const
+    {
+      return arena == other.arena;
+    }
+
+    template <typename U>
+    bool operator!=(const Arena_allocator<U> &other) const
+    {
+      return arena != other.arena;
+    }
+
+    Arena *arena;
+};
+
+// inline function definitions
+
+// what the Arena holds.
+inline const Arena::Stats &Arena::stats() const
+{
+  return counts;
+}
+
+// free list for size, which is at most max_small.
+inline Arena::Free *&Arena::free_list(std::size_t size)
+{
+  return free_lists[(size + grain - 1) / grain - 1];
+}
+
+// size bytes aligned to align (a power of 2, at most 16).
+// small sizes come from a free list if one has any, else from the
+// current block.
+inline void *Arena::allocate(std::size_t size, std::size_t align)
+{
+  ++counts.allocations;
+  if (size == 0) {
+    size = 1;
+  }
+  if (size > max_small) {
+    Large *block = static_cast<Large *>(::operator new(sizeof(Large) + size));
+    block->prev = nullptr;
+    block->next = large;
+    if (large != nullptr) {
+      large->prev = block;
+    }
+    large = block;
+    ++counts.blocks;
+    counts.reserved += size;
+    counts.in_use += size;
+    return block + 1;
+  }
+  size = (size + grain - 1) / grain * grain;
+  counts.in_use += size;
+  Free *&list = free_list(size);
+  if (list != nullptr) {
+    Free *f = list;
+    list = f->next;
+    ++counts.reused;
+    return f;
+  }
+  // every small size is a multiple of grain, and blocks start aligned,
+  // so next is always aligned to grain.
+  (void)align;
+  if (static_cast<std::size_t>(end - next) < size) {
+    new_block();
+  }
+  void *p = next;
+  next += size;
+  return p;
+}
+
+#endif /* ARENA_H */
@@ -0,0 +1,80 @@
+// Backend.cpp
+//
+// Where Screens send what they draw.
+
+#include <cstdlib>
+#include <cstring>
+
+#include <unistd.h>
+
+#include "Backend.h"
+#include "Ncurses_backend.h"
+#include "Vt_backend.h"
+#include "Log.h"
+
+Backend::~Backend()
+{
+  // empty
+}
+
+// set up the terminal the editor runs in, with the Backend that suits
+// it best: escape sequences written directly if it speaks them, ncurses
+// if not. JPEDIT_BACKEND in the environment, "vt" or "ncurses", chooses
+// instead.
+// escape sequences are only written directly to a terminal.
+Backend *Backend::open_terminal()
+{
+  const char *chosen = std::getenv("JPEDIT_BACKEND");
+  bool vt;
+  if (chosen != nullptr && std::strcmp(chosen, "vt") == 0) {
+    vt = true;
+  } else if (chosen != nullptr && std::strcmp(chosen, "ncurses") == 0) {
+    vt = false;
+  } else {
+    vt = isatty(STDOUT_FILENO) && Vt_backend::speaks(std::getenv("TERM"));
+  }
+  LOG_INFO("drawing with {}", vt ? "vt" : "ncurses");
+  if (vt) {
+    return new Vt_backend();
+  }
+  return new Ncurses_backend();
+}
+
+// constructor:
+// a terminal of the given size.
+Null_backend::Null_backend(int rows_, int cols_) : rows(rows_), cols(cols_)
+{
+  // empty
+}
+
+// size of the terminal, in rows and columns.
+void Null_backend::size(int &rows_, int &cols_) const
+{
+  rows_ = rows;
+  cols_ = cols;
+}
+
+// shows nothing.
+void Null_backend::put(int, int, const char *, int, bool)
+{
+  // empty
+}
+
+// shows nothing.
+void Null_backend::set_cursor(int, int)
+{
+  // empty
+}
+
+// shows nothing.
+void Null_backend::flush()
+{
+  // empty
+}
+
+// the terminal has changed size.
+void Null_backend::resize(int rows_, int cols_)
+{
+  rows = rows_;
+  cols = cols_;
+}
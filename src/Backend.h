@@ -0,0 +1,59 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+// Backend.h
+//
+// Where Screens send what they draw: the terminal, by way of ncurses or
+// of escape sequences written directly, or nowhere at all.
+// A Backend is given runs of cells in terminal coordinates and shows
+// them all at once when flushed. Whichever one draws on the terminal
+// also sets it up for the editor, and puts it back when it goes.
+
+class Backend {
+  public:
+    virtual ~Backend();
+
+    // size of the terminal, in rows and columns.
+    virtual void size(int &rows, int &cols) const = 0;
+
+    // write length cells of text at row y, column x, highlighted or
+    // not. the cells must be printable. nothing shows until a flush.
+    virtual void put(int y, int x, const char *text, int length,
+                     bool highlighted) = 0;
+
+    // where flush leaves the cursor.
+    virtual void set_cursor(int y, int x) = 0;
+
+    // show everything put since the last flush, at once.
+    virtual void flush() = 0;
+
+    // the terminal has changed size.
+    virtual void resize(int rows, int cols) = 0;
+
+    // set up the terminal the editor runs in, with the Backend that
+    // suits it best: escape sequences written directly if it speaks
+    // them, ncurses if not. JPEDIT_BACKEND in the environment, "vt" or
+    // "ncurses", chooses instead.
+    static Backend *open_terminal();
+};
+
+// a terminal of a fixed size that shows nothing, e.g. for benchmarks.
+class Null_backend : public Backend {
+  public:
+    // constructor:
+    // a terminal of the given size.
+    Null_backend(int rows_, int cols_);
+
+    void size(int &rows_, int &cols_) const override;
+    void put(int y, int x, const char *text, int length,
+             bool highlighted) override;
+    void set_cursor(int y, int x) override;
+    void flush() override;
+    void resize(int rows_, int cols_) override;
+
+  private:
+    int rows;
+    int cols;
+};
+
+#endif /* BACKEND_H */
@@ -0,0 +1,201 @@
+// Background_save.cpp
+//
+// Writes a snapshot of a Buffer's text to its file on a thread of its
+// own.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "Background_save.h"
+#include "Log.h"
+
+namespace {
+
+// most runs passed to one writev.
+#ifdef IOV_MAX
+const int max_iovecs = IOV_MAX < 1024 ? IOV_MAX : 1024;
+#else
+const int max_iovecs = 16;
+#endif
+
+// most characters passed to one writev, so that progress moves
+// steadily even through one huge run.
+const Background_save::size_type max_batch = 4 << 20;
+
+// directory holding the file at path.
+std::string directory_of(const std::string &path)
+{
+  auto slash = path.rfind('/');
+  if (slash == std::string::npos) {
+    return ".";
+  }
+  return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+}
+
+// constructor:
+// starts writing the text to the file at path_.
+Background_save::Background_save(const std::string &path_,
+                                 Piece_table::Snapshot text_) :
+  path(path_), text(std::move(text_)), length(text.size()),
+  bytes_written(0), finished(false), succeeded(false)
+{
+  worker = std::thread(&Background_save::work, this);
+}
+
+// waits for the save to finish.
+Background_save::~Background_save()
+{
+  wait();
+}
+
+// wait for the save to finish.
+void Background_save::wait()
+{
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+// write the file, then mark the save done.
+// the original text may be mapped from path itself, so truncating
+// path in place would pull it out from under the editor. the text
+// goes to a temporary file, which is renamed over path once it is
+// safely on disk.
+// a path through symbolic links is followed to the file it names, so
+// that the file is replaced and the links are left alone.
+void Background_save::work()
+{
+  LOG_TRACE("saving {} characters to {}", length, path);
+  std::string real_path = path;
+  char resolved[PATH_MAX];
+  if (::realpath(path.c_str(), resolved) != nullptr) {
+    real_path = resolved;
+  }
+  std::string temp_path = real_path + ".jpedit-save";
+  // keep the permissions and owners of the file being replaced.
+  bool replacing = false;
+  mode_t mode = 0666;
+  struct stat info;
+  if (::stat(real_path.c_str(), &info) == 0) {
+    replacing = true;
+    mode = info.st_mode & 07777;
+  }
+  int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, mode);
+  if (fd < 0) {
+    fail("open");
+  } else {
+    if (replacing) {
+      // only root may give a file away; anyone may keep the group if
+      // they are in it. changing owners may clear set-id bits, so the
+      // mode goes last, and past the umask.
+      if (::fchown(fd, info.st_uid, info.st_gid) != 0 &&
+          ::fchown(fd, static_cast<uid_t>(-1), info.st_gid) != 0) {
+        LOG_DEBUG("save of {}: cannot keep its owners", path);
+      }
+      ::fchmod(fd, mode);
+    }
+    bool written = write_runs(fd);
+    if (written && ::fsync(fd) != 0) {
+      fail("sync");
+      written = false;
+    }
+    if (::close(fd) != 0 && written) {
+      fail("close");
+      written = false;
+    }
+    if (written && ::rename(temp_path.c_str(), real_path.c_str()) != 0) {
+      fail("rename");
+      written = false;
+    }
+    if (!written) {
+      ::unlink(temp_path.c_str());
+    } else {
+      // make the rename itself durable.
+      int dir = ::open(directory_of(real_path).c_str(), O_RDONLY);
+      if (dir >= 0) {
+        ::fsync(dir);
+        ::close(dir);
+      }
+      succeeded = true;
+    }
+  }
+  LOG_TRACE("save of {} {}", path, succeeded ? "done" : failure);
+  finished.store(true, std::memory_order_release);
+}
+
+// write every run of the text to fd. returns false on failure.
+// runs are gathered into batches, and a batch is written with one
+// writev, resumed where it left off if the system takes only part.
+bool Background_save::write_runs(int fd)
+{
+  std::vector<Run> runs;
+  text.runs(runs);
+  std::vector<struct iovec> batch;
+  batch.reserve(max_iovecs);
+  auto run = runs.begin();
+  size_type used = 0;  // characters of *run already batched
+  while (run != runs.end()) {
+    batch.clear();
+    size_type batch_length = 0;
+    while (run != runs.end() &&
+           static_cast<int>(batch.size()) < max_iovecs &&
+           batch_length < max_batch) {
+      size_type take = std::min(run->length - used,
+                                max_batch - batch_length);
+      struct iovec v;
+      v.iov_base = const_cast<char *>(run->data + used);
+      v.iov_len = take;
+      batch.push_back(v);
+      batch_length += take;
+      used += take;
+      if (used == run->length) {
+        ++run;
+        used = 0;
+      }
+    }
+
+    struct iovec *next = batch.data();
+    int left = static_cast<int>(batch.size());
+    while (left > 0) {
+      ssize_t n = ::writev(fd, next, left);
+      if (n < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        fail("write");
+        return false;
+      }
+      bytes_written.fetch_add(n, std::memory_order_relaxed);
+      // skip what was written, which may end partway through a run.
+      while (left > 0 && static_cast<size_type>(n) >= next->iov_len) {
+        n -= next->iov_len;
+        ++next;
+        --left;
+      }
+      if (left > 0) {
+        next->iov_base = static_cast<char *>(next->iov_base) + n;
+        next->iov_len -= n;
+      }
+    }
+  }
+  return true;
+}
+
+// note a failure of the named step and what the system said.
+void Background_save::fail(const char *step)
+{
+  failure = std::string(step) + " failed: " + std::strerror(errno);
+}
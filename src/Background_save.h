@@ -0,0 +1,117 @@
+#ifndef BACKGROUND_SAVE_H
+#define BACKGROUND_SAVE_H
+
+// Background_save.h
+//
+// Writes a snapshot of a Buffer's text to its file on a thread of its
+// own, so that editing carries on while a large file is saved.
+// The text goes to a temporary file beside the target in large
+// gathered writes, is synced, and then renamed over the target, so the
+// file on disk is always either the old version or the new one. A
+// target reached through symbolic links is the file they lead to, and
+// it keeps its permissions and owners.
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Piece_table.h"
+
+class Background_save {
+  public:
+    using size_type = Piece_table::size_type;
+    using Run = Piece_table::Run;
+
+    // constructor:
+    // starts writing the text to the file at path_.
+    Background_save(const std::string &path_, Piece_table::Snapshot text_);
+
+    // waits for the save to finish.
+    ~Background_save();
+
+    Background_save(const Background_save &) = delete;
+    Background_save &operator=(const Background_save &) = delete;
+
+    // if the save has finished, well or not.
+    bool done() const;
+
+    // wait for the save to finish.
+    void wait();
+
+    // if the file was saved. only meaningful once done.
+    bool ok() const;
+
+    // why the save failed. only meaningful once done.
+    const std::string &error() const;
+
+    // characters written so far, and in all.
+    size_type written() const;
+    size_type total() const;
+
+    // file being saved to.
+    const std::string &target() const;
+
+  private:
+    // write the file, then mark the save done.
+    void work();
+
+    // write every run of the text to fd. returns false on failure.
+    bool write_runs(int fd);
+
+    // note a failure of the named step and what the system said.
+    void fail(const char *step);
+
+    std::string path;
+    Piece_table::Snapshot text;
+    size_type length;
+
+    std::atomic<size_type> bytes_written;
+    std::atomic<bool> finished;
+
+    // set by the saving thread before finished.
+    bool succeeded;
+    std::string failure;
+
+    std::thread worker;
+};
+
+// inline function definitions
+
+// if the save has finished, well or not.
+inline bool Background_save::done() const
+{
+  return finished.load(std::memory_order_acquire);
+}
+
+// if the file was saved. only meaningful once done.
+inline bool Background_save::ok() const
+{
+  return succeeded;
+}
+
+// why the save failed. only meaningful once done.
+inline const std::string &Background_save::error() const
+{
+  return failure;
+}
+
+// characters written so far.
+inline Background_save::size_type Background_save::written() const
+{
+  return bytes_written.load(std::memory_order_relaxed);
+}
+
+// characters to write in all.
+inline Background_save::size_type Background_save::total() const
+{
+  return length;
+}
+
+// file being saved to.
+inline const std::string &Background_save::target() const
+{
+  return path;
+}
+
+#endif /* BACKGROUND_SAVE_H */
@@ -2,16 +2,21 @@
 //
 // Represents an editing session with a file.
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
-#include <list>
+#include <sstream>
+#include <vector>
+#include <cstdio>
+#include <new>
+#include <utility>
 
 #include "Buffer.h"
+#include "File_map.h"
+#include "Newline_scan.h"
 #include "Utility.h"
 
-#ifndef NDEBUG
-#include "Debug.h"
-#endif /* NDEBUG */
+#include "Log.h"
 
 // default constructor:
 // does not bind to a file.
@@ -22,454 +27,931 @@ Buffer::Buffer() : Buffer("")
 
 // constructor:
 // binds to the given file.
-Buffer::Buffer(const std::string &p) : path(p)
-{
-  // initializes Buffer state to be existing file state, if one exists.
-  std::ifstream state_init(path);
-  // read all existing lines into Buffer.
-  std::string file_line;
-#ifndef NDEBUG
-  std::stringstream ss;
-  ss << "reading lines from file: " << path;
-  Debug::log(ss.str());
-#endif /* NDEBUG */
-  while (getline(state_init, file_line)) {
-    // must be a list<char>, not a string
-    lines.emplace_back(file_line.begin(), file_line.end());
-  }
-  
-  // fails if no line in lines (empty file).
-  // works with empty one because no newline written on last line.
-  if (lines.empty()) {
-    Line empty_line;
-    lines.push_back(empty_line);
-  }
-#ifndef NDEBUG
-  std::string s("finished ");
-  s.append(ss.str());
-  Debug::log(s);
-#endif /* NDEBUG */
-
-  // done with state_init
-  state_init.close();
+// initializes Buffer state to be existing file state, if one exists.
+// the file is mapped, not read: nothing is scanned until it is shown.
+Buffer::Buffer(const std::string &p) : Buffer(p, File_map(p))
+{
+  // empty
+}
+
+// constructor:
+// binds to the given file, whose contents have already been mapped or
+// read.
+Buffer::Buffer(const std::string &p, File_map contents) :
+  text(std::move(contents), arena), history(arena), cursor(0), path(p),
+  pool(new Delta_pool(arena)), journal_failure_shown(false),
+  change_on_disk_shown(false), save_mark(0)
+{
+  LOG_TRACE("mapped file: {} ({} characters)", path, text.size());
 
   // place cursor at start of file.
-  line = lines.begin();
   cursor = very_first_char();
 }
 
+// lets a save in progress finish, then deletes the journal, if there
+// is one: the editor is done with the file.
+Buffer::~Buffer()
+{
+  if (saving) {
+    saving->wait();
+    finish_save();
+  }
+  if (journal) {
+    journal->discard();
+  }
+}
+
 // constructor:
-// takes topmost line that was changed,
-// number of lines that were changed, and
-// starting and final positions of the cursor.
-Buffer::Changeset::Changeset(Line_list::iterator topln,
-                             Line_list::difference_type lines_edited,
+// takes the pool to borrow from (may be null),
+// starting and final positions of the cursor, and
+// the range of lines to redraw and where the first one starts.
+Buffer::Changeset::Changeset(Delta_pool *pool_,
                              Point orig,
-                             Point final) :
+                             Point final,
+                             int top,
+                             int bottom,
+                             size_type topln) :
   cursor_orig(orig),
   cursor_final(final),
-  top_line(utility::min(orig.y, final.y)),
-  bottom_line(utility::max(orig.y, final.y))
-{
-#ifndef NDEBUG
-  Debug::indent();
-  std::stringstream ss;
-  ss << "constructing a Changeset";
-  ss << " with cursors " << "(" << orig.x << "," << orig.y << ")";
-  ss << " -> ";
-  ss << "(" << final.x << "," << final.y << ").";
-  Debug::log(ss.str());
-  Debug::indent();
-#endif /* NDEBUG */
-  while (lines_edited > 0) {
-    changed.emplace_back(begin(*topln), end(*topln));
-    ++topln;
-    --lines_edited;
-#ifndef NDEBUG
-  Debug::log("completed a Changeset construction loop iteration");
-#endif /* NDEBUG */
-  }
-#ifndef NDEBUG
-  Debug::outdent();
-  Debug::log("finished constructing a Changeset");
-  Debug::outdent();
-#endif /* NDEBUG */
+  top_line(top),
+  bottom_line(bottom),
+  top_offset(topln),
+  redraw_below(false),
+  num_local(0),
+  overflow(nullptr),
+  pool(pool_)
+{
+  LOG_INDENT();
+  LOG_TRACE("constructing a Changeset with cursors ({},{}) -> ({},{}).",
+            orig.x, orig.y, final.x, final.y);
+}
+
+Buffer::Changeset::Changeset(Changeset &&other) :
+  Changeset(other.pool, other.cursor_orig, other.cursor_final,
+            other.top_line, other.bottom_line, other.top_offset)
+{
+  *this = std::move(other);
+}
+
+Buffer::Changeset &Buffer::Changeset::operator=(Changeset &&other)
+{
+  if (this != &other) {
+    release();
+    cursor_orig = other.cursor_orig;
+    cursor_final = other.cursor_final;
+    top_line = other.top_line;
+    bottom_line = other.bottom_line;
+    top_offset = other.top_offset;
+    redraw_below = other.redraw_below;
+    num_local = other.num_local;
+    for (size_type i = 0; i < num_local; ++i) {
+      local[i] = other.local[i];
+    }
+    overflow = other.overflow;
+    pool = other.pool;
+    other.overflow = nullptr;
+  }
+  return *this;
+}
+
+Buffer::Changeset::~Changeset()
+{
+  release();
+}
+
+// hand borrowed storage back to the pool.
+void Buffer::Changeset::release()
+{
+  if (overflow != nullptr) {
+    if (pool != nullptr) {
+      pool->give(overflow);
+    } else {
+      delete overflow;
+    }
+    overflow = nullptr;
+  }
+}
+
+// constructor:
+// allocates from the given arena.
+Buffer::Delta_pool::Delta_pool(Arena &arena_) : arena(arena_)
+{
+  // empty
+}
+
+// an empty list, reusing old storage if there is any.
+Buffer::Delta_list *Buffer::Delta_pool::take()
+{
+  if (spare.empty()) {
+    void *memory = arena.allocate(sizeof(Delta_list), alignof(Delta_list));
+    return new (memory) Delta_list(Arena_allocator<Delta>(&arena));
+  }
+  auto deltas = spare.back();
+  spare.pop_back();
+  return deltas;
+}
+
+// return a list to the pool.
+// its storage is kept for the next Changeset that needs it.
+void Buffer::Delta_pool::give(Delta_list *deltas)
+{
+  deltas->clear();
+  spare.push_back(deltas);
+}
+
+Buffer::Delta_pool::~Delta_pool()
+{
+  for (auto deltas : spare) {
+    deltas->~Delta_list();
+    arena.recycle(deltas, sizeof(Delta_list));
+  }
 }
 
+// write the buffer to the file, waiting until it is done.
+// true on success.
 bool Buffer::write()
 {
-  std::ofstream file(path);
-  if (!file) {
-    file.close();
+  if (saving) {
+    saving->wait();
+    finish_save();
+  }
+  if (!start_save()) {
+    std::cout << "write failed" << std::endl;
+    return false;
+  }
+  saving->wait();
+  if (!finish_save()) {
     std::cout << "write failed" << std::endl;
     return false;
   }
+  return true;
+}
 
-  int size = lines.size();
-  int lineindex = 0;
-  for (Line line : lines) {
-    for (char letter : line) {
-      file << letter;
-    }
-    if (lineindex != size - 1) {
-      file << "\n";
-    }
-    lineindex++;
+// start writing the buffer to the file in the background.
+// edits can go on meanwhile: a snapshot of the text as it is now is
+// what gets written.
+// false if a save is already running or there is no file.
+bool Buffer::start_save()
+{
+  if (saving || path.empty()) {
+    return false;
   }
-  file << std::flush;
-  file.close();
+  save_mark = journal ? journal->mark() : 0;
+  saving.reset(new Background_save(path, snapshot()));
   return true;
 }
 
+// the text as it is now, for reading on any thread while editing
+// goes on. must be let go of before the Buffer.
+Piece_table::Snapshot Buffer::snapshot() const
+{
+  return text.snapshot();
+}
+
+// how the save is going, for the status line.
+// how it ended is reported once, as are the journal failing and the
+// file being cut short on disk; empty if there is nothing to report.
+std::string Buffer::save_status()
+{
+  if (text.original_changed() && !change_on_disk_shown) {
+    change_on_disk_shown = true;
+    return path + " changed on disk: what was cut off reads as zeros";
+  }
+  if (journal && !journal->ok() && !journal_failure_shown) {
+    journal_failure_shown = true;
+    return "journal for " + path + " failed: edits are no longer safe "
+           "from a crash";
+  }
+  if (is_saving()) {
+    auto total = saving->total();
+    auto percent = total == 0 ? 100 : saving->written() * 100 / total;
+    return "saving " + path + ": " + std::to_string(percent) + "%";
+  }
+  if (saving) {
+    finish_save();
+  }
+  std::string message;
+  message.swap(save_message);
+  return message;
+}
+
+// once the save has finished, note how it went and let the journal
+// forget the edits that are in the file now.
+// returns if the save worked.
+bool Buffer::finish_save()
+{
+  bool ok = saving->ok();
+  if (ok) {
+    if (journal) {
+      journal->reset(save_mark);
+    }
+    save_message = "saved " + path;
+  } else {
+    save_message = "saving " + path + " failed: " + saving->error();
+    LOG_WARN("{}", save_message);
+  }
+  saving.reset();
+  return ok;
+}
+
 void Buffer::set_path(const std::string &p)
 {
-#ifndef NDEBUG
-  Debug::indent();
-  std::stringstream ss;
-  ss << "starting to set path";
-  ss << " to: " << p;
-  Debug::log(ss.str());
-#endif /* NDEBUG */
+  LOG_INDENT();
+  LOG_TRACE("starting to set path to: {}", p);
   path = p;
-#ifndef NDEBUG
-  Debug::log("finished setting path");
-  Debug::outdent();
-#endif /* NDEBUG */
+  LOG_TRACE("finished setting path");
+}
+
+// journal every edit from now on to a file beside the one being
+// edited, so that a crash loses almost nothing. edits left in a
+// journal by an editor that died are replayed first.
+// returns the number of edits recovered.
+Buffer::size_type Buffer::start_journal()
+{
+  if (path.empty()) {
+    return 0;
+  }
+  journal.reset(new Journal(path, [this](size_type offset, size_type removed,
+                                         const char *chars, size_type count) {
+    return replay_edit(offset, removed, chars, count);
+  }));
+  LOG_TRACE("journaling to {}: recovered {} edits",
+            Journal::path_for(path), journal->recovered());
+  return journal->recovered();
+}
+
+
+// append the text of the line starting at pos to out.
+// only count characters from column first on are copied.
+// returns the position of the start of the next line,
+// or npos if this is the last one.
+Buffer::size_type Buffer::copy_line(size_type pos, std::string &out,
+                                    size_type first /* = 0 */,
+                                    size_type count /* = npos */) const
+{
+  auto endln = line_end(pos);
+  if (first < endln - pos) {
+    text.copy(pos + first, std::min(count, endln - pos - first), out);
+  }
+  return endln == very_end_char() ? Piece_table::npos : endln + 1;
+}
+
+// position of the first character of the given line (from 0).
+// lines near the cursor are found by searching outward from it,
+// which never waits for the line index; others through the index.
+Buffer::size_type Buffer::line_offset(int line_num) const
+{
+  int distance = line_num - cursor_pos.y;
+  if (distance > nearby_lines || distance < -nearby_lines) {
+    return text.line_offset(line_num);
+  }
+  auto pos = local_first_char();
+  for (; distance < 0; ++distance) {
+    pos = line_start(pos - 1);
+  }
+  for (; distance > 0; --distance) {
+    auto endln = line_end(pos);
+    if (endln == very_end_char()) {
+      return endln;
+    }
+    pos = endln + 1;
+  }
+  return pos;
+}
+
+// Changeset for a command that started with the cursor at orig,
+// redrawing lines [top, bottom], the first of which starts at topln.
+Buffer::Changeset
+Buffer::changeset(Point orig, size_type topln, int top, int bottom)
+{
+  return Changeset(pool.get(), orig, cursor_pos, top, bottom, topln);
 }
 
 // insert the given character before the cursor.
-std::unique_ptr<Buffer::Changeset>
-Buffer::insert(const int &character)
-{
-#ifndef NDEBUG
-  Debug::indent();
-  std::stringstream ss;
-  ss << "performing insert for " << static_cast<char>(character);
-  Debug::log(ss.str());
-#endif /* NDEBUG */
+Buffer::Changeset Buffer::insert(const int &character)
+{
+  LOG_INDENT();
+  LOG_TRACE("performing insert for {}", static_cast<char>(character));
   //TODO: update this when line length limiting is implemented.
-  line->insert(cursor, character);
+  char letter = static_cast<char>(character);
   auto orig_pos = cursor_pos;
+  Delta edit = { cursor, 0, 1 };
+  insert_text(cursor, &letter, 1, Undo_history::Kind::typing);
+  ++cursor;
   ++cursor_pos.x;
-  
-  std::unique_ptr<Changeset> ret(
-      new Changeset(line, 1, orig_pos, cursor_pos));
-#ifndef NDEBUG
-  std::string s("finished ");
-  s.append(ss.str());
-  Debug::log(s);
-  Debug::outdent();
-#endif /* NDEBUG */
+
+  Changeset ret = changeset(orig_pos, local_first_char(),
+                            cursor_pos.y, cursor_pos.y);
+  ret.add_delta(edit);
+  LOG_TRACE("finished performing insert for {}",
+            static_cast<char>(character));
+  return ret;
+}
+
+// insert count characters before the cursor, as one edit.
+// the characters may include line breaks.
+// the cursor ends up just after them.
+Buffer::Changeset Buffer::insert(const char *chars, size_type count)
+{
+  LOG_INDENT();
+  LOG_TRACE("performing insert of {} characters", count);
+  auto orig_pos = cursor_pos;
+  auto top = local_first_char();
+  Delta edit = { cursor, 0, count };
+  // typing fast arrives here too; a burst with line breaks in it is
+  // more likely pasted, and is a step of its own.
+  bool pasted = newline_scan::find_first(chars, count) < count;
+  insert_text(cursor, chars, count, pasted ? Undo_history::Kind::other :
+                                             Undo_history::Kind::typing);
+  cursor += count;
+
+  // the cursor moves down a line for each line break, and lands just
+  // after the characters following the last one.
+  int breaks = 0;
+  size_type last_break = Piece_table::npos;
+  for (size_type i = newline_scan::find_first(chars, count); i < count;
+       i += 1 + newline_scan::find_first(chars + i + 1, count - i - 1)) {
+    ++breaks;
+    last_break = i;
+  }
+  if (breaks == 0) {
+    cursor_pos.x += count;
+  } else {
+    cursor_pos.y += breaks;
+    cursor_pos.x = count - last_break - 1;
+  }
+
+  Changeset ret = changeset(orig_pos, top, orig_pos.y, cursor_pos.y);
+  ret.add_delta(edit);
+  // lines below have moved down.
+  ret.redraw_below = (breaks > 0);
+  LOG_TRACE("finished performing insert of {} characters", count);
   return ret;
 }
 
+// add count characters at the very end, leaving the cursor where it is.
+// for text the editor writes itself, e.g. results: it is not journaled,
+// nor can it be undone. the edits before it can, since their offsets
+// are all before the end.
+Buffer::Changeset Buffer::append(const char *chars, size_type count)
+{
+  auto orig_pos = cursor_pos;
+  auto end = very_end_char();
+  int top = static_cast<int>(text.line_of(end));
+  Delta edit = { end, 0, count };
+  text.insert(end, chars, count);
+
+  Changeset ret = changeset(orig_pos, line_start(end), top, top);
+  ret.add_delta(edit);
+  // the text added may be any number of lines.
+  ret.redraw_below = true;
+  return ret;
+}
+
+// replace every one of matches, which are in order and do not overlap,
+// by with, as one edit: a single step to undo.
+// in with, \0 stands for the text matched, \n and \t for a line break
+// and a tab, and \ before anything else for that character.
+// the text is changed once, however many matches there are: the new
+// text is added to the add buffer once, if it does not use the match,
+// and the span from the first match to the last is rebuilt in a pass.
+// the cursor stays on the same text, or goes to the start of the match
+// it was in.
+Buffer::Changeset Buffer::replace_all(const std::vector<Regex::Match> &matches,
+                                      const std::string &with)
+{
+  LOG_INDENT();
+  LOG_TRACE("performing replace_all of {} matches", matches.size());
+  auto orig_pos = cursor_pos;
+  if (matches.empty()) {
+    return changeset(orig_pos, local_first_char(),
+                     cursor_pos.y, cursor_pos.y - 1);
+  }
+
+  // with, cut where the text matched goes.
+  std::vector<std::string> parts(1);
+  for (size_type i = 0; i < with.size(); ++i) {
+    char c = with[i];
+    if (c == '\\' && i + 1 < with.size()) {
+      c = with[++i];
+      if (c == '0') {
+        parts.emplace_back();
+        continue;
+      }
+      c = c == 'n' ? '\n' : c == 't' ? '\t' : c;
+    }
+    parts.back().push_back(c);
+  }
+
+  std::vector<Piece_table::Replacement> ranges;
+  ranges.reserve(matches.size());
+  std::string added = parts.size() == 1 ? parts[0] : std::string();
+  for (const auto &m : matches) {
+    Piece_table::Replacement range = { m.start, m.length, 0, added.size() };
+    if (parts.size() > 1) {
+      range.with_start = added.size();
+      for (size_type i = 0; i < parts.size(); ++i) {
+        if (i > 0) {
+          text.copy(m.start, m.length, added);
+        }
+        added += parts[i];
+      }
+      range.with_length = added.size() - range.with_start;
+    }
+    ranges.push_back(range);
+  }
+
+  auto first = matches.front().start;
+  auto last = matches.back().start + matches.back().length;
+  Undo_history::Piece_list removed{ Arena_allocator<Piece_table::Piece>(
+      &arena) };
+  text.replace_all(ranges, added.data(), added.size(), &removed);
+
+  // the journal replays the replacements one by one, each where the
+  // ones before it have left it.
+  size_type new_cursor = cursor;
+  size_type shift = 0;
+  for (const auto &range : ranges) {
+    if (journal) {
+      journal->record(range.start + shift, range.length,
+                      added.data() + range.with_start, range.with_length);
+    }
+    if (range.start < cursor) {
+      new_cursor = range.start + range.length <= cursor ?
+                   cursor + shift + range.with_length - range.length :
+                   range.start + shift;
+    }
+    shift += range.with_length - range.length;
+  }
+  size_type inserted = last - first + shift;
+  history.record(Undo_history::Kind::other, cursor, first,
+                 std::move(removed), inserted);
+
+  cursor = new_cursor;
+  cursor_pos.y = text.line_of(cursor);
+  cursor_pos.x = cursor - text.line_offset(cursor_pos.y);
+  int top = text.line_of(first);
+  Changeset ret = changeset(orig_pos, line_start(first), top, top);
+  Delta edit = { first, last - first, inserted };
+  ret.add_delta(edit);
+  // lines may have come or gone anywhere below the first match.
+  ret.redraw_below = true;
+  LOG_TRACE("finished performing replace_all");
+  return ret;
+}
+
+// undo the last group of edits, putting the cursor back where it
+// was before them.
+// takes time in proportion to the size of the edits, not the text.
+Buffer::Changeset Buffer::do_undo()
+{
+  LOG_INDENT();
+  LOG_TRACE("performing do_undo");
+  Changeset ret = replay_history(false);
+  LOG_TRACE("finished performing do_undo");
+  return ret;
+}
+
+// redo the last group of edits undone, leaving the cursor after them.
+Buffer::Changeset Buffer::do_redo()
+{
+  LOG_INDENT();
+  LOG_TRACE("performing do_redo");
+  Changeset ret = replay_history(true);
+  LOG_TRACE("finished performing do_redo");
+  return ret;
+}
+
+// keep about bytes of undo history.
+void Buffer::set_undo_budget(std::size_t bytes)
+{
+  history.set_budget(bytes);
+}
+
+// Changeset for undoing or redoing: fills the Deltas from the
+// changes history makes to the text, and redraws from the first.
+// lines may have come or gone anywhere below it.
+Buffer::Changeset Buffer::replay_history(bool redo)
+{
+  auto orig_pos = cursor_pos;
+  std::vector<Delta> deltas;
+  size_type first = Piece_table::npos;
+  std::string chars;
+  auto changed = [&](size_type offset, size_type removed,
+                     size_type inserted) {
+    Delta d = { offset, removed, inserted };
+    deltas.push_back(d);
+    first = std::min(first, offset);
+    if (journal) {
+      chars.clear();
+      text.copy(offset, inserted, chars);
+      journal->record(offset, removed, chars.data(), chars.size());
+    }
+  };
+  bool replayed = redo ? history.redo(text, cursor, changed) :
+                         history.undo(text, cursor, changed);
+  if (!replayed) {
+    return changeset(orig_pos, local_first_char(),
+                     cursor_pos.y, cursor_pos.y - 1);
+  }
+  cursor_pos.y = text.line_of(cursor);
+  cursor_pos.x = cursor - text.line_offset(cursor_pos.y);
+  int top = text.line_of(first);
+  Changeset ret = changeset(orig_pos, line_start(first), top, top);
+  for (const auto &d : deltas) {
+    ret.add_delta(d);
+  }
+  ret.redraw_below = true;
+  return ret;
+}
+
+// insert count characters before pos, recording the edit as kind.
+void Buffer::insert_text(size_type pos, const char *chars, size_type count,
+                         Undo_history::Kind kind)
+{
+  text.insert(pos, chars, count);
+  if (journal) {
+    journal->record(pos, 0, chars, count);
+  }
+  Undo_history::Piece_list removed{ Arena_allocator<Piece_table::Piece>(
+      &arena) };
+  history.record(kind, cursor, pos, std::move(removed), count);
+}
+
+// erase count characters at pos, recording the edit as kind.
+// the pieces erased are kept by the history, not copied.
+void Buffer::erase_text(size_type pos, size_type count,
+                        Undo_history::Kind kind)
+{
+  Undo_history::Piece_list removed{ Arena_allocator<Piece_table::Piece>(
+      &arena) };
+  text.erase(pos, count, &removed);
+  if (journal) {
+    journal->record(pos, count, "", 0);
+  }
+  history.record(kind, cursor, pos, std::move(removed), 0);
+}
+
+// apply an edit recovered from the journal.
+// it is not recorded again, nor can it be undone.
+// returns false if it does not fit the text.
+bool Buffer::replay_edit(size_type offset, size_type removed,
+                         const char *chars, size_type count)
+{
+  if (offset > text.size() || removed > text.size() - offset) {
+    return false;
+  }
+  text.erase(offset, removed);
+  text.insert(offset, chars, count);
+  return true;
+}
+
 // place cursor at beginning of line above.
 // stops at first line.
 // makes no changes to file text
-std::unique_ptr<Buffer::Changeset>
-Buffer::do_up(const int &num_lines /* = 1 */)
-{
-#ifndef NDEBUG
-  Debug::indent();
-  Debug::log("performing do_up");
-#endif /* NDEBUG */
-  Line_list::difference_type moves = 0;
+Buffer::Changeset Buffer::do_up(const int &num_lines /* = 1 */)
+{
+  LOG_INDENT();
+  LOG_TRACE("performing do_up");
   auto orig_pos = cursor_pos;
-  auto first = begin(lines);
-  while(moves < num_lines && line != first) {
-    --line;
-    --cursor_pos.y;
-    ++moves;
-  }
-  cursor = local_first_char();
+  // a line nearby is found from the cursor, without waiting for the
+  // line index; one far above through it.
+  int line_num = utility::max(cursor_pos.y - num_lines, 0);
+  cursor = line_offset(line_num);
+  cursor_pos.y = line_num;
   cursor_pos.x = 0;
 
-  std::unique_ptr<Changeset> ret(
-      new Changeset(line, 0, orig_pos, cursor_pos));
-#ifndef NDEBUG
-  Debug::log("finished performing do_up");
-  Debug::outdent();
-#endif /* NDEBUG */
+  Changeset ret = changeset(orig_pos, cursor,
+                            cursor_pos.y, cursor_pos.y - 1);
+  LOG_TRACE("finished performing do_up");
   return ret;
 }
 
 // place cursor at beginning of line below.
 // stops at last line.
 // makes no changes to file text
-std::unique_ptr<Buffer::Changeset>
-Buffer::do_down(const int &num_lines /* = 1 */)
-{
-#ifndef NDEBUG
-  Debug::indent();
-  Debug::log("performing do_down");
-#endif /* NDEBUG */
-  Line_list::difference_type moves = 0;
+Buffer::Changeset Buffer::do_down(const int &num_lines /* = 1 */)
+{
+  LOG_INDENT();
+  LOG_TRACE("performing do_down");
   auto orig_pos = cursor_pos;
-  auto endln = --end(lines);
-  auto top = line;
-  while(moves < num_lines && line != endln) {
-    ++line;
-    ++moves;
-    ++cursor_pos.y;
+  auto top = local_first_char();
+  if (num_lines <= nearby_lines) {
+    // step down a line at a time, without waiting for the line index,
+    // stopping at the last.
+    cursor = top;
+    for (int k = 0; k < num_lines; ++k) {
+      auto endln = line_end(cursor);
+      if (endln == very_end_char()) {
+        break;
+      }
+      cursor = endln + 1;
+      ++cursor_pos.y;
+    }
+  } else {
+    // jump straight to a line far below through the line index.
+    int last_line = text.line_count() - 1;
+    cursor_pos.y = utility::min(cursor_pos.y + num_lines, last_line);
+    cursor = text.line_offset(cursor_pos.y);
   }
-  cursor = local_first_char();
   cursor_pos.x = 0;
 
-  std::unique_ptr<Changeset> ret(
-      new Changeset(top, 0, orig_pos, cursor_pos));
-#ifndef NDEBUG
-  Debug::log("finished performing do_down");
-  Debug::outdent();
-#endif /* NDEBUG */
+  Changeset ret = changeset(orig_pos, top, orig_pos.y, orig_pos.y - 1);
+  LOG_TRACE("finished performing do_down");
   return ret;
 }
 
 // move the cursor left, possibly wrapping to previous line.
 // Stops at first position of first line.
+// crosses whole lines at a time, using their lengths.
 // makes no changes to file text
-std::unique_ptr<Buffer::Changeset>
-Buffer::do_left(const int &num_moves /* = 1 */)
-{
-#ifndef NDEBUG
-  Debug::indent();
-  std::stringstream ss;
-  ss << "performing do_left " << num_moves << " times.";
-  Debug::log(ss.str());
-  Debug::indent();
-#endif /* NDEBUG */
-  Line_list::difference_type moves = 0;
+Buffer::Changeset Buffer::do_left(const int &num_moves /* = 1 */)
+{
+  LOG_INDENT();
+  LOG_TRACE("performing do_left {} times.", num_moves);
   auto orig_pos = cursor_pos;
-  // very first character
-  auto first = very_first_char();
+  size_type moves = utility::max(num_moves, 0);
   // first character of this line
   auto local_first = local_first_char();
-  while (moves < num_moves && cursor != first) {
-    // if should wrap left, and can
-    if (cursor == local_first) {
-#ifndef NDEBUG
-  Debug::log("wrapping to upper line");
-#endif /* NDEBUG */
-      --line;
-      local_first = local_first_char();
-      cursor = local_end_char();  // wrap over newline, but not next char.
-      --cursor_pos.y;
-      cursor_pos.x = line->size();
-      ++moves;
-    } else { // else just move left
-#ifndef NDEBUG
-  Debug::log("moving left");
-#endif /* NDEBUG */
-      --cursor;
-      --cursor_pos.x;
-      ++moves;
-    }
+  // while the moves reach past the start of this line, jump over the
+  // line break to the end of the line above.
+  while (moves > static_cast<size_type>(cursor_pos.x) && cursor_pos.y > 0) {
+    LOG_TRACE("wrapping to upper line");
+    moves -= cursor_pos.x + 1;
+    cursor = local_first - 1;
+    local_first = line_start(cursor);
+    --cursor_pos.y;
+    cursor_pos.x = cursor - local_first;
   }
-
-  std::unique_ptr<Changeset> ret(
-      new Changeset(line, 0, orig_pos, cursor_pos));
-#ifndef NDEBUG
-  Debug::outdent();
-  Debug::log("finished performing do_left");
-  Debug::outdent();
-#endif /* NDEBUG */
+  // the rest are on this line.
+  auto step = std::min(moves, static_cast<size_type>(cursor_pos.x));
+  cursor -= step;
+  cursor_pos.x -= step;
+
+  Changeset ret = changeset(orig_pos, local_first,
+                            cursor_pos.y, cursor_pos.y - 1);
+  LOG_TRACE("finished performing do_left");
   return ret;
 }
 
 // move the cursor right, possibly wrapping to next line.
 // Stops after last position of last line.
+// crosses whole lines at a time, using their lengths.
 // makes no changes to file text
-std::unique_ptr<Buffer::Changeset>
-Buffer::do_right(const int &num_moves /* = 1 */)
-{
-#ifndef NDEBUG
-  Debug::indent();
-  std::stringstream ss;
-  ss << "performing do_right " << num_moves << " times.";
-  Debug::log(ss.str());
-  Debug::indent();
-#endif /* NDEBUG */
-  Line_list::difference_type moves = 0;
+Buffer::Changeset Buffer::do_right(const int &num_moves /* = 1 */)
+{
+  LOG_INDENT();
+  LOG_TRACE("performing do_right {} times.", num_moves);
   auto orig_pos = cursor_pos;
+  size_type moves = utility::max(num_moves, 0);
   // after very last character
   auto last = very_end_char();
   // after last character of this line
   auto local_last = local_end_char();
-  while (moves < num_moves && cursor != last) {
-    // if should wrap right, and can
-    if (cursor == local_last) {
-#ifndef NDEBUG
-  Debug::outdent();
-  Debug::log("wrapping to lower line");
-#endif /* NDEBUG */
-      ++line;
-      local_last = local_end_char();
-      cursor = local_first_char();  // wrap over newline, but not next char.
-      ++cursor_pos.y;
-      cursor_pos.x = 0;
-      ++moves;
-    } else { // else just move right
-#ifndef NDEBUG
-  Debug::log("moving right");
-#endif /* NDEBUG */
-      ++cursor;
-      ++cursor_pos.x;
-      ++moves;
-    }
+  // while the moves reach past the end of this line, jump over the
+  // line break to the start of the line below.
+  while (moves > local_last - cursor && local_last != last) {
+    LOG_TRACE("wrapping to lower line");
+    moves -= local_last - cursor + 1;
+    cursor = local_last + 1;
+    ++cursor_pos.y;
+    cursor_pos.x = 0;
+    local_last = local_end_char();
   }
-
-  std::unique_ptr<Changeset> ret(
-      new Changeset(line, 0, orig_pos, cursor_pos));
-#ifndef NDEBUG
-  Debug::outdent();
-  Debug::log("finished performing do_right");
-  Debug::outdent();
-#endif /* NDEBUG */
+  // the rest are on this line.
+  auto step = std::min(moves, local_last - cursor);
+  cursor += step;
+  cursor_pos.x += step;
+
+  Changeset ret = changeset(orig_pos, local_first_char(),
+                            cursor_pos.y, cursor_pos.y - 1);
+  LOG_TRACE("finished performing do_right");
   return ret;
 }
 
 // perform necessary actions to handle pressing of BACKSPACE.
-std::unique_ptr<Buffer::Changeset>
-Buffer::do_backspace(const int &num_presses /* = 1 */)
-{
-#ifndef NDEBUG
-  Debug::indent();
-  Debug::log("performing do_backspace");
-#endif /* NDEBUG */
-  Line_list::difference_type num_done = 0;
-  std::unique_ptr<Changeset> ret(
-    new Changeset(line, 0, cursor_pos, cursor_pos));
+Buffer::Changeset Buffer::do_backspace(const int &num_presses /* = 1 */)
+{
+  LOG_INDENT();
+  LOG_TRACE("performing do_backspace");
+  int num_done = 0;
+  Changeset ret = changeset(cursor_pos, local_first_char(),
+                            cursor_pos.y, cursor_pos.y - 1);
   auto first = very_first_char();
   while (cursor != first && num_done < num_presses) {
-    ret->append(*do_left());
-    ret->append(*do_delete());
+    Changeset left = do_left();
+    ret.append(left);
+    Changeset deleted = do_delete();
+    ret.append(deleted);
     ++num_done;
   }
-#ifndef NDEBUG
-  Debug::log("finished performing do_backspace");
-  Debug::outdent();
-#endif /* NDEBUG */
+  LOG_TRACE("finished performing do_backspace");
   return ret;
 }
 
 // perform necessary actions to handle pressing of DELETE.
-std::unique_ptr<Buffer::Changeset>
-Buffer::do_delete(const int &num_presses /* = 1 */)
-{
-  //TODO: update Window::update to work if lines are merged
-#ifndef NDEBUG
-  Debug::indent();
-  Debug::log("performing do_delete");
-#endif /* NDEBUG */
-  Line_list::difference_type num_done = 0;
+// deleting a line break joins the line below onto this one,
+// which moves every line below up.
+Buffer::Changeset Buffer::do_delete(const int &num_presses /* = 1 */)
+{
+  LOG_INDENT();
+  LOG_TRACE("performing do_delete");
+  size_type num_done = 0;
   int wraps = 0;
-  auto endln = very_end_char();
-  while (cursor != endln && num_done < num_presses) {
-    if (cursor == local_end_char()) {
+  while (cursor + num_done != very_end_char() &&
+         num_done < static_cast<size_type>(num_presses)) {
+    if (text.at(cursor + num_done) == '\n') {
       // delete line break: join line with next
-      auto next = line;
-      ++next;
-      line->insert(cursor, begin(*next), end(*next));
-    } else {
-      cursor = line->erase(cursor);
-      // cursor ends up on element after one erased
+      ++wraps;
     }
     ++num_done;
   }
+  Delta edit = { cursor, num_done, 0 };
+  erase_text(cursor, num_done, Undo_history::Kind::deleting);
 
   // cursor doesn't move
-  std::unique_ptr<Changeset> ret(
-      new Changeset(line, wraps + 1, cursor_pos, cursor_pos));
-#ifndef NDEBUG
-  Debug::log("finished performing do_delete");
-  Debug::outdent();
-#endif /* NDEBUG */
+  Changeset ret = changeset(cursor_pos, local_first_char(),
+                            cursor_pos.y, cursor_pos.y);
+  ret.add_delta(edit);
+  ret.redraw_below = wraps > 0;
+  LOG_TRACE("finished performing do_delete");
   return ret;
 }
 
 // perform necessary actions to handle pressing of ENTER.
 // insert a line break before character under cursor.
-std::unique_ptr<Buffer::Changeset>
-Buffer::do_enter(const int &num_presses /* = 1 */)
-{
-#ifndef NDEBUG
-  Debug::indent();
-  Debug::log("performing do_enter");
-  Debug::indent();
-#endif /* NDEBUG */
-  Line_list::difference_type num_done = 0;
+// every line below moves down.
+Buffer::Changeset Buffer::do_enter(const int &num_presses /* = 1 */)
+{
+  LOG_INDENT();
+  LOG_TRACE("performing do_enter");
+  int num_done = 0;
   auto orig_pos = cursor_pos;
-  auto top = line;
+  auto top = local_first_char();
+  Delta edit = { cursor, 0, 0 };
+  // line breaks go before the cursor, which moves to the last new line.
+  const std::string newlines(utility::max(num_presses, 0), '\n');
+  insert_text(cursor, newlines.data(), newlines.size(),
+              Undo_history::Kind::other);
   while (num_done < num_presses) {
-#ifndef NDEBUG
-  Debug::log("doing an enter");
-#endif /* NDEBUG */
-    auto curr_end = local_end_char();
-    // cursor can never be past end of lines, so always safe to increment.
-    ++line;
+    LOG_TRACE("doing an enter");
+    ++cursor;
     ++cursor_pos.y;
-    // insert empty line
-    line = lines.emplace(line);
-    // move over old elements
-    auto dest = line--;
-    dest->splice(begin(*dest), *line, cursor, end(*line));
-    ++line;
-    cursor = local_first_char();
+    ++edit.inserted;
     ++num_done;
   }
   cursor_pos.x = 0;
 
-  std::unique_ptr<Changeset> ret(
-      new Changeset(top, num_done + 1, orig_pos, cursor_pos));
-#ifndef NDEBUG
-  Debug::outdent();
-  Debug::log("finished performing do_enter");
-  Debug::outdent();
-#endif /* NDEBUG */
+  Changeset ret = changeset(orig_pos, top, orig_pos.y, cursor_pos.y);
+  ret.add_delta(edit);
+  ret.redraw_below = true;
+  LOG_TRACE("finished performing do_enter");
+  return ret;
+}
+
+// place cursor at beginning of the given line (from 0).
+// stops at first and last lines.
+// makes no changes to file text
+Buffer::Changeset Buffer::do_goto_line(const int &line_num)
+{
+  LOG_INDENT();
+  LOG_TRACE("performing do_goto_line {}", line_num);
+  auto orig_pos = cursor_pos;
+  int last_line = text.line_count() - 1;
+  cursor_pos.y = utility::max(utility::min(line_num, last_line), 0);
+  cursor = text.line_offset(cursor_pos.y);
+  cursor_pos.x = 0;
+
+  Changeset ret = changeset(orig_pos, cursor,
+                            cursor_pos.y, cursor_pos.y - 1);
+  LOG_TRACE("finished performing do_goto_line");
+  return ret;
+}
+
+// place cursor on the character at the given position in the file.
+// stops after last position of last line.
+// a position near the cursor is found by searching outward from it,
+// which never waits for the line index; others through the index.
+// makes no changes to file text
+Buffer::Changeset Buffer::do_goto_offset(const size_type &offset)
+{
+  LOG_INDENT();
+  LOG_TRACE("performing do_goto_offset {}", offset);
+  auto orig_pos = cursor_pos;
+  auto target = offset < very_end_char() ? offset : very_end_char();
+  auto local_first = local_first_char();
+  bool found = false;
+  if (target >= local_first) {
+    for (int k = 0; k <= nearby_lines && !found; ++k) {
+      auto endln = line_end(local_first);
+      found = target <= endln;
+      if (!found) {
+        local_first = endln + 1;
+        ++cursor_pos.y;
+      }
+    }
+  } else {
+    for (int k = 0; k < nearby_lines && !found; ++k) {
+      local_first = line_start(local_first - 1);
+      --cursor_pos.y;
+      found = target >= local_first;
+    }
+  }
+  if (!found) {
+    cursor_pos.y = text.line_of(target);
+    local_first = text.line_offset(cursor_pos.y);
+  }
+  cursor = target;
+  cursor_pos.x = cursor - local_first;
+
+  Changeset ret = changeset(orig_pos, local_first,
+                            cursor_pos.y, cursor_pos.y - 1);
+  LOG_TRACE("finished performing do_goto_offset");
+  return ret;
+}
+
+// show num_lines lines, starting with the current one.
+// only those lines are read from the file.
+// makes no changes to file text
+Buffer::Changeset Buffer::do_redraw(const int &num_lines)
+{
+  LOG_INDENT();
+  LOG_TRACE("performing do_redraw");
+  Changeset ret = changeset(cursor_pos, local_first_char(),
+                            cursor_pos.y, cursor_pos.y + num_lines - 1);
+  LOG_TRACE("finished performing do_redraw");
   return ret;
 }
 
 // perform necessary actions to handle pressing of HOME.
 // place cursor on first character of line.
 // makes no changes to file text
-std::unique_ptr<Buffer::Changeset> Buffer::do_home()
+Buffer::Changeset Buffer::do_home()
 {
-#ifndef NDEBUG
-  Debug::indent();
-  Debug::log("performing do_home");
-#endif /* NDEBUG */
+  LOG_INDENT();
+  LOG_TRACE("performing do_home");
   auto orig_pos = cursor_pos;
   cursor = local_first_char();
   cursor_pos.x = 0;
 
-  std::unique_ptr<Changeset> ret(
-      new Changeset(line, 0, orig_pos, cursor_pos));
-#ifndef NDEBUG
-  Debug::log("finished performing do_home");
-  Debug::outdent();
-#endif /* NDEBUG */
+  Changeset ret = changeset(orig_pos, cursor,
+                            cursor_pos.y, cursor_pos.y - 1);
+  LOG_TRACE("finished performing do_home");
   return ret;
 }
 
 // perform necessary actions to handle pressing of END.
 // place cursor after last character of line.
 // makes no changes to file text
-std::unique_ptr<Buffer::Changeset> Buffer::do_end()
+Buffer::Changeset Buffer::do_end()
 {
-#ifndef NDEBUG
-  Debug::indent();
-  Debug::log("performing do_end");
-#endif /* NDEBUG */
+  LOG_INDENT();
+  LOG_TRACE("performing do_end");
   auto orig_pos = cursor_pos;
+  auto local_first = local_first_char();
   cursor = local_end_char();
-  cursor_pos.x = line->size();
+  cursor_pos.x = cursor - local_first;
 
-  std::unique_ptr<Changeset> ret(
-      new Changeset(line, 0, orig_pos, cursor_pos));
+  Changeset ret = changeset(orig_pos, local_first,
+                            cursor_pos.y, cursor_pos.y - 1);
+  LOG_TRACE("finished performing do_end");
   return ret;
-#ifndef NDEBUG
-  Debug::log("finished performing do_end");
-  Debug::outdent();
-#endif /* NDEBUG */
+}
+
+// record an edit, merging it into the last one if they touch.
+// typing a word, or deleting one a character at a time, is then a
+// single Delta however long it is.
+void Buffer::Changeset::add_delta(const Delta &delta)
+{
+  if (delta.removed == 0 && delta.inserted == 0) {
+    return;
+  }
+  if (num_deltas() > 0) {
+    Delta &last = overflow ? overflow->back() : local[num_local - 1];
+    // text that last inserted is [last.offset, last.offset + inserted).
+    auto last_end = last.offset + last.inserted;
+    auto delta_end = delta.offset + delta.removed;
+    if (delta.offset <= last_end && delta_end >= last.offset) {
+      // removed text before and after what last inserted was in the
+      // text before last; the rest was inserted by last.
+      auto before = last.offset > delta.offset ?
+                    last.offset - delta.offset : 0;
+      auto after = delta_end > last_end ? delta_end - last_end : 0;
+      auto inside = delta.removed - before - after;
+      last.offset = utility::min(last.offset, delta.offset);
+      last.removed += before + after;
+      last.inserted = last.inserted - inside + delta.inserted;
+      return;
+    }
+  }
+  if (num_local < inline_deltas) {
+    local[num_local++] = delta;
+    return;
+  }
+  if (overflow == nullptr) {
+    overflow = pool ? pool->take() : new Delta_list;
+  }
+  overflow->push_back(delta);
 }
 
 // append another Changeset to this one, so that this one includes
@@ -477,103 +959,34 @@ std::unique_ptr<Buffer::Changeset> Buffer::do_end()
 // invalidates the other Changeset.
 void Buffer::Changeset::append(Changeset &other)
 {
-#ifndef NDEBUG
-  Debug::indent();
-  Debug::log("performing append");
-  Debug::indent();
-#endif /* NDEBUG */
+  LOG_INDENT();
+  LOG_TRACE("performing append");
   if (cursor_final != other.cursor_orig) {
-#ifndef NDEBUG
-    Debug::outdent();
-  Debug::log("finished performing append: nonadjacent input received");
-    Debug::outdent();
-#endif /* NDEBUG */
+    LOG_TRACE("finished performing append: nonadjacent input received");
     return;
   }
 
-  int lowest_top = utility::max(top_line, other.top_line);
-  int highest_bottom = utility::min(bottom_line, other.bottom_line);
-
-  // replace overlapping section with other's
-  if ((lowest_top < highest_bottom) ||
-      ((top_line == bottom_line) &&
-       (other.top_line == other.bottom_line))) {
-#ifndef NDEBUG
-  Debug::log("replacing overlapping section");
-#endif /* NDEBUG */
-    auto overlap_top_this = begin(changed),
-         overlap_bottom_this = end(changed),
-         overlap_top_other = begin(other.changed),
-         overlap_bottom_other = end(other.changed);
-    // position top_this
-    for (int i = top_line; i < lowest_top; ++i) {
-      ++overlap_top_this;
-    }
-    // position top_other
-    for (int i = other.top_line; i < lowest_top; ++i) {
-      ++overlap_top_other;
-    }
-    // position bottom_this
-    for (int i = bottom_line; i > highest_bottom; --i) {
-      --overlap_bottom_this;
-    }
-    // position bottom_other
-    for (int i = other.bottom_line; i > highest_bottom; --i) {
-      --overlap_bottom_other;
-    }
-    
-    // delete old section
-    changed.erase(overlap_top_this, overlap_bottom_this);
-    // insert new section
-    changed.splice(overlap_top_this,
-                   other.changed,
-                   overlap_top_other,
-                   overlap_bottom_other);
-  }
-
-  // prepend extra beginning section
-  if (other.top_line < top_line) {
-#ifndef NDEBUG
-  Debug::log("prepending section");
-#endif /* NDEBUG */
-    auto prepend_bottom_other = begin(other.changed);
-    // position bottom_other
-    for (int i = other.top_line; i < top_line; ++i) {
-      ++prepend_bottom_other;
-    }
-
-    // prepend section
-    changed.splice(begin(changed),
-                   other.changed,
-                   begin(other.changed),
-                   prepend_bottom_other);
-  }
-
-  // append extra ending section
-  if (bottom_line < other.bottom_line) {
-#ifndef NDEBUG
-  Debug::log("appending section");
-#endif /* NDEBUG */
-    auto append_top_other = end(other.changed);
-    // position top_other
-    for (int i = other.bottom_line; i > bottom_line; --i) {
-      --append_top_other;
+  // lines to redraw: the union of both ranges.
+  // other's line numbers are current, so prefer its top line.
+  if (other.bottom_line >= other.top_line) {
+    if (bottom_line < top_line) {
+      top_line = other.top_line;
+      bottom_line = other.bottom_line;
+      top_offset = other.top_offset;
+    } else {
+      bottom_line = utility::max(bottom_line, other.bottom_line);
+      if (other.top_line <= top_line) {
+        top_line = other.top_line;
+        top_offset = other.top_offset;
+      }
     }
-
-    // append section
-    changed.splice(end(changed),
-                   other.changed,
-                   append_top_other,
-                   end(other.changed));
   }
+  redraw_below = redraw_below || other.redraw_below;
 
-  top_line = utility::min(top_line, other.top_line);
-  bottom_line = utility::max(bottom_line, other.bottom_line);
+  for (size_type i = 0; i < other.num_deltas(); ++i) {
+    add_delta(other.delta(i));
+  }
   cursor_final = other.cursor_final;
 
-#ifndef NDEBUG
-  Debug::outdent();
-  Debug::log("finished performing append");
-  Debug::outdent();
-#endif /* NDEBUG */
+  LOG_TRACE("finished performing append");
 }
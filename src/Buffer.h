@@ -8,10 +8,15 @@
 #include <string>
 #include <fstream>
 #include <memory>
-#include <list>
+#include <vector>
 
 #include "Point.h"
-#include "Line.h"
+#include "Arena.h"
+#include "Background_save.h"
+#include "Journal.h"
+#include "Piece_table.h"
+#include "Regex.h"
+#include "Undo_history.h"
 
 class Window;
 
@@ -20,9 +25,8 @@ class Buffer {
   
   //TODO: decide how to implement set of Buffer-specific options.
   //  decided: use a lookup table.
-  //  See Line.h for ideas on how to use it.
   public:
-    using Line_list = std::list<Line>;
+    using size_type = Piece_table::size_type;
   
     // default constructor:
     // does not bind to a file.
@@ -32,142 +36,418 @@ class Buffer {
     // binds to the given file.
     explicit Buffer(const std::string &p);
 
+    // constructor:
+    // binds to the given file, whose contents have already been
+    // mapped or read.
+    Buffer(const std::string &p, File_map contents);
+
+    // lets a save in progress finish, then deletes the journal, if
+    // there is one: the editor is done with the file.
+    ~Buffer();
+
     // set of changes made by Buffer edit commands.
     struct Changeset;
 
-    // write the buffer to the file.
+    // one edit to the text: at offset, removed characters were
+    // replaced by inserted characters.
+    struct Delta {
+      size_type offset;
+      size_type removed;
+      size_type inserted;
+    };
+
+    // Deltas past the few a Changeset holds itself.
+    using Delta_list = std::vector<Delta, Arena_allocator<Delta>>;
+
+    // spare storage for Changesets with many Deltas.
+    class Delta_pool;
+
+    // write the buffer to the file, waiting until it is done.
     // true on success.
     bool write();
 
+    // start writing the buffer to the file in the background.
+    // edits can go on meanwhile; the text as it is now is written.
+    // false if a save is already running or there is no file.
+    bool start_save();
+
+    // how the save is going, for the status line.
+    // how it ended is reported once, as are the journal failing and
+    // the file being cut short on disk; empty if there is nothing to
+    // report.
+    std::string save_status();
+
+    // if a save is running.
+    bool is_saving() const;
+
+    // the text as it is now, for reading on any thread while editing
+    // goes on. must be let go of before the Buffer.
+    // costs O(log n) per edit made while it is held.
+    Piece_table::Snapshot snapshot() const;
+
     // set the path to which this buffer will write.
     void set_path(const std::string &p);
 
+    // the path to which this buffer will write.
+    const std::string &get_path() const;
+
+    // journal every edit from now on to a file beside the one being
+    // edited, so that a crash loses almost nothing. edits left in a
+    // journal by an editor that died are replayed first.
+    // returns the number of edits recovered.
+    size_type start_journal();
+
     // insert the given character before the cursor.
-    std::unique_ptr<Changeset> insert(const int &character);
+    Changeset insert(const int &character);
+
+    // insert count characters before the cursor, as one edit.
+    // the characters may include line breaks.
+    // the cursor ends up just after them.
+    Changeset insert(const char *chars, size_type count);
+
+    // add count characters at the very end, leaving the cursor where it
+    // is. for text the editor writes itself, e.g. results: it is not
+    // journaled, nor can it be undone.
+    Changeset append(const char *chars, size_type count);
+
+    // replace every one of matches, which are in order and do not
+    // overlap, by with, as one edit: a single step to undo.
+    // in with, \0 stands for the text matched, \n and \t for a line
+    // break and a tab, and \ before anything else for that character.
+    Changeset replace_all(const std::vector<Regex::Match> &matches,
+                          const std::string &with);
+
+    // undo the last group of edits, putting the cursor back where it
+    // was before them.
+    // takes time in proportion to the size of the edits, not the text.
+    Changeset do_undo();
+
+    // redo the last group of edits undone, leaving the cursor after
+    // them.
+    Changeset do_redo();
+
+    // keep about bytes of undo history.
+    void set_undo_budget(std::size_t bytes);
 
     // place cursor at beginning of line above.
     // stops at first line.
+    // a line nearby never waits for the line index; one far above is
+    // found through it, in O(log n) in the size of the file.
     // makes no changes to file text
-    std::unique_ptr<Changeset> do_up(const int &num_lines = 1);
+    Changeset do_up(const int &num_lines = 1);
 
     // place cursor at beginning of line below.
     // stops at last line.
+    // a line nearby never waits for the line index; one far below is
+    // found through it, in O(log n) in the size of the file.
     // makes no changes to file text
-    std::unique_ptr<Changeset> do_down(const int &num_lines = 1);
+    Changeset do_down(const int &num_lines = 1);
 
     // move the cursor left, possibly wrapping to previous line.
     // Stops at first position of first line.
+    // crosses whole lines at a time.
     // makes no changes to file text
-    std::unique_ptr<Changeset> do_left(const int &num_moves = 1);
+    Changeset do_left(const int &num_moves = 1);
 
     // move the cursor right, possibly wrapping to next line.
     // Stops after last position of last line.
+    // crosses whole lines at a time.
     // makes no changes to file text
-    std::unique_ptr<Changeset> do_right(const int &num_moves = 1);
+    Changeset do_right(const int &num_moves = 1);
 
     // perform necessary actions to handle pressing of BACKSPACE.
-    std::unique_ptr<Changeset> do_backspace(const int &num_presses = 1);
+    Changeset do_backspace(const int &num_presses = 1);
 
     // perform necessary actions to handle pressing of DELETE.
-    std::unique_ptr<Changeset> do_delete(const int &num_presses = 1);
+    Changeset do_delete(const int &num_presses = 1);
 
     // perform necessary actions to handle pressing of ENTER.
     // insert a line break before character under cursor.
-    std::unique_ptr<Changeset> do_enter(const int &num_presses = 1);
+    Changeset do_enter(const int &num_presses = 1);
+
+    // place cursor at beginning of the given line (from 0).
+    // stops at first and last lines.
+    // makes no changes to file text
+    Changeset do_goto_line(const int &line_num);
+
+    // place cursor on the character at the given position in the file.
+    // stops after last position of last line.
+    // near the cursor, never waits for the line index.
+    // makes no changes to file text
+    Changeset do_goto_offset(const size_type &offset);
+
+    // show num_lines lines, starting with the current one.
+    // only those lines are read from the file.
+    // makes no changes to file text
+    Changeset do_redraw(const int &num_lines);
 
     // perform necessary actions to handle pressing of HOME.
     // place cursor on first character of line.
     // makes no changes to file text
-    std::unique_ptr<Changeset> do_home();
+    Changeset do_home();
     
     // perform necessary actions to handle pressing of END.
     // place cursor after last character of line.
     // makes no changes to file text
-    std::unique_ptr<Changeset> do_end();
+    Changeset do_end();
+
+    // append the text of the line starting at pos to out.
+    // only count characters from column first on are copied.
+    // returns the position of the start of the next line,
+    // or npos if this is the last one.
+    size_type copy_line(size_type pos, std::string &out,
+                        size_type first = 0,
+                        size_type count = Piece_table::npos) const;
+
+    // position of the first character of the given line (from 0).
+    // lines near the cursor are found by searching outward from it,
+    // others through the line index.
+    // end of the text if there is no such line.
+    size_type line_offset(int line_num) const;
+
+    // what this Buffer's memory arena holds.
+    const Arena::Stats &memory() const;
 
   private:
+    // Changeset for a command that started with the cursor at orig,
+    // redrawing lines [top, bottom], the first of which starts at topln.
+    Changeset changeset(Point orig, size_type topln, int top, int bottom);
+
+    // Changeset for undoing or redoing: fills the Deltas from the
+    // changes history makes to the text, and redraws from the first.
+    Changeset replay_history(bool redo);
+
+    // insert count characters before pos, recording the edit as kind.
+    void insert_text(size_type pos, const char *chars, size_type count,
+                     Undo_history::Kind kind);
+
+    // once the save has finished, note how it went and let the journal
+    // forget the edits that are in the file now.
+    // returns if the save worked.
+    bool finish_save();
+
+    // apply an edit recovered from the journal.
+    // returns false if it does not fit the text.
+    bool replay_edit(size_type offset, size_type removed,
+                     const char *chars, size_type count);
+
+    // erase count characters at pos, recording the edit as kind.
+    void erase_text(size_type pos, size_type count, Undo_history::Kind kind);
+
+    // position of first character on the line containing pos.
+    size_type line_start(size_type pos) const;
+
+    // position AFTER last character on the line containing pos.
+    size_type line_end(size_type pos) const;
+
     // position of first character on current line.
-    Line::iterator local_first_char();
+    size_type local_first_char() const;
 
     // position AFTER last character on current line.
-    Line::iterator local_end_char();
+    size_type local_end_char() const;
 
     // position of first character on first line.
-    Line::iterator very_first_char();
+    size_type very_first_char() const;
 
     // position AFTER last character on last line.
-    Line::iterator very_end_char();
+    size_type very_end_char() const;
+
+    // memory for the text's tree and added text, and for Changesets.
+    // freed all at once with the Buffer.
+    // declared first so that it outlives everything allocated from it.
+    Arena arena;
 
     // current state of this Buffer's representation of its file.
-    Line_list lines;
+    Piece_table text;
 
-    // current line being edited.
-    Line_list::iterator line;
+    // edits that can be undone and redone.
+    Undo_history history;
 
-    // cursor position on current line.
-    Line::iterator cursor;
+    // cursor position in the text.
+    size_type cursor;
     Point cursor_pos;
 
     // file being edited.
     std::string path;
+
+    // storage lent to this Buffer's Changesets.
+    std::unique_ptr<Delta_pool> pool;
+
+    // where edits are recorded until the file is written, if anywhere,
+    // and if it failing has been reported.
+    std::unique_ptr<Journal> journal;
+    bool journal_failure_shown;
+
+    // if the file changing on disk under the text has been reported.
+    bool change_on_disk_shown;
+
+    // save running in the background, if any, the journal's mark when
+    // it started, and how the last one ended.
+    // declared after the text, whose snapshot it writes.
+    std::unique_ptr<Background_save> saving;
+    unsigned long long save_mark;
+    std::string save_message;
+
+    // how far line_offset will search from the cursor before using
+    // the line index instead.
+    static const int nearby_lines = 1024;
 };
 
+// lists of Deltas, kept for reuse once a Changeset is done with them.
+// lists and their storage come from the Buffer's arena.
+class Buffer::Delta_pool {
+  public:
+    // constructor:
+    // allocates from the given arena.
+    explicit Delta_pool(Arena &arena_);
+
+    // an empty list, reusing old storage if there is any.
+    Delta_list *take();
+
+    // return a list to the pool.
+    void give(Delta_list *deltas);
+
+    ~Delta_pool();
+
+  private:
+    Arena &arena;
+    std::vector<Delta_list *> spare;
+};
+
+// returned by value from every Buffer command.
+// the first few Deltas are stored inline; only commands making many
+// separate edits borrow more room from the Buffer's Delta_pool.
 struct Buffer::Changeset {
   // constructor:
-  // takes topmost line that was changed,
-  // number of lines that were changed, and
-  // starting and final positions of the cursor.
-  Changeset(Line_list::iterator topln,
-      Line_list::difference_type lines_edited,
+  // takes the pool to borrow from (may be null),
+  // starting and final positions of the cursor, and
+  // the range of lines to redraw and where the first one starts.
+  Changeset(Delta_pool *pool_,
       Point orig,
-      Point final);
+      Point final,
+      int top,
+      int bottom,
+      size_type topln);
 
-  // changed lines.
-  std::list<std::string> changed;
+  Changeset(Changeset &&other);
+  Changeset &operator=(Changeset &&other);
+  ~Changeset();
+
+  Changeset(const Changeset &) = delete;
+  Changeset &operator=(const Changeset &) = delete;
 
   // starting and final positions of the cursor.
   Point cursor_orig;
   Point cursor_final;
 
-  // top and bottom line numbers
+  // top and bottom line numbers of the lines to redraw.
+  // no lines if bottom_line < top_line.
   int top_line;
   int bottom_line;
 
+  // position of the first character of top_line.
+  size_type top_offset;
+
+  // lines below bottom_line moved too, so redraw everything below.
+  bool redraw_below;
+
+  // record an edit, merging it into the last one if they touch.
+  void add_delta(const Delta &delta);
+
+  // number of Deltas recorded.
+  size_type num_deltas() const;
+
+  // Delta number i, in the order they were made.
+  const Delta &delta(size_type i) const;
+
   // append another Changeset to this one, so that this one includes
   // information from both. Other's cursor must start where this one's ends.
-// invalidates the other Changeset.
+  // invalidates the other Changeset.
   void append(Changeset &other);
+
+  private:
+    // hand borrowed storage back to the pool.
+    void release();
+
+    static const size_type inline_deltas = 2;
+
+    Delta local[inline_deltas];
+    size_type num_local;
+
+    // borrowed from pool once local is full.
+    Delta_list *overflow;
+    Delta_pool *pool;
 };
 
-// position of first character on first line.
-inline Line::iterator Buffer::very_first_char()
+// inline function definitions
+
+// the path to which this buffer will write.
+inline const std::string &Buffer::get_path() const
 {
-  return begin(*begin(lines));
+  return path;
 }
 
-// inline function definitions
+// what this Buffer's memory arena holds.
+inline const Arena::Stats &Buffer::memory() const
+{
+  return arena.stats();
+}
 
-// position AFTER last character on last line.
-inline Line::iterator Buffer::very_end_char()
+// if a save is running.
+inline bool Buffer::is_saving() const
+{
+  return saving && !saving->done();
+}
+
+// position of first character on the line containing pos.
+inline Buffer::size_type Buffer::line_start(size_type pos) const
 {
-  // last line iterator
-  auto last_line = begin(lines) == end(lines) ?
-                   end(lines) :
-                   --end(lines);
-  // after very last character
-  return end(*last_line);
+  // npos + 1 wraps to the very first character.
+  return text.rfind_newline(pos) + 1;
+}
+
+// position AFTER last character on the line containing pos.
+inline Buffer::size_type Buffer::line_end(size_type pos) const
+{
+  return text.find_newline(pos);
 }
 
 // position of first character on current line.
-inline Line::iterator Buffer::local_first_char()
+// cursor_pos.x is always the distance from it, so there is no need to
+// search for it.
+inline Buffer::size_type Buffer::local_first_char() const
 {
-  return begin(*line);
+  return cursor - cursor_pos.x;
 }
 
 // position AFTER last character on current line.
-inline Line::iterator Buffer::local_end_char()
+inline Buffer::size_type Buffer::local_end_char() const
+{
+  return line_end(cursor);
+}
+
+// position of first character on first line.
+inline Buffer::size_type Buffer::very_first_char() const
+{
+  return 0;
+}
+
+// position AFTER last character on last line.
+inline Buffer::size_type Buffer::very_end_char() const
+{
+  return text.size();
+}
+
+// number of Deltas recorded.
+inline Buffer::size_type Buffer::Changeset::num_deltas() const
+{
+  return num_local + (overflow ? overflow->size() : 0);
+}
+
+// Delta number i, in the order they were made.
+inline const Buffer::Delta &Buffer::Changeset::delta(size_type i) const
 {
-  return end(*line);
+  return i < num_local ? local[i] : (*overflow)[i - num_local];
 }
 
 #endif /* BUFFER_H */
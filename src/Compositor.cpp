@@ -0,0 +1,197 @@
+// Compositor.cpp
+//
+// Lays out the windows on the terminal.
+
+#include <algorithm>
+#include <string>
+
+#include "Compositor.h"
+#include "Window.h"
+
+// constructor:
+// dividers are drawn by backend_, or by renderer_ if there is one.
+Compositor::Compositor(Backend *backend_, Renderer *renderer_) :
+  backend(backend_), renderer(renderer_)
+{
+  // empty
+}
+
+// have window take up the whole terminal, the only one there is.
+void Compositor::start(Window *window)
+{
+  whole.reset(new Part());
+  whole->window = window;
+  whole->parent = nullptr;
+  whole->top = window->screen.top();
+  whole->left = window->screen.left();
+  whole->rows = window->screen.height();
+  whole->cols = window->screen.width();
+}
+
+// split the part of the terminal window takes in two: window keeps the
+// top or left half, and added takes the other.
+// returns false, doing nothing, if there is no room: each half needs a
+// row or column, and so does the divider.
+// nothing moves until the next layout.
+bool Compositor::split(Window *window, Window *added, Split how)
+{
+  Part *part = find(whole.get(), window);
+  if (part == nullptr ||
+      (how == Split::stacked ? part->rows : part->cols) < 3) {
+    return false;
+  }
+  // each half takes the whole part until the next layout.
+  for (auto half : { &part->first, &part->second }) {
+    half->reset(new Part());
+    (*half)->parent = part;
+    (*half)->top = part->top;
+    (*half)->left = part->left;
+    (*half)->rows = part->rows;
+    (*half)->cols = part->cols;
+  }
+  part->first->window = window;
+  part->second->window = added;
+  part->window = nullptr;
+  part->how = how;
+  part->divider.reset(new Screen(backend, renderer, 0, 0, 1, 1));
+  return true;
+}
+
+// take window out; the window or windows it was split from take up its
+// part too. the last window cannot be taken out.
+// nothing moves until the next layout.
+void Compositor::remove(Window *window)
+{
+  Part *part = find(whole.get(), window);
+  if (part == nullptr || part->parent == nullptr) {
+    return;
+  }
+  Part *parent = part->parent;
+  std::unique_ptr<Part> other = std::move(
+      parent->first.get() == part ? parent->second : parent->first);
+  // the parent becomes the other half; the part taken out goes with
+  // whichever half it was.
+  parent->window = other->window;
+  parent->how = other->how;
+  parent->divider = std::move(other->divider);
+  parent->first = std::move(other->first);
+  parent->second = std::move(other->second);
+  for (auto half : { parent->first.get(), parent->second.get() }) {
+    if (half != nullptr) {
+      half->parent = parent;
+    }
+  }
+}
+
+// fit every window and divider into a terminal rows by cols, and draw
+// the dividers.
+void Compositor::layout(int rows, int cols)
+{
+  if (whole) {
+    place(whole.get(), 0, 0, rows, cols);
+  }
+}
+
+// the window after window, left to right and top to bottom, or the
+// first after the last.
+Window *Compositor::next(Window *window) const
+{
+  std::vector<Window *> windows;
+  windows_in(whole.get(), windows);
+  auto found = std::find(windows.begin(), windows.end(), window);
+  if (found == windows.end() || ++found == windows.end()) {
+    return windows.empty() ? nullptr : windows.front();
+  }
+  return *found;
+}
+
+// draw every window but except again in full.
+void Compositor::redraw(Window *except)
+{
+  std::vector<Window *> windows;
+  windows_in(whole.get(), windows);
+  for (Window *window : windows) {
+    if (window != except) {
+      window->refresh();
+    }
+  }
+}
+
+// show change, made to the Buffer with ID buff_id, in every window
+// showing it but from, which made it.
+void Compositor::show_change(int buff_id, const Buffer::Changeset &change,
+                             Window *from)
+{
+  std::vector<Window *> windows;
+  windows_in(whole.get(), windows);
+  for (Window *window : windows) {
+    if (window != from && window->buffer_id == buff_id) {
+      window->mirror(change);
+    }
+  }
+}
+
+// the part window takes up, or null.
+Compositor::Part *Compositor::find(Part *part, Window *window) const
+{
+  if (part == nullptr) {
+    return nullptr;
+  }
+  if (part->window != nullptr) {
+    return part->window == window ? part : nullptr;
+  }
+  Part *found = find(part->first.get(), window);
+  return found != nullptr ? found : find(part->second.get(), window);
+}
+
+// every window in part, left to right and top to bottom.
+void Compositor::windows_in(const Part *part,
+                            std::vector<Window *> &out) const
+{
+  if (part == nullptr) {
+    return;
+  }
+  if (part->window != nullptr) {
+    out.push_back(part->window);
+    return;
+  }
+  windows_in(part->first.get(), out);
+  windows_in(part->second.get(), out);
+}
+
+// fit part, and whatever it is split into, into the given place.
+// the first half gets the odd row or column out; no window gets less
+// than one, even on a terminal too small for them all.
+void Compositor::place(Part *part, int top, int left, int rows, int cols)
+{
+  part->top = top;
+  part->left = left;
+  part->rows = rows;
+  part->cols = cols;
+  if (part->window != nullptr) {
+    part->window->place(top, left, rows, cols);
+    return;
+  }
+  Screen &divider = *part->divider;
+  if (part->how == Split::stacked) {
+    int first_rows = std::max((rows - 1) / 2, 1);
+    place(part->first.get(), top, left, first_rows, cols);
+    place(part->second.get(), top + first_rows + 1, left,
+          std::max(rows - first_rows - 1, 1), cols);
+    // a highlighted row.
+    divider.place(top + first_rows, left, 1, cols);
+    divider.clear_line(0);
+    divider.highlight(0, 0, cols);
+  } else {
+    int first_cols = std::max((cols - 1) / 2, 1);
+    place(part->first.get(), top, left, rows, first_cols);
+    place(part->second.get(), top, left + first_cols + 1, rows,
+          std::max(cols - first_cols - 1, 1));
+    // a column of bars.
+    divider.place(top, left + first_cols, rows, 1);
+    for (int y = 0; y < rows; ++y) {
+      divider.put_line(y, "|", 1);
+    }
+  }
+  divider.flush();
+}
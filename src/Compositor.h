@@ -0,0 +1,98 @@
+#ifndef COMPOSITOR_H
+#define COMPOSITOR_H
+
+// Compositor.h
+//
+// Lays out the windows on the terminal. The terminal is split in two,
+// one part above the other or side by side with a divider between
+// them, and each part may be split again; every part not split is a
+// window.
+// It also shows a change made to a Buffer in one window in every other
+// window showing that Buffer, drawing only the lines in each one's view
+// that the change touched. Windows showing other Buffers are left alone.
+
+#include <memory>
+#include <vector>
+
+#include "Buffer.h"
+#include "Screen.h"
+
+class Backend;
+class Renderer;
+class Window;
+
+class Compositor {
+  public:
+    // how a window is split in two.
+    enum class Split { stacked, beside };
+
+    // constructor:
+    // dividers are drawn by backend_, or by renderer_ if there is one.
+    Compositor(Backend *backend_, Renderer *renderer_);
+
+    // have window take up the whole terminal, the only one there is.
+    void start(Window *window);
+
+    // split the part of the terminal window takes in two: window keeps
+    // the top or left half, and added takes the other.
+    // returns false, doing nothing, if there is no room.
+    // nothing moves until the next layout.
+    bool split(Window *window, Window *added, Split how);
+
+    // take window out; the window or windows it was split from take up
+    // its part too. the last window cannot be taken out.
+    // nothing moves until the next layout.
+    void remove(Window *window);
+
+    // fit every window and divider into a terminal rows by cols, and
+    // draw the dividers.
+    void layout(int rows, int cols);
+
+    // the window after window, left to right and top to bottom, or the
+    // first after the last.
+    Window *next(Window *window) const;
+
+    // draw every window but except again in full.
+    void redraw(Window *except);
+
+    // show change, made to the Buffer with ID buff_id, in every window
+    // showing it but from, which made it.
+    void show_change(int buff_id, const Buffer::Changeset &change,
+                     Window *from);
+
+  private:
+    // a part of the terminal: a window, or split in two.
+    struct Part {
+      // null if split.
+      Window *window;
+
+      Split how;
+      std::unique_ptr<Part> first;
+      std::unique_ptr<Part> second;
+      std::unique_ptr<Screen> divider;
+
+      // null for the whole terminal.
+      Part *parent;
+
+      // where the part is on the terminal, as of the last layout.
+      int top;
+      int left;
+      int rows;
+      int cols;
+    };
+
+    // the part window takes up, or null.
+    Part *find(Part *part, Window *window) const;
+
+    // every window in part, left to right and top to bottom.
+    void windows_in(const Part *part, std::vector<Window *> &out) const;
+
+    // fit part, and whatever it is split into, into the given place.
+    void place(Part *part, int top, int left, int rows, int cols);
+
+    Backend *backend;
+    Renderer *renderer;
+    std::unique_ptr<Part> whole;
+};
+
+#endif /* COMPOSITOR_H */
@@ -1,7 +0,0 @@
-// Debug.h
-//
-// Contains debugging tools
-
-#include "Debug.h"
-
-int Debug::indent_level = 0;
@@ -0,0 +1,268 @@
+// Event_loop.cpp
+//
+// Waits on everything the editor reacts to at once: keys from the
+// terminal, the terminal being resized, timers, and wakeups from other
+// threads.
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <ncurses.h>
+
+#include "Event_loop.h"
+#include "Log.h"
+
+const int Event_loop::default_escape_delay;
+int Event_loop::resize_fd = -1;
+
+namespace {
+
+// what next_key gives once the terminal has gone: the key that stops
+// editing.
+const int escape = 27;
+
+// what a resize and a wakeup put in the wake pipe.
+const char resize_byte = 'r';
+const char wake_byte = 'w';
+
+// how SIGWINCH was handled before the loop took it over.
+struct sigaction old_resize;
+
+// milliseconds from then until now.
+int since(Event_loop::Clock::time_point then, Event_loop::Clock::time_point now)
+{
+  return static_cast<int>(std::chrono::duration_cast<
+      std::chrono::milliseconds>(now - then).count());
+}
+
+// the shorter of two waits in milliseconds, where negative is for ever.
+int sooner(int a, int b)
+{
+  if (a < 0) {
+    return b;
+  }
+  if (b < 0) {
+    return a;
+  }
+  return std::min(a, b);
+}
+
+}
+
+// constructor:
+// reads keys from the terminal at input_fd_, and takes over SIGWINCH.
+// the terminal must have been set up, by a Backend.
+// the escape delay is ESCDELAY from the environment, if it is set, as
+// it is for ncurses.
+Event_loop::Event_loop(int input_fd_ /* = 0 */) :
+  input_fd(input_fd_), wake_pending(false),
+  escape_delay(default_escape_delay), last_input(Clock::now()),
+  resized(false), new_rows(0), new_cols(0), hung_up(false)
+{
+  if (pipe(wake_pipe) != 0) {
+    LOG_ERROR("event loop: cannot make the wake pipe");
+    wake_pipe[0] = wake_pipe[1] = -1;
+  } else {
+    for (int fd : wake_pipe) {
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+      fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+  }
+  const char *delay = std::getenv("ESCDELAY");
+  if (delay != nullptr && *delay != '\0') {
+    set_escape_delay(std::atoi(delay));
+  }
+  resize_fd = wake_pipe[1];
+  struct sigaction action;
+  action.sa_handler = on_resize;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_RESTART;
+  sigaction(SIGWINCH, &action, &old_resize);
+}
+
+// gives SIGWINCH back.
+Event_loop::~Event_loop()
+{
+  sigaction(SIGWINCH, &old_resize, nullptr);
+  resize_fd = -1;
+  for (int fd : wake_pipe) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+}
+
+// wait up to timeout milliseconds, or for ever if it is negative, for
+// the next key.
+// timers due run meanwhile. returns ERR once the time is up, or as soon
+// as a timer has run, the loop has been woken, or the terminal has been
+// resized, so that the caller can show what has changed.
+// returns ESC for ever once the terminal has gone.
+// the terminal is always polled at least once, so a timeout of 0 takes
+// keys that have already arrived.
+int Event_loop::next_key(int timeout)
+{
+  auto start = Clock::now();
+  bool polled = false;
+  for (;;) {
+    if (!pushed.empty()) {
+      int key = pushed.front();
+      pushed.pop_front();
+      return key;
+    }
+    int key = keys.next();
+    if (key != ERR) {
+      return key;
+    }
+    if (hung_up) {
+      return escape;
+    }
+
+    auto now = Clock::now();
+    if (timers.advance(now) > 0) {
+      return ERR;
+    }
+    int wait = timeout < 0 ? -1 : std::max(timeout - since(start, now), 0);
+    // a lone ESC, or the start of a sequence, that nothing has followed.
+    if (keys.pending()) {
+      int quiet = since(last_input, now);
+      if (quiet >= escape_delay) {
+        return keys.next(true);
+      }
+      wait = sooner(wait, escape_delay - quiet);
+    }
+    if (polled && wait == 0) {
+      return ERR;
+    }
+    wait = sooner(wait, timers.next_due(now));
+
+    pollfd fds[2] = {
+      { input_fd, POLLIN, 0 },
+      { wake_pipe[0], POLLIN, 0 },
+    };
+    int ready = poll(fds, 2, wait);
+    polled = true;
+    if (ready <= 0) {
+      continue;
+    }
+    if (fds[0].revents != 0) {
+      read_input();
+    }
+    if (fds[1].revents != 0) {
+      read_wakes();
+      // keys that came in with the wakeup are taken next time.
+      return ERR;
+    }
+  }
+}
+
+// have next_key return key before anything else.
+void Event_loop::unget_key(int key)
+{
+  pushed.push_front(key);
+}
+
+// if the terminal has been resized since the last call, and if so its
+// new size.
+bool Event_loop::take_resize(int &rows, int &cols)
+{
+  if (!resized) {
+    return false;
+  }
+  resized = false;
+  rows = new_rows;
+  cols = new_cols;
+  return true;
+}
+
+// run callback once, ms milliseconds from now, from next_key.
+// returns an ID to cancel it by.
+int Event_loop::add_timer(int ms, Callback callback)
+{
+  return timers.add(ms, std::move(callback));
+}
+
+// stop a timer from running.
+// returns false if it has run or been cancelled already.
+bool Event_loop::cancel_timer(int id)
+{
+  return timers.cancel(id);
+}
+
+// make next_key return. may be called from any thread; wakeups coming
+// in while one is waiting to be seen count as one.
+void Event_loop::wake()
+{
+  if (!wake_pending.exchange(true)) {
+    ssize_t written = write(wake_pipe[1], &wake_byte, 1);
+    (void) written;
+  }
+}
+
+// milliseconds to wait for the rest of an escape sequence before taking
+// ESC as a key by itself.
+void Event_loop::set_escape_delay(int ms)
+{
+  escape_delay = std::max(ms, 0);
+}
+
+// read what the terminal has sent, if anything.
+// the terminal has gone if it says there is nothing more to read.
+void Event_loop::read_input()
+{
+  char bytes[4096];
+  ssize_t count = read(input_fd, bytes, sizeof(bytes));
+  if (count > 0) {
+    keys.feed(bytes, count);
+    last_input = Clock::now();
+  } else if (count == 0 || (errno != EAGAIN && errno != EINTR)) {
+    LOG_INFO("event loop: the terminal has gone");
+    hung_up = true;
+  }
+}
+
+// empty the wake pipe, noting resizes.
+// wakeups from now on need a new byte in the pipe.
+void Event_loop::read_wakes()
+{
+  wake_pending.store(false);
+  char bytes[64];
+  ssize_t count;
+  while ((count = read(wake_pipe[0], bytes, sizeof(bytes))) > 0) {
+    if (std::find(bytes, bytes + count, resize_byte) != bytes + count) {
+      resize_terminal();
+    }
+  }
+}
+
+// note the terminal's new size.
+// the Backend is left alone: whatever draws on the terminal tells it.
+void Event_loop::resize_terminal()
+{
+  winsize size;
+  if (ioctl(input_fd, TIOCGWINSZ, &size) == 0 &&
+      size.ws_row > 0 && size.ws_col > 0) {
+    resized = true;
+    new_rows = size.ws_row;
+    new_cols = size.ws_col;
+  }
+}
+
+// tells the loop that the terminal was resized.
+// only writes to the pipe, as a signal handler may.
+void Event_loop::on_resize(int)
+{
+  int saved = errno;
+  if (resize_fd >= 0) {
+    ssize_t written = write(resize_fd, &resize_byte, 1);
+    (void) written;
+  }
+  errno = saved;
+}
@@ -0,0 +1,115 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+// Event_loop.h
+//
+// Waits on everything the editor reacts to at once: keys from the
+// terminal, the terminal being resized, timers, and wakeups from other
+// threads, with a single poll(2).
+// Keys are read from the terminal directly and parsed by a Key_parser,
+// so ESC counts as soon as what follows it shows it is not the start of
+// a sequence, or after a short delay if nothing follows, rather than
+// ncurses' escape delay. A resize and a wakeup each come in on a pipe
+// the loop polls, written to by the signal handler and by the thread
+// waking it.
+// Only one Event_loop at a time gets resizes.
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+
+#include "Key_parser.h"
+#include "Timer_wheel.h"
+
+class Event_loop {
+  public:
+    using Clock = Timer_wheel::Clock;
+    using Callback = Timer_wheel::Callback;
+
+    // constructor:
+    // reads keys from the terminal at input_fd_, and takes over
+    // SIGWINCH. the terminal must have been set up, by a Backend.
+    // the escape delay is ESCDELAY from the environment, if it is set,
+    // as it is for ncurses.
+    explicit Event_loop(int input_fd_ = 0);
+
+    // gives SIGWINCH back.
+    ~Event_loop();
+
+    Event_loop(const Event_loop &) = delete;
+    Event_loop &operator=(const Event_loop &) = delete;
+
+    // wait up to timeout milliseconds, or for ever if it is negative,
+    // for the next key.
+    // timers due run meanwhile. returns ERR once the time is up, or
+    // as soon as a timer has run, the loop has been woken, or the
+    // terminal has been resized, so that the caller can show what has
+    // changed.
+    // returns ESC for ever once the terminal has gone.
+    int next_key(int timeout);
+
+    // have next_key return key before anything else.
+    void unget_key(int key);
+
+    // if the terminal has been resized since the last call, and if so
+    // its new size.
+    bool take_resize(int &rows, int &cols);
+
+    // run callback once, ms milliseconds from now, from next_key.
+    // returns an ID to cancel it by.
+    int add_timer(int ms, Callback callback);
+
+    // stop a timer from running.
+    // returns false if it has run or been cancelled already.
+    bool cancel_timer(int id);
+
+    // make next_key return. may be called from any thread; wakeups
+    // coming in while one is waiting to be seen count as one.
+    void wake();
+
+    // milliseconds to wait for the rest of an escape sequence before
+    // taking ESC as a key by itself.
+    void set_escape_delay(int ms);
+
+    static const int default_escape_delay = 25;
+
+  private:
+    // read what the terminal has sent, if anything.
+    void read_input();
+
+    // empty the wake pipe, noting resizes.
+    void read_wakes();
+
+    // note the terminal's new size.
+    void resize_terminal();
+
+    // tells the loop that the terminal was resized.
+    static void on_resize(int);
+
+    int input_fd;
+
+    // read and write ends of the pipe wakeups and resizes come in on.
+    int wake_pipe[2];
+
+    // write end of the wake pipe of the loop that gets resizes.
+    static int resize_fd;
+
+    // a wakeup is in the pipe and not yet seen.
+    std::atomic<bool> wake_pending;
+
+    Key_parser keys;
+    std::deque<int> pushed;
+    int escape_delay;
+
+    // when the last bytes came from the terminal.
+    Clock::time_point last_input;
+
+    Timer_wheel timers;
+
+    bool resized;
+    int new_rows;
+    int new_cols;
+    bool hung_up;
+};
+
+#endif /* EVENT_LOOP_H */
@@ -0,0 +1,212 @@
+// File_map.cpp
+//
+// Read-only view of a file's contents.
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "File_map.h"
+
+namespace {
+
+// a mapped file that a bus error may be coming from.
+// free while start is null.
+struct Guard {
+  std::atomic<bool> taken;
+  std::atomic<const char *> start;
+  std::atomic<std::size_t> length;
+  std::atomic<bool> changed;
+};
+
+// most mappings guarded at once; past that, files are copied instead.
+const int max_guarded = 1024;
+Guard guards[max_guarded];
+
+std::size_t page_size;
+
+// how SIGBUS was handled before the guard took it over.
+struct sigaction old_bus_error;
+
+// a bus error reading a mapped file means it has been cut short: put
+// a page of zeros where the missing one was and carry on. any other
+// bus error is handled as it was before, when the read is tried again.
+void on_bus_error(int, siginfo_t *info, void *)
+{
+  auto address = static_cast<const char *>(info->si_addr);
+  for (auto &guard : guards) {
+    const char *start = guard.start.load();
+    if (start == nullptr || address < start ||
+        address >= start + guard.length.load()) {
+      continue;
+    }
+    auto page = reinterpret_cast<std::uintptr_t>(address) & ~(page_size - 1);
+    void *p = mmap(reinterpret_cast<void *>(page), page_size, PROT_READ,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    if (p != MAP_FAILED) {
+      guard.changed.store(true);
+      return;
+    }
+    break;
+  }
+  sigaction(SIGBUS, &old_bus_error, nullptr);
+}
+
+// take over SIGBUS, the first time a file is mapped.
+bool install_guard()
+{
+  page_size = sysconf(_SC_PAGESIZE);
+  struct sigaction action;
+  action.sa_sigaction = on_bus_error;
+  sigemptyset(&action.sa_mask);
+  action.sa_flags = SA_SIGINFO | SA_RESTART;
+  return sigaction(SIGBUS, &action, &old_bus_error) == 0;
+}
+
+// guard length characters mapped at start.
+// returns which guard it is, or -1 if they are all taken.
+int add_guard(const char *start, std::size_t length)
+{
+  static bool installed = install_guard();
+  if (!installed) {
+    return -1;
+  }
+  for (int i = 0; i < max_guarded; ++i) {
+    bool taken = false;
+    if (guards[i].taken.compare_exchange_strong(taken, true)) {
+      guards[i].length.store(length);
+      guards[i].changed.store(false);
+      guards[i].start.store(start);
+      return i;
+    }
+  }
+  return -1;
+}
+
+// stop guarding a mapping, before it is unmapped.
+void remove_guard(int i)
+{
+  guards[i].start.store(nullptr);
+  guards[i].taken.store(false);
+}
+
+}
+
+// default constructor:
+// empty view, not bound to a file.
+File_map::File_map() :
+  start(nullptr), length(0), is_mapped(false), guard(-1)
+{
+  // empty
+}
+
+// constructor:
+// maps the given file.
+// empty if the file does not exist or cannot be read.
+File_map::File_map(const std::string &path) : File_map()
+{
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  struct stat info;
+  if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode)) {
+    if (info.st_size > 0) {
+      // private mapping: the editor never writes through it.
+      // unguarded, it is copied instead.
+      void *p = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED) {
+        guard = add_guard(static_cast<const char *>(p), info.st_size);
+        if (guard >= 0) {
+          start = static_cast<const char *>(p);
+          length = info.st_size;
+          is_mapped = true;
+        } else {
+          munmap(p, info.st_size);
+        }
+      }
+    }
+    close(fd);
+    if (is_mapped || info.st_size == 0) {
+      return;
+    }
+  } else {
+    close(fd);
+  }
+
+  // not mappable: copy it instead.
+  std::ifstream in(path, std::ios::in | std::ios::binary);
+  std::stringstream contents;
+  contents << in.rdbuf();
+  fallback = contents.str();
+  start = fallback.data();
+  length = fallback.size();
+}
+
+File_map::~File_map()
+{
+  unmap();
+}
+
+File_map::File_map(File_map &&other) : File_map()
+{
+  *this = std::move(other);
+}
+
+File_map &File_map::operator=(File_map &&other)
+{
+  if (this != &other) {
+    unmap();
+    fallback = std::move(other.fallback);
+    is_mapped = other.is_mapped;
+    guard = other.guard;
+    length = other.length;
+    start = is_mapped ? other.start : fallback.data();
+    other.start = nullptr;
+    other.length = 0;
+    other.is_mapped = false;
+    other.guard = -1;
+  }
+  return *this;
+}
+
+// if the file was cut short on disk since it was mapped, and part
+// of it has read as zeros.
+bool File_map::changed() const
+{
+  return guard >= 0 && guards[guard].changed.load();
+}
+
+// start reading the first count characters in from disk, without
+// waiting for them, so that they are there when looked at.
+// copied contents are already in memory.
+void File_map::prefetch(size_type count) const
+{
+  if (is_mapped) {
+    madvise(const_cast<char *>(start), std::min(count, length),
+            MADV_WILLNEED);
+  }
+}
+
+// release the mapping, if any.
+void File_map::unmap()
+{
+  if (is_mapped) {
+    remove_guard(guard);
+    guard = -1;
+    munmap(const_cast<char *>(start), length);
+    is_mapped = false;
+  }
+  start = nullptr;
+  length = 0;
+}
@@ -0,0 +1,89 @@
+#ifndef FILE_MAP_H
+#define FILE_MAP_H
+
+// File_map.h
+//
+// Read-only view of a file's contents.
+// Regular files are memory-mapped, so pages are only read from disk
+// when something looks at them. Anything that cannot be mapped
+// (pipes, devices) is read into memory instead.
+// If a mapped file is cut short on disk while it is open, reading past
+// its new end would crash; instead the missing pages read as zeros and
+// the File_map notes that the file changed.
+
+#include <string>
+
+class File_map {
+  public:
+    using size_type = std::string::size_type;
+
+    // default constructor:
+    // empty view, not bound to a file.
+    File_map();
+
+    // constructor:
+    // maps the given file.
+    // empty if the file does not exist or cannot be read.
+    explicit File_map(const std::string &path);
+
+    ~File_map();
+
+    File_map(File_map &&other);
+    File_map &operator=(File_map &&other);
+
+    File_map(const File_map &) = delete;
+    File_map &operator=(const File_map &) = delete;
+
+    // first character of the file.
+    const char *data() const;
+
+    // number of characters in the file.
+    size_type size() const;
+
+    // if the contents are memory-mapped rather than copied.
+    bool mapped() const;
+
+    // if the file was cut short on disk since it was mapped, and part
+    // of it has read as zeros.
+    bool changed() const;
+
+    // start reading the first count characters in from disk, without
+    // waiting for them, so that they are there when looked at.
+    void prefetch(size_type count) const;
+
+  private:
+    // release the mapping, if any.
+    void unmap();
+
+    const char *start;
+    size_type length;
+    bool is_mapped;
+
+    // which guarded range the mapping is, or -1.
+    int guard;
+
+    // contents of a file that could not be mapped.
+    std::string fallback;
+};
+
+// inline function definitions
+
+// first character of the file.
+inline const char *File_map::data() const
+{
+  return start;
+}
+
+// number of characters in the file.
+inline File_map::size_type File_map::size() const
+{
+  return length;
+}
+
+// if the contents are memory-mapped rather than copied.
+inline bool File_map::mapped() const
+{
+  return is_mapped;
+}
+
+#endif /* FILE_MAP_H */
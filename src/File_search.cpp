@@ -0,0 +1,254 @@
+// File_search.cpp
+//
+// Finds a literal pattern in every file under a directory, in the
+// background.
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "File_search.h"
+#include "File_map.h"
+#include "Newline_scan.h"
+#include "Substring_search.h"
+#include "Thread_pool.h"
+#include "Log.h"
+
+const File_search::size_type File_search::max_shown;
+
+namespace {
+
+// how much of the start of a file is looked at to tell if it is binary.
+const File_search::size_type binary_check = 8192;
+
+// path of name in the directory at dir.
+std::string join(const std::string &dir, const char *name)
+{
+  if (dir == ".") {
+    return name;
+  }
+  if (!dir.empty() && dir.back() == '/') {
+    return dir + name;
+  }
+  return dir + '/' + name;
+}
+
+}
+
+// constructor:
+// starts looking for pattern_ in the files under root_, which may also
+// be a single file. hidden files and directories, symbolic links, and
+// files that look binary are skipped.
+// an empty pattern matches nothing.
+// found_, if given, is called from the searching threads whenever
+// results come in, and once the search is over.
+File_search::File_search(const std::string &root_,
+                         const std::string &pattern_,
+                         std::function<void()> found_ /* = nullptr */) :
+  pattern(pattern_), found(std::move(found_)), num_files(0), num_found(0),
+  cancelled(false), jobs(0), running(0),
+  max_running(std::max(Thread_pool::shared().size(), 2u) - 1)
+{
+  if (pattern.empty()) {
+    return;
+  }
+  struct stat info;
+  if (stat(root_.c_str(), &info) != 0) {
+    LOG_DEBUG("find in files: cannot look in {}", root_);
+    return;
+  }
+  auto root = root_;
+  if (S_ISDIR(info.st_mode)) {
+    submit([this, root] { walk(root); });
+  } else if (S_ISREG(info.st_mode)) {
+    submit([this, root] { scan(root); });
+  }
+}
+
+// stops the search, waiting for jobs running.
+// jobs not yet started are skipped.
+File_search::~File_search()
+{
+  cancelled.store(true, std::memory_order_relaxed);
+  std::unique_lock<std::mutex> guard(lock);
+  jobs -= waiting.size();
+  waiting.clear();
+  idle.wait(guard, [this] { return jobs == 0; });
+}
+
+// append the results found since the last call to out.
+// returns false once the search is over and every result taken.
+bool File_search::take(std::string &out)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  out += results;
+  results.clear();
+  return jobs > 0;
+}
+
+// if every file has been scanned.
+bool File_search::done() const
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return jobs == 0;
+}
+
+// read the directory at path, queueing jobs for what is in it.
+// the type readdir gives is trusted when there is one, so that most
+// entries need no stat of their own.
+void File_search::walk(const std::string &path)
+{
+  DIR *dir = opendir(path.c_str());
+  if (dir == nullptr) {
+    LOG_DEBUG("find in files: cannot read {}", path);
+    return;
+  }
+  while (dirent *entry = readdir(dir)) {
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+    auto child = join(path, entry->d_name);
+    auto type = entry->d_type;
+    if (type == DT_UNKNOWN) {
+      struct stat info;
+      if (lstat(child.c_str(), &info) != 0) {
+        continue;
+      }
+      type = S_ISDIR(info.st_mode) ? DT_DIR :
+             S_ISREG(info.st_mode) ? DT_REG : DT_UNKNOWN;
+    }
+    if (type == DT_DIR) {
+      submit([this, child] { walk(child); });
+    } else if (type == DT_REG) {
+      submit([this, child] { scan(child); });
+    }
+  }
+  closedir(dir);
+}
+
+// scan the file at path.
+// every matching line gives one result, however many matches are on it.
+void File_search::scan(const std::string &path)
+{
+  File_map file(path);
+  const char *text = file.data();
+  size_type length = file.size();
+  num_files.fetch_add(1, std::memory_order_relaxed);
+  if (length == 0 ||
+      std::memchr(text, '\0', std::min(length, binary_check)) != nullptr) {
+    return;
+  }
+
+  std::vector<size_type> starts;
+  substring_search::find_all(text, length, pattern.data(), pattern.size(),
+                             starts);
+
+  std::string out;
+  size_type line_num = 1;
+  size_type line_start = 0;
+  size_type num_lines = 0;
+  for (auto start : starts) {
+    if (start < line_start) {
+      // on the line already given.
+      continue;
+    }
+    // count the lines down to the match.
+    for (;;) {
+      auto newline = line_start + newline_scan::find_first(
+          text + line_start, start - line_start);
+      if (newline >= start) {
+        break;
+      }
+      ++line_num;
+      line_start = newline + 1;
+    }
+    auto line_length = newline_scan::find_first(text + line_start,
+                                                length - line_start);
+    out += path;
+    out += ':';
+    out += std::to_string(line_num);
+    out += ": ";
+    out.append(text + line_start, std::min(line_length, max_shown));
+    out += '\n';
+    ++num_lines;
+    ++line_num;
+    line_start += line_length + 1;
+  }
+  // a file cut short while it was read gives no results; they could
+  // be for text that is no longer there.
+  if (num_lines > 0 && !file.changed()) {
+    num_found.fetch_add(num_lines, std::memory_order_relaxed);
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      results += out;
+    }
+    if (found) {
+      found();
+    }
+  }
+}
+
+// queue a job, unless the search was stopped. it goes on the shared
+// Thread_pool if there is room, and waits its turn if not. the job
+// counts as running until it returns.
+void File_search::submit(std::function<void()> job)
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    ++jobs;
+    if (running >= max_running) {
+      waiting.push_back(std::move(job));
+      return;
+    }
+    ++running;
+  }
+  start(std::move(job));
+}
+
+// put a job on the shared Thread_pool.
+void File_search::start(std::function<void()> job)
+{
+  Thread_pool::shared().submit([this, job] {
+    if (!cancelled.load(std::memory_order_relaxed)) {
+      job();
+    }
+    finish_job();
+  });
+}
+
+// record that a job has finished, starting the next waiting. it goes at
+// the back of the Thread_pool's queue, behind whatever the editor has
+// put there meanwhile.
+// the last one says that the search is over.
+void File_search::finish_job()
+{
+  std::function<void()> next;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    --jobs;
+    if (cancelled.load(std::memory_order_relaxed)) {
+      jobs -= waiting.size();
+      waiting.clear();
+    }
+    if (!waiting.empty()) {
+      next = std::move(waiting.front());
+      waiting.pop_front();
+    } else {
+      --running;
+    }
+    if (jobs == 0) {
+      if (found) {
+        found();
+      }
+      idle.notify_all();
+    }
+  }
+  if (next) {
+    start(std::move(next));
+  }
+}
@@ -0,0 +1,111 @@
+#ifndef FILE_SEARCH_H
+#define FILE_SEARCH_H
+
+// File_search.h
+//
+// Finds a literal pattern in every file under a directory, without
+// opening them as Buffers, in the background.
+// Each directory and each file is a job on the shared Thread_pool:
+// reading a directory queues jobs for what is in it, so the tree is
+// walked and its files scanned in parallel. The jobs wait in a queue of
+// the search's own, and only so many are on the pool at once, one less
+// than it has workers: work for the editor, such as reading a file
+// opened from the results, never waits behind the rest of the tree. Files are memory-mapped
+// and scanned with substring_search, as a Search does.
+// Results come in as text, a line per matching line, "path:line: text",
+// and can be taken as they do.
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+
+class File_search {
+  public:
+    using size_type = std::string::size_type;
+
+    // constructor:
+    // starts looking for pattern_ in the files under root_, which may
+    // also be a single file. hidden files and directories, symbolic
+    // links, and files that look binary are skipped.
+    // an empty pattern matches nothing.
+    // found_, if given, is called from the searching threads whenever
+    // results come in, and once the search is over.
+    File_search(const std::string &root_, const std::string &pattern_,
+                std::function<void()> found_ = nullptr);
+
+    // stops the search, waiting for jobs running.
+    ~File_search();
+
+    File_search(const File_search &) = delete;
+    File_search &operator=(const File_search &) = delete;
+
+    // append the results found since the last call to out.
+    // returns false once the search is over and every result taken.
+    bool take(std::string &out);
+
+    // if every file has been scanned.
+    bool done() const;
+
+    // numbers of files scanned and of lines found so far.
+    size_type files() const;
+    size_type count() const;
+
+    // most characters of a matching line put in its result.
+    static const size_type max_shown = 200;
+
+  private:
+    // read the directory at path, queueing jobs for what is in it.
+    void walk(const std::string &path);
+
+    // scan the file at path.
+    void scan(const std::string &path);
+
+    // queue a job, unless the search was stopped.
+    void submit(std::function<void()> job);
+
+    // put a job on the shared Thread_pool.
+    void start(std::function<void()> job);
+
+    // record that a job has finished, starting the next waiting.
+    void finish_job();
+
+    std::string pattern;
+    std::function<void()> found;
+
+    std::atomic<size_type> num_files;
+    std::atomic<size_type> num_found;
+
+    // set by the destructor to skip jobs not yet started.
+    std::atomic<bool> cancelled;
+
+    // results not yet taken, jobs queued or running, jobs on the
+    // Thread_pool, and jobs waiting to go on it, guarded by lock.
+    std::string results;
+    size_type jobs;
+    size_type running;
+    std::deque<std::function<void()>> waiting;
+
+    // most jobs on the Thread_pool at once.
+    size_type max_running;
+    mutable std::mutex lock;
+    std::condition_variable idle;
+};
+
+// inline function definitions
+
+// numbers of files scanned so far.
+inline File_search::size_type File_search::files() const
+{
+  return num_files.load(std::memory_order_relaxed);
+}
+
+// numbers of lines found so far.
+inline File_search::size_type File_search::count() const
+{
+  return num_found.load(std::memory_order_relaxed);
+}
+
+#endif /* FILE_SEARCH_H */
@@ -0,0 +1,448 @@
+// Journal.cpp
+//
+// Crash-safe record of the edits made to a Buffer since its file was
+// last written, kept in a file beside it.
+//
+// The file starts with a header naming the version of the file the
+// edits apply to. Each record after it is
+//   length (4 bytes), checksum of the payload (4 bytes), payload
+// where the payload is the offset, the number of characters removed
+// and the number inserted, as varints, then the inserted characters.
+// A record cut short by a crash fails its checksum, and it and
+// everything after it are ignored.
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Journal.h"
+#include "Log.h"
+
+namespace {
+
+// first bytes of every journal.
+const char magic[8] = { 'J', 'P', 'E', 'J', 'N', 'L', '0', '1' };
+
+// size of the header: magic, then the base file's size, modification
+// time and inode, 8 bytes each.
+const std::size_t header_size = sizeof(magic) + 3 * 8;
+
+// longest the writer waits before committing what has been recorded.
+const std::chrono::milliseconds commit_interval(100);
+
+// amount of pending records that is committed at once.
+const std::size_t commit_bytes = 64 << 10;
+
+// append v to out, 7 bits at a time, low bits first.
+void put_varint(std::string &out, unsigned long long v)
+{
+  while (v >= 0x80) {
+    out.push_back(static_cast<char>((v & 0x7f) | 0x80));
+    v >>= 7;
+  }
+  out.push_back(static_cast<char>(v));
+}
+
+// read a varint from [p, end) into v, advancing p.
+// returns false if it runs off the end.
+bool get_varint(const char *&p, const char *end, unsigned long long &v)
+{
+  v = 0;
+  for (int shift = 0; p != end && shift < 64; shift += 7) {
+    auto byte = static_cast<unsigned char>(*p++);
+    v |= static_cast<unsigned long long>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// append v to out as 8 bytes, low byte first.
+void put_fixed(std::string &out, std::uint64_t v, int bytes = 8)
+{
+  for (int i = 0; i < bytes; ++i) {
+    out.push_back(static_cast<char>(v >> (8 * i)));
+  }
+}
+
+// read bytes bytes, low byte first, from p.
+std::uint64_t get_fixed(const char *p, int bytes = 8)
+{
+  std::uint64_t v = 0;
+  for (int i = 0; i < bytes; ++i) {
+    v |= static_cast<std::uint64_t>(static_cast<unsigned char>(p[i]))
+         << (8 * i);
+  }
+  return v;
+}
+
+// FNV-1a hash of [p, p + count).
+std::uint32_t checksum(const char *p, std::size_t count)
+{
+  std::uint32_t h = 2166136261u;
+  for (std::size_t i = 0; i < count; ++i) {
+    h = (h ^ static_cast<unsigned char>(p[i])) * 16777619u;
+  }
+  return h;
+}
+
+// write all of [p, p + count) to fd. returns false on failure.
+bool write_all(int fd, const char *p, std::size_t count)
+{
+  while (count > 0) {
+    ssize_t n = ::write(fd, p, count);
+    if (n < 0) {
+      return false;
+    }
+    p += n;
+    count -= n;
+  }
+  return true;
+}
+
+}
+
+// constructor:
+// journals edits to the file at base_path.
+// a journal left by an editor that did not exit cleanly is replayed
+// through apply first, if it was made against the file as it is now.
+Journal::Journal(const std::string &base_path_, const Replay &apply) :
+  base_path(base_path_), path(path_for(base_path_)), fd(-1),
+  num_recovered(0), recorded(0), committed(0), file_base(0),
+  hurry(false), restart(false), restart_mark(0), failed(false),
+  stopping(false)
+{
+  size_type intact = replay(apply);
+  if (intact > 0) {
+    recorded = committed = intact - header_size;
+  }
+  fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0600);
+  if (fd < 0) {
+    LOG_WARN("cannot open journal {}", path);
+    failed.store(true);
+    return;
+  }
+  // carry on after the last good record, if any.
+  if (!start_file(intact)) {
+    LOG_WARN("cannot write journal {}", path);
+  }
+  writer = std::thread(&Journal::work, this);
+}
+
+// commits what is left, then stops.
+Journal::~Journal()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_one();
+  if (writer.joinable()) {
+    writer.join();
+  }
+  if (fd >= 0) {
+    ::close(fd);
+  }
+}
+
+// record an edit: at offset, removed characters were replaced by
+// the count characters at text.
+// returns at once; the record is committed with the next group.
+// nothing is recorded once the journal has failed.
+void Journal::record(size_type offset, size_type removed,
+                     const char *text, size_type count)
+{
+  if (!ok()) {
+    return;
+  }
+  std::string payload;
+  put_varint(payload, offset);
+  put_varint(payload, removed);
+  put_varint(payload, count);
+  payload.append(text, count);
+
+  bool full;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    put_fixed(pending, payload.size(), 4);
+    put_fixed(pending, checksum(payload.data(), payload.size()), 4);
+    pending.append(payload);
+    recorded += 8 + payload.size();
+    full = pending.size() >= commit_bytes;
+  }
+  if (full) {
+    wake.notify_one();
+  }
+}
+
+// wait until every edit recorded so far is on disk.
+// returns false if they cannot be: the journal has failed.
+bool Journal::sync()
+{
+  std::unique_lock<std::mutex> guard(lock);
+  auto wanted = recorded;
+  hurry = true;
+  wake.notify_one();
+  done.wait(guard, [&] { return committed >= wanted || !ok(); });
+  return committed >= wanted;
+}
+
+// where the next edit recorded will go, to pass to reset once the
+// text as it is now has been written to the file.
+unsigned long long Journal::mark()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  return recorded;
+}
+
+// start afresh, after the file was written with every edit recorded
+// before mark in it. edits recorded since are kept.
+// returns at once: the writer thread starts the file over, so that the
+// disk is never waited on here. a later mark replaces one not yet
+// acted on.
+void Journal::reset(unsigned long long mark)
+{
+  if (!ok()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    restart = true;
+    restart_mark = mark;
+  }
+  wake.notify_one();
+}
+
+// stop journaling and delete the journal, for when the editor is
+// done with the file.
+void Journal::discard()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+    restart = false;
+    committed += pending.size();
+    pending.clear();
+  }
+  wake.notify_one();
+  if (writer.joinable()) {
+    writer.join();
+  }
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+    ::unlink(path.c_str());
+  }
+}
+
+// journal kept for the file at path.
+std::string Journal::path_for(const std::string &path)
+{
+  return path + ".jpedit-journal";
+}
+
+// replay the journal at path through apply, if it matches the file.
+// returns the size of the part that was intact, 0 if none.
+Journal::size_type Journal::replay(const Replay &apply)
+{
+  int in = ::open(path.c_str(), O_RDONLY);
+  if (in < 0) {
+    return 0;
+  }
+  // read it all at once: records are small and many.
+  std::string data;
+  char block[64 << 10];
+  ssize_t n;
+  while ((n = ::read(in, block, sizeof(block))) > 0) {
+    data.append(block, n);
+  }
+  ::close(in);
+  if (data.size() < header_size || data.compare(0, header_size, header())) {
+    LOG_INFO("ignoring journal {}: not made against this file", path);
+    return 0;
+  }
+
+  size_type intact = header_size;
+  const char *p = data.data() + header_size;
+  const char *end = data.data() + data.size();
+  while (end - p >= 8) {
+    auto length = get_fixed(p, 4);
+    auto sum = static_cast<std::uint32_t>(get_fixed(p + 4, 4));
+    if (length > static_cast<std::uint64_t>(end - p - 8) ||
+        checksum(p + 8, length) != sum) {
+      break;
+    }
+    const char *q = p + 8;
+    const char *record_end = q + length;
+    unsigned long long offset, removed, count;
+    if (!get_varint(q, record_end, offset) ||
+        !get_varint(q, record_end, removed) ||
+        !get_varint(q, record_end, count) ||
+        count != static_cast<unsigned long long>(record_end - q) ||
+        !apply(offset, removed, q, count)) {
+      break;
+    }
+    ++num_recovered;
+    p = record_end;
+    intact = p - data.data();
+  }
+  LOG_INFO("replayed {} edits from journal {}", num_recovered, path);
+  return intact;
+}
+
+// keep the first keep bytes of the journal file and write after them.
+// with none kept, the file is started over with a new header.
+// returns false on failure.
+bool Journal::start_file(size_type keep)
+{
+  if (::ftruncate(fd, keep) != 0 || ::lseek(fd, keep, SEEK_SET) < 0) {
+    return false;
+  }
+  if (keep > 0) {
+    return true;
+  }
+  std::string h = header();
+  return write_all(fd, h.data(), h.size()) && ::fsync(fd) == 0;
+}
+
+// header for a journal against the file as it is now.
+std::string Journal::header() const
+{
+  struct stat info;
+  if (::stat(base_path.c_str(), &info) != 0) {
+    std::memset(&info, 0, sizeof(info));
+  }
+  std::string h(magic, sizeof(magic));
+  put_fixed(h, info.st_size);
+  put_fixed(h, info.st_mtime);
+  put_fixed(h, info.st_ino);
+  return h;
+}
+
+// commit groups of records, and start the file over when asked,
+// until stopped.
+// a group goes out when commit_interval has passed since the last,
+// or sooner if commit_bytes have built up.
+void Journal::work()
+{
+  std::unique_lock<std::mutex> guard(lock);
+  while (!stopping) {
+    wake.wait(guard, [&] {
+      return stopping || restart || !pending.empty();
+    });
+    // let the group gather.
+    wake.wait_for(guard, commit_interval, [&] {
+      return stopping || hurry || restart || pending.size() >= commit_bytes;
+    });
+    hurry = false;
+    if (restart) {
+      start_over(guard);
+    } else if (!pending.empty()) {
+      commit(guard);
+    }
+  }
+  if (restart) {
+    start_over(guard);
+  }
+  if (!pending.empty()) {
+    commit(guard);
+  }
+}
+
+// write out and sync what is pending. lock is held on entry and
+// on return, but not while writing.
+void Journal::commit(std::unique_lock<std::mutex> &guard)
+{
+  std::string group;
+  group.swap(pending);
+  guard.unlock();
+  bool written = write_all(fd, group.data(), group.size()) &&
+                 ::fsync(fd) == 0;
+  guard.lock();
+  if (written) {
+    committed += group.size();
+    done.notify_all();
+  } else {
+    fail();
+  }
+}
+
+// start a new journal file holding the records from restart_mark on.
+// lock is held on entry and on return, but not while writing.
+// every record so far goes to the old file first, so that those from
+// the mark on can be read back from it. the new file is built beside
+// the old one and renamed over it, so a crash part way leaves one or
+// the other.
+void Journal::start_over(std::unique_lock<std::mutex> &guard)
+{
+  auto mark = restart_mark;
+  restart = false;
+  if (!ok()) {
+    return;
+  }
+  std::string group;
+  group.swap(pending);
+  auto upto = recorded;
+  guard.unlock();
+
+  bool good = write_all(fd, group.data(), group.size());
+  bool flushed = good;
+  // records from mark on, read back from the old file.
+  std::string kept(upto - mark, '\0');
+  off_t from = header_size + (mark - file_base);
+  for (size_type got = 0; good && got < kept.size(); ) {
+    ssize_t n = ::pread(fd, &kept[got], kept.size() - got, from + got);
+    good = n > 0;
+    got += good ? n : 0;
+  }
+
+  std::string temp_path = path + ".tmp";
+  int temp = good ? ::open(temp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC,
+                           0600)
+                  : -1;
+  std::string h = header();
+  good = good && temp >= 0 &&
+         write_all(temp, h.data(), h.size()) &&
+         write_all(temp, kept.data(), kept.size()) &&
+         ::fsync(temp) == 0 &&
+         ::rename(temp_path.c_str(), path.c_str()) == 0;
+  if (good) {
+    ::close(fd);
+    fd = temp;
+    file_base = mark;
+  } else {
+    LOG_WARN("journal {} could not be reset", path);
+    if (temp >= 0) {
+      ::close(temp);
+      ::unlink(temp_path.c_str());
+    }
+    // the old file goes on, with the group on disk in it.
+    flushed = flushed && ::fsync(fd) == 0;
+  }
+
+  guard.lock();
+  if (flushed) {
+    committed += group.size();
+    done.notify_all();
+  } else {
+    fail();
+  }
+}
+
+// give up on the journal after a group could not be written. what was
+// committed before it is still good; later records would follow a gap,
+// so none are taken, and sync reports the failure. lock is held.
+void Journal::fail()
+{
+  LOG_WARN("journal {} could not be written: edits are no longer "
+           "journaled", path);
+  failed.store(true);
+  pending.clear();
+  done.notify_all();
+}
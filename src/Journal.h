@@ -0,0 +1,153 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+// Journal.h
+//
+// Crash-safe record of the edits made to a Buffer since its file was
+// last written, kept in a file beside it.
+// Edits are appended as small binary records and committed to disk in
+// groups by a background thread, on a timer or once enough have built
+// up, so typing never waits for the disk. If the editor dies, the next
+// one to open the file replays the journal onto it.
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class Journal {
+  public:
+    using size_type = std::string::size_type;
+
+    // applies one recovered edit: at offset, removed characters are
+    // replaced by the count characters at text.
+    // returns false if the edit does not fit the text.
+    using Replay = std::function<bool(size_type offset, size_type removed,
+                                      const char *text, size_type count)>;
+
+    // constructor:
+    // journals edits to the file at base_path.
+    // a journal left by an editor that did not exit cleanly is replayed
+    // through apply first, if it was made against the file as it is now.
+    Journal(const std::string &base_path, const Replay &apply);
+
+    // commits what is left, then stops.
+    ~Journal();
+
+    Journal(const Journal &) = delete;
+    Journal &operator=(const Journal &) = delete;
+
+    // record an edit: at offset, removed characters were replaced by
+    // the count characters at text.
+    // returns at once; the record is committed with the next group.
+    void record(size_type offset, size_type removed,
+                const char *text, size_type count);
+
+    // wait until every edit recorded so far is on disk.
+    // returns false if they cannot be: the journal has failed.
+    bool sync();
+
+    // where the next edit recorded will go, to pass to reset once the
+    // text as it is now has been written to the file.
+    unsigned long long mark();
+
+    // start afresh, after the file was written with every edit recorded
+    // before mark in it. edits recorded since are kept.
+    // returns at once; the writer thread does it.
+    void reset(unsigned long long mark);
+
+    // stop journaling and delete the journal, for when the editor is
+    // done with the file.
+    void discard();
+
+    // number of edits replayed when the journal was opened.
+    size_type recovered() const;
+
+    // if the journal file could be opened for writing, and every
+    // commit to it has worked.
+    bool ok() const;
+
+    // journal kept for the file at path.
+    static std::string path_for(const std::string &path);
+
+  private:
+    // replay the journal at path through apply, if it matches the
+    // file. returns the size of the part that was intact, 0 if none.
+    size_type replay(const Replay &apply);
+
+    // keep the first keep bytes of the journal file and write after them.
+    // with none kept, the file is started over with a new header.
+    bool start_file(size_type keep);
+
+    // header for a journal against the file as it is now.
+    std::string header() const;
+
+    // commit groups of records until stopped.
+    void work();
+
+    // write out and sync what is pending. lock is held on entry and
+    // on return, but not while writing.
+    void commit(std::unique_lock<std::mutex> &lock);
+
+    // start a new journal file holding the records from restart_mark
+    // on. lock is held on entry and on return, but not while writing.
+    void start_over(std::unique_lock<std::mutex> &lock);
+
+    // give up on the journal after a group could not be written.
+    // lock is held.
+    void fail();
+
+    std::string base_path;
+    std::string path;
+    int fd;
+    size_type num_recovered;
+
+    // records waiting for the next commit, and how many bytes of
+    // records have been recorded and committed in all.
+    std::string pending;
+    unsigned long long recorded;
+    unsigned long long committed;
+
+    // bytes recorded before the first record in the file.
+    unsigned long long file_base;
+
+    // if sync is waiting for the next commit.
+    bool hurry;
+
+    // if the writer is to start the file over, and from which mark.
+    bool restart;
+    unsigned long long restart_mark;
+
+    // set when a group could not be written, or the file opened:
+    // records after it would follow a gap, so none are taken or
+    // acknowledged from then on.
+    std::atomic<bool> failed;
+
+    // the members above are guarded by lock. the file is only written
+    // by the writer thread.
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    bool stopping;
+
+    std::thread writer;
+};
+
+// inline function definitions
+
+// number of edits replayed when the journal was opened.
+inline Journal::size_type Journal::recovered() const
+{
+  return num_recovered;
+}
+
+// if the journal file could be opened for writing, and every commit to
+// it has worked.
+inline bool Journal::ok() const
+{
+  return !failed.load();
+}
+
+#endif /* JOURNAL_H */
@@ -0,0 +1,144 @@
+// Key_parser.cpp
+//
+// Turns the bytes a terminal sends into keys, as ncurses numbers them.
+
+#include <algorithm>
+#include <string>
+
+#include <ncurses.h>
+
+#include "Key_parser.h"
+
+namespace {
+
+// terminfo names of the sequences special keys send, and their keys.
+struct Capability {
+  const char *name;
+  int key;
+};
+
+const Capability capabilities[] = {
+  { "kcuu1", KEY_UP }, { "kcud1", KEY_DOWN },
+  { "kcub1", KEY_LEFT }, { "kcuf1", KEY_RIGHT },
+  { "khome", KEY_HOME }, { "kend", KEY_END },
+  { "kpp", KEY_PPAGE }, { "knp", KEY_NPAGE },
+  { "kich1", KEY_IC }, { "kdch1", KEY_DC },
+  { "kbs", KEY_BACKSPACE }, { "kent", KEY_ENTER },
+};
+
+// what most terminals send, whether or not the keypad is in
+// application mode, in case terminfo does not say.
+struct Fallback {
+  const char *sequence;
+  int key;
+};
+
+const Fallback fallbacks[] = {
+  { "\033[A", KEY_UP }, { "\033[B", KEY_DOWN },
+  { "\033[D", KEY_LEFT }, { "\033[C", KEY_RIGHT },
+  { "\033OA", KEY_UP }, { "\033OB", KEY_DOWN },
+  { "\033OD", KEY_LEFT }, { "\033OC", KEY_RIGHT },
+  { "\033[H", KEY_HOME }, { "\033[F", KEY_END },
+  { "\033OH", KEY_HOME }, { "\033OF", KEY_END },
+  { "\033[1~", KEY_HOME }, { "\033[4~", KEY_END },
+  { "\033[7~", KEY_HOME }, { "\033[8~", KEY_END },
+  { "\033[5~", KEY_PPAGE }, { "\033[6~", KEY_NPAGE },
+  { "\033[2~", KEY_IC }, { "\033[3~", KEY_DC },
+  { "\033OM", KEY_ENTER }, { "\177", KEY_BACKSPACE },
+};
+
+// how many bytes taken may pile up before they are let go of.
+const Key_parser::size_type max_taken = 4096;
+
+}
+
+// constructor:
+// knows the sequences terminfo says the terminal sends, and those most
+// terminals send for the keys the editor uses.
+// terminfo knows nothing until the Backend has loaded it.
+Key_parser::Key_parser() : leads(256, false), start(0)
+{
+  for (auto &cap : capabilities) {
+    char *sequence = tigetstr(const_cast<char *>(cap.name));
+    if (sequence != nullptr && sequence != reinterpret_cast<char *>(-1) &&
+        sequence[0] != '\0') {
+      add(sequence, cap.key);
+    }
+  }
+  for (auto &fallback : fallbacks) {
+    add(fallback.sequence, fallback.key);
+  }
+}
+
+// know that the terminal sends sequence for key.
+// a sequence already known keeps the key it had.
+void Key_parser::add(const std::string &sequence, int key)
+{
+  if (sequence.empty()) {
+    return;
+  }
+  auto at = std::lower_bound(
+      sequences.begin(), sequences.end(), sequence,
+      [](const std::pair<std::string, int> &known, const std::string &s) {
+        return known.first < s;
+      });
+  if (at == sequences.end() || at->first != sequence) {
+    sequences.insert(at, std::make_pair(sequence, key));
+    leads[static_cast<unsigned char>(sequence[0])] = true;
+  }
+}
+
+// add bytes read from the terminal.
+void Key_parser::feed(const char *bytes, size_type count)
+{
+  if (start == input.size()) {
+    input.clear();
+    start = 0;
+  } else if (start > max_taken) {
+    input.erase(0, start);
+    start = 0;
+  }
+  input.append(bytes, count);
+}
+
+// take the next key. returns ERR if there is none yet.
+// the longest sequence the bytes start with is taken; if they could
+// still go on to make a longer one, they are waited on, unless flush.
+// bytes that start no sequence are keys by themselves: a return is
+// taken as a line break, as ncurses does.
+int Key_parser::next(bool flush /* = false */)
+{
+  if (start == input.size()) {
+    return ERR;
+  }
+  unsigned char first = input[start];
+  if (!leads[first]) {
+    // most keys are typed text, and start no sequence.
+    ++start;
+    return first == '\r' ? '\n' : first;
+  }
+  const char *rest = input.data() + start;
+  size_type length = input.size() - start;
+  size_type matched = 0;
+  int key = ERR;
+  for (auto &known : sequences) {
+    auto &sequence = known.first;
+    if (sequence.size() <= length) {
+      if (sequence.size() > matched &&
+          sequence.compare(0, sequence.size(), rest,
+                           sequence.size()) == 0) {
+        matched = sequence.size();
+        key = known.second;
+      }
+    } else if (!flush && sequence.compare(0, length, rest, length) == 0) {
+      // more may be on the way.
+      return ERR;
+    }
+  }
+  if (matched > 0) {
+    start += matched;
+    return key;
+  }
+  unsigned char letter = input[start++];
+  return letter == '\r' ? '\n' : letter;
+}
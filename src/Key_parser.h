@@ -0,0 +1,61 @@
+#ifndef KEY_PARSER_H
+#define KEY_PARSER_H
+
+// Key_parser.h
+//
+// Turns the bytes a terminal sends into keys, as ncurses numbers them:
+// plain characters are themselves, and the sequences special keys send
+// (arrows, HOME, DELETE, ...) are KEY_ codes.
+// Most sequences start with ESC, which is also a key of its own. ESC
+// followed by bytes that cannot go on to make a sequence is taken at
+// once; only ESC, or the start of a sequence, with nothing after it
+// yet has to wait, and the caller says when it has waited long enough.
+
+#include <string>
+#include <utility>
+#include <vector>
+
+class Key_parser {
+  public:
+    using size_type = std::string::size_type;
+
+    // constructor:
+    // knows the sequences terminfo says the terminal sends, and those
+    // most terminals send for the keys the editor uses.
+    Key_parser();
+
+    // know that the terminal sends sequence for key.
+    void add(const std::string &sequence, int key);
+
+    // add bytes read from the terminal.
+    void feed(const char *bytes, size_type count);
+
+    // take the next key. returns ERR if there is none yet.
+    // bytes that may be the start of a sequence are waited on, unless
+    // flush: then they are taken as keys by themselves.
+    int next(bool flush = false);
+
+    // if bytes have been fed that are not keys yet.
+    bool pending() const;
+
+  private:
+    // known sequences, in order, with their keys.
+    std::vector<std::pair<std::string, int>> sequences;
+
+    // which bytes some sequence starts with, by value.
+    std::vector<bool> leads;
+
+    // bytes fed and not yet taken, from start on.
+    std::string input;
+    size_type start;
+};
+
+// inline function definitions
+
+// if bytes have been fed that are not keys yet.
+inline bool Key_parser::pending() const
+{
+  return start < input.size();
+}
+
+#endif /* KEY_PARSER_H */
@@ -0,0 +1,42 @@
+// Keymap.cpp
+//
+// Table of which command each key runs.
+
+#include "Keymap.h"
+
+// constructor:
+// no keys are bound.
+Keymap::Keymap()
+{
+  // empty
+}
+
+// make key run the given command, replacing what it ran before.
+// keys are small numbers (ncurses codes), so the table is indexed
+// directly.
+void Keymap::bind(int key, const Command &command)
+{
+  if (key < 0) {
+    return;
+  }
+  if (static_cast<size_t>(key) >= commands.size()) {
+    commands.resize(key + 1);
+  }
+  commands[key] = command;
+}
+
+// shorthand for binding a command given by its parts.
+void Keymap::bind(int key, const char *name, const Command::action &run,
+                  bool repeats /* = false */)
+{
+  Command command = { run, name, repeats };
+  bind(key, command);
+}
+
+// make key run nothing.
+void Keymap::unbind(int key)
+{
+  if (key >= 0 && static_cast<size_t>(key) < commands.size()) {
+    commands[key] = Command();
+  }
+}
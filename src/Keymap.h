@@ -0,0 +1,70 @@
+#ifndef KEYMAP_H
+#define KEYMAP_H
+
+// Keymap.h
+//
+// Table of which command each key runs.
+// Keys can be bound, rebound and unbound while editing.
+
+#include <functional>
+#include <vector>
+
+#include "Buffer.h"
+
+class Window;
+
+// something a key can do.
+struct Command {
+  // do the command count times over, setting change to what was done.
+  // returns false if editing should stop.
+  using action = std::function<bool(Window &, Buffer &, int count,
+                                    Buffer::Changeset &change)>;
+
+  action run;
+
+  // what the command is called, e.g. in timing reports.
+  // a string literal.
+  const char *name;
+
+  // if a queued run of the same key can be done as one call,
+  // with the length of the run as its count.
+  bool repeats;
+};
+
+class Keymap {
+  public:
+    // constructor:
+    // no keys are bound.
+    Keymap();
+
+    // make key run the given command, replacing what it ran before.
+    void bind(int key, const Command &command);
+
+    // shorthand for binding a command given by its parts.
+    void bind(int key, const char *name, const Command::action &run,
+              bool repeats = false);
+
+    // make key run nothing.
+    void unbind(int key);
+
+    // command bound to key, or nullptr if there is none.
+    const Command *find(int key) const;
+
+  private:
+    // commands indexed by key. keys with no command have no action.
+    std::vector<Command> commands;
+};
+
+// inline function definitions
+
+// command bound to key, or nullptr if there is none.
+inline const Command *Keymap::find(int key) const
+{
+  if (key < 0 || static_cast<size_t>(key) >= commands.size() ||
+      !commands[key].run) {
+    return nullptr;
+  }
+  return &commands[key];
+}
+
+#endif /* KEYMAP_H */
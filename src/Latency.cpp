@@ -0,0 +1,150 @@
+// Latency.cpp
+//
+// Timing of the editing loop: histograms of how long each stage of a
+// keystroke and each command take.
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+#include "Latency.h"
+
+namespace {
+
+// enough buckets for any 64-bit value.
+const int num_buckets = (64 - 4 + 1) << 4;
+
+// one line of the report.
+void report_line(std::string &out, const char *name, const Histogram &h)
+{
+  char line[160];
+  std::snprintf(line, sizeof(line),
+                "%-14s %9llu %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+                name, h.count(), h.mean() / 1e3,
+                h.percentile(0.50) / 1e3, h.percentile(0.90) / 1e3,
+                h.percentile(0.99) / 1e3, h.max() / 1e3);
+  out.append(line);
+}
+
+}
+
+// constructor:
+// empty.
+Histogram::Histogram() :
+  counts(num_buckets, 0), total(0), largest(0), sum(0)
+{
+  // empty
+}
+
+// count one sample.
+void Histogram::record(long long ns)
+{
+  if (ns < 0) {
+    ns = 0;
+  }
+  ++counts[bucket_of(ns)];
+  ++total;
+  sum += ns;
+  if (ns > largest) {
+    largest = ns;
+  }
+}
+
+// smallest value that at least the given fraction of samples
+// are no greater than, to within a bucket. 0 if empty.
+long long Histogram::percentile(double fraction) const
+{
+  if (total == 0) {
+    return 0;
+  }
+  auto wanted = static_cast<unsigned long long>(fraction * total + 0.5);
+  if (wanted == 0) {
+    wanted = 1;
+  }
+  unsigned long long seen = 0;
+  for (int i = 0; i < num_buckets; ++i) {
+    seen += counts[i];
+    if (seen >= wanted) {
+      // a bucket's top may overshoot the largest sample.
+      auto top = static_cast<long long>(bucket_top(i));
+      return top < largest ? top : largest;
+    }
+  }
+  return largest;
+}
+
+// average sample. 0 if empty.
+double Histogram::mean() const
+{
+  return total == 0 ? 0 : sum / total;
+}
+
+// bucket holding value v.
+// values below sub_buckets get a bucket each; above that, the bucket
+// is picked by the top bit (the power of 2) and the sub_bits below it.
+int Histogram::bucket_of(unsigned long long v)
+{
+  if (v < static_cast<unsigned long long>(sub_buckets)) {
+    return static_cast<int>(v);
+  }
+  int top_bit = 63 - __builtin_clzll(v);
+  int shift = top_bit - sub_bits;
+  int sub = static_cast<int>((v >> shift) & (sub_buckets - 1));
+  return ((shift + 1) << sub_bits) + sub;
+}
+
+// largest value held by bucket i.
+unsigned long long Histogram::bucket_top(int i)
+{
+  if (i < sub_buckets) {
+    return i;
+  }
+  int shift = (i >> sub_bits) - 1;
+  unsigned long long sub = i & (sub_buckets - 1);
+  unsigned long long first = (sub_buckets + sub) << shift;
+  return first + ((1ull << shift) - 1);
+}
+
+// constructor:
+// no samples.
+Latency_stats::Latency_stats()
+{
+  // empty
+}
+
+// count a sample for the command with the given name.
+void Latency_stats::record_command(const char *name, long long ns)
+{
+  commands[name].record(ns);
+}
+
+// table of counts and percentiles, one line per stage and command.
+// times are in microseconds.
+std::string Latency_stats::report() const
+{
+  static const char *stage_names[num_stages] = {
+    "input", "command", "changeset", "draw", "flush", "total",
+  };
+  std::string out;
+  char line[160];
+  std::snprintf(line, sizeof(line),
+                "%-14s %9s %10s %10s %10s %10s %10s\n",
+                "(us)", "count", "mean", "p50", "p90", "p99", "max");
+  out.append(line);
+  for (int s = 0; s < num_stages; ++s) {
+    report_line(out, stage_names[s], stages[s]);
+  }
+  out.append("\n");
+  for (const auto &c : commands) {
+    report_line(out, c.first, c.second);
+  }
+  return out;
+}
+
+// write the report to the file at path. returns false on failure.
+bool Latency_stats::dump(const std::string &path) const
+{
+  std::ofstream out(path);
+  out << report();
+  return static_cast<bool>(out);
+}
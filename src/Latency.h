@@ -0,0 +1,134 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+// Latency.h
+//
+// Timing of the editing loop: histograms of how long each stage of a
+// keystroke and each command take.
+
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+// HDR-style histogram of durations in nanoseconds.
+// buckets are log-linear: each power of 2 is split into equal
+// sub-buckets, so every value is kept to within a few percent,
+// however large, in constant space.
+class Histogram {
+  public:
+    // constructor:
+    // empty.
+    Histogram();
+
+    // count one sample.
+    void record(long long ns);
+
+    // number of samples.
+    unsigned long long count() const;
+
+    // smallest value that at least the given fraction of samples
+    // are no greater than, to within a bucket. 0 if empty.
+    long long percentile(double fraction) const;
+
+    // largest sample. 0 if empty.
+    long long max() const;
+
+    // average sample. 0 if empty.
+    double mean() const;
+
+  private:
+    // each power of 2 is split into this many buckets.
+    static const int sub_bits = 4;
+    static const int sub_buckets = 1 << sub_bits;
+
+    // bucket holding value v.
+    static int bucket_of(unsigned long long v);
+
+    // largest value held by bucket i.
+    static unsigned long long bucket_top(int i);
+
+    std::vector<unsigned long long> counts;
+    unsigned long long total;
+    long long largest;
+    double sum;
+};
+
+// histograms for the stages of handling input, and for each command.
+class Latency_stats {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    // parts of the time from a key arriving to the screen showing it.
+    enum Stage {
+      input,      // reading keys that have arrived
+      command,    // running commands (all of them)
+      changeset,  // combining the Changesets of a burst
+      draw,       // drawing changed lines into the Screen
+      flush,      // sending the Screen to the terminal
+      total,      // the whole way, once per burst
+      num_stages
+    };
+
+    // constructor:
+    // no samples.
+    Latency_stats();
+
+    // count a sample for the given stage.
+    void record(Stage stage, long long ns);
+
+    // count a sample for the command with the given name.
+    // name must be a string literal: only the pointer is kept.
+    void record_command(const char *name, long long ns);
+
+    // nanoseconds since start.
+    static long long since(const Clock::time_point &start);
+
+    // table of counts and percentiles, one line per stage and command.
+    std::string report() const;
+
+    // write the report to the file at path. returns false on failure.
+    bool dump(const std::string &path) const;
+
+  private:
+    // orders command names by their text.
+    struct Name_less {
+      bool operator()(const char *a, const char *b) const
+      {
+        return std::strcmp(a, b) < 0;
+      }
+    };
+
+    Histogram stages[num_stages];
+    std::map<const char *, Histogram, Name_less> commands;
+};
+
+// inline function definitions
+
+// number of samples.
+inline unsigned long long Histogram::count() const
+{
+  return total;
+}
+
+// largest sample. 0 if empty.
+inline long long Histogram::max() const
+{
+  return largest;
+}
+
+// count a sample for the given stage.
+inline void Latency_stats::record(Stage stage, long long ns)
+{
+  stages[stage].record(ns);
+}
+
+// nanoseconds since start.
+inline long long Latency_stats::since(const Clock::time_point &start)
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      Clock::now() - start).count();
+}
+
+#endif /* LATENCY_H */
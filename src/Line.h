@@ -1,12 +0,0 @@
-#ifndef LINE_H
-#define LINE_H
-
-// Line.h
-//
-// Represents a line of text.
-
-#include <list>
-
-using Line = std::list<char>;
-
-#endif /* LINE_H */
@@ -0,0 +1,178 @@
+// Line_index.cpp
+//
+// Positions of every newline in a block of read-only text.
+
+#include <algorithm>
+#include <mutex>
+#include <string>
+
+#include "Line_index.h"
+#include "Newline_scan.h"
+#include "Thread_pool.h"
+
+const Line_index::size_type Line_index::chunk_size;
+
+// constructor:
+// starts indexing text[0, length). small texts are indexed
+// immediately, large ones in the background.
+Line_index::Line_index(const char *text_, size_type length_) :
+  text(text_), length(length_), total(0), remaining(0),
+  cancelled(false), is_ready(false)
+{
+  size_type num_chunks = (length + chunk_size - 1) / chunk_size;
+  chunks.resize(num_chunks);
+  remaining = num_chunks;
+  if (num_chunks <= 1) {
+    // not worth a thread.
+    if (num_chunks == 1) {
+      scan(0);
+    } else {
+      is_ready = true;
+    }
+    return;
+  }
+  Thread_pool &pool = Thread_pool::shared();
+  for (size_type i = 0; i < num_chunks; ++i) {
+    pool.submit([this, i] { scan(i); });
+  }
+}
+
+// stops any indexing still in progress.
+// queued jobs still refer to this index, so wait for them to drain.
+Line_index::~Line_index()
+{
+  cancelled = true;
+  std::unique_lock<std::mutex> guard(lock);
+  done.wait(guard, [this] { return remaining.load() == 0; });
+}
+
+// block until the whole text has been indexed.
+void Line_index::wait() const
+{
+  if (ready()) {
+    return;
+  }
+  std::unique_lock<std::mutex> guard(lock);
+  done.wait(guard, [this] { return ready(); });
+}
+
+// total number of newlines in the text.
+Line_index::size_type Line_index::newlines() const
+{
+  wait();
+  return total;
+}
+
+// number of newlines before pos.
+Line_index::size_type Line_index::rank(size_type pos) const
+{
+  wait();
+  if (pos >= length) {
+    return total;
+  }
+  const Chunk &chunk = chunks[pos / chunk_size];
+  auto rel = static_cast<std::uint32_t>(pos % chunk_size);
+  auto it = std::lower_bound(begin(chunk.offsets), end(chunk.offsets), rel);
+  return chunk.before + (it - begin(chunk.offsets));
+}
+
+// position of newline number n (from 0).
+// finds the last chunk starting at or before it, then looks inside.
+Line_index::size_type Line_index::nth(size_type n) const
+{
+  wait();
+  auto after = std::upper_bound(begin(chunks), end(chunks), n,
+      [](size_type k, const Chunk &c) { return k < c.before; });
+  size_type c = (after - begin(chunks)) - 1;
+  // skip chunks with no newlines, which share their successor's count.
+  while (n - chunks[c].before >= chunks[c].offsets.size()) {
+    ++c;
+  }
+  return c * chunk_size + chunks[c].offsets[n - chunks[c].before];
+}
+
+// position of the first newline at or after pos.
+bool Line_index::next_newline(size_type pos, size_type &found) const
+{
+  if (!ready()) {
+    return false;
+  }
+  found = length;
+  if (pos >= length) {
+    return true;
+  }
+  size_type c = pos / chunk_size;
+  const auto &first = chunks[c].offsets;
+  auto it = std::lower_bound(begin(first), end(first),
+                             static_cast<std::uint32_t>(pos - c * chunk_size));
+  if (it != end(first)) {
+    found = c * chunk_size + *it;
+    return true;
+  }
+  for (++c; c < chunks.size(); ++c) {
+    if (!chunks[c].offsets.empty()) {
+      found = c * chunk_size + chunks[c].offsets.front();
+      return true;
+    }
+  }
+  return true;
+}
+
+// position of the last newline before pos.
+bool Line_index::prev_newline(size_type pos, size_type &found) const
+{
+  if (!ready()) {
+    return false;
+  }
+  found = std::string::npos;
+  if (pos > length) {
+    pos = length;
+  }
+  if (pos == 0) {
+    return true;
+  }
+  size_type c = (pos - 1) / chunk_size;
+  const auto &last = chunks[c].offsets;
+  auto it = std::lower_bound(begin(last), end(last),
+                             static_cast<std::uint32_t>(pos - c * chunk_size));
+  if (it != begin(last)) {
+    found = c * chunk_size + *--it;
+    return true;
+  }
+  while (c > 0) {
+    --c;
+    if (!chunks[c].offsets.empty()) {
+      found = c * chunk_size + chunks[c].offsets.back();
+      return true;
+    }
+  }
+  return true;
+}
+
+// index chunk number i.
+void Line_index::scan(size_type i)
+{
+  if (!cancelled) {
+    size_type start = i * chunk_size;
+    size_type count = std::min(chunk_size, length - start);
+    newline_scan::find_all(text + start, count, chunks[i].offsets);
+  }
+  finish_chunk();
+}
+
+// record that a chunk has finished.
+// the last one to finish totals up the chunks and wakes any waiters.
+void Line_index::finish_chunk()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  if (--remaining == 0) {
+    if (!cancelled) {
+      for (auto &chunk : chunks) {
+        chunk.before = total;
+        total += chunk.offsets.size();
+      }
+      is_ready.store(true, std::memory_order_release);
+    }
+    done.notify_all();
+  }
+}
@@ -0,0 +1,108 @@
+#ifndef LINE_INDEX_H
+#define LINE_INDEX_H
+
+// Line_index.h
+//
+// Positions of every newline in a block of read-only text.
+// Large texts are cut into chunks that are scanned in the background
+// on the shared Thread_pool, so the text can be used (and shown)
+// before it is fully indexed. Offsets are stored as 32 bits relative
+// to their chunk, 4 bytes per line.
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class Line_index {
+  public:
+    using size_type = std::string::size_type;
+
+    // constructor:
+    // starts indexing text[0, length). small texts are indexed
+    // immediately, large ones in the background.
+    // text must outlive this index.
+    Line_index(const char *text_, size_type length_);
+
+    // stops any indexing still in progress.
+    ~Line_index();
+
+    Line_index(const Line_index &) = delete;
+    Line_index &operator=(const Line_index &) = delete;
+
+    // if the whole text has been indexed.
+    bool ready() const;
+
+    // block until the whole text has been indexed.
+    void wait() const;
+
+    // total number of newlines in the text.
+    // waits for the index.
+    size_type newlines() const;
+
+    // number of newlines before pos.
+    // waits for the index.
+    size_type rank(size_type pos) const;
+
+    // position of newline number n (from 0).
+    // waits for the index. n must be less than newlines().
+    size_type nth(size_type n) const;
+
+    // position of the first newline at or after pos.
+    // false, without waiting, if the index is not ready yet.
+    // found is set to the text length if there is none.
+    bool next_newline(size_type pos, size_type &found) const;
+
+    // position of the last newline before pos.
+    // false, without waiting, if the index is not ready yet.
+    // found is set to npos if there is none.
+    bool prev_newline(size_type pos, size_type &found) const;
+
+    // number of characters indexed by each background job.
+    static const size_type chunk_size = 8 << 20;
+
+  private:
+    struct Chunk {
+      // newline offsets, relative to the chunk's start.
+      std::vector<std::uint32_t> offsets;
+
+      // newlines in all the chunks before this one.
+      size_type before;
+    };
+
+    // index chunk number i.
+    void scan(size_type i);
+
+    // record that a chunk has finished.
+    void finish_chunk();
+
+    const char *text;
+    size_type length;
+
+    std::vector<Chunk> chunks;
+
+    // total newlines, valid once ready.
+    size_type total;
+
+    // chunks not yet scanned.
+    std::atomic<size_type> remaining;
+
+    // set by the destructor to skip unstarted chunks.
+    std::atomic<bool> cancelled;
+
+    std::atomic<bool> is_ready;
+    mutable std::mutex lock;
+    mutable std::condition_variable done;
+};
+
+// inline function definitions
+
+// if the whole text has been indexed.
+inline bool Line_index::ready() const
+{
+  return is_ready.load(std::memory_order_acquire);
+}
+
+#endif /* LINE_INDEX_H */
@@ -0,0 +1,287 @@
+// Log.cpp
+//
+// Logging for debugging.
+// Writers claim slots of a bounded ring buffer without locking; one
+// background thread takes them in order, formats them and appends them
+// to the log file.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "Log.h"
+
+#ifndef LOG_FILE
+#define LOG_FILE "jpedit.log"
+#endif /* LOG_FILE */
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// number of slots in the ring. a power of 2.
+const std::size_t capacity = 4096;
+
+// how long the writer sleeps when there is nothing to write.
+const std::chrono::milliseconds idle_wait(20);
+
+}
+
+thread_local int Log::depth = 0;
+
+// the ring buffer and the thread that empties it.
+// made on the first message, so that programs that never log
+// never start the thread.
+class Log_sink {
+  public:
+    // constructor:
+    // opens the log file and starts writing.
+    Log_sink();
+
+    // writes out what is left, then stops.
+    ~Log_sink();
+
+    Log_sink(const Log_sink &) = delete;
+    Log_sink &operator=(const Log_sink &) = delete;
+
+    // see Log::claim and Log::publish.
+    Log::Record *claim();
+    void publish(Log::Record *r);
+
+    // write out every published message. returns how many there were.
+    int drain();
+
+    // when the log started.
+    const Clock::time_point epoch;
+
+  private:
+    // write out messages until stopped.
+    void work();
+
+    // write r's message to the log file.
+    void format(const Log::Record &r);
+
+    Log::Record ring[capacity];
+
+    // next ticket for writers; next ticket to be written out.
+    std::atomic<std::size_t> enqueue_pos;
+    std::size_t dequeue_pos;
+
+    // messages lost because the ring was full.
+    std::atomic<std::size_t> dropped;
+
+    std::FILE *file;
+    std::string line;
+
+    // only one thread formats at a time.
+    std::mutex draining;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stopping;
+    std::thread writer;
+};
+
+namespace {
+
+// the sink, made on first use.
+Log_sink &sink()
+{
+  static Log_sink s;
+  return s;
+}
+
+}
+
+// constructor:
+// opens the log file and starts writing.
+Log_sink::Log_sink() :
+  epoch(Clock::now()), enqueue_pos(0), dequeue_pos(0), dropped(0),
+  file(std::fopen(LOG_FILE, "w")), stopping(false)
+{
+  for (std::size_t i = 0; i < capacity; ++i) {
+    ring[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  writer = std::thread(&Log_sink::work, this);
+}
+
+// writes out what is left, then stops.
+Log_sink::~Log_sink()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_all();
+  writer.join();
+  drain();
+  if (file != nullptr) {
+    std::fclose(file);
+  }
+}
+
+// slot for a new message, or nullptr if the ring is full.
+// a slot is free for ticket t when its sequence is t.
+Log::Record *Log_sink::claim()
+{
+  std::size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+  for (;;) {
+    Log::Record &r = ring[pos & (capacity - 1)];
+    std::size_t seq = r.sequence.load(std::memory_order_acquire);
+    auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+    if (diff == 0) {
+      if (enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                                            std::memory_order_relaxed)) {
+        r.ticket = pos;
+        return &r;
+      }
+    } else if (diff < 0) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return nullptr;
+    } else {
+      pos = enqueue_pos.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+// hand a filled slot to the writer.
+// a slot is ready to write out when its sequence is its ticket + 1.
+void Log_sink::publish(Log::Record *r)
+{
+  r->sequence.store(r->ticket + 1, std::memory_order_release);
+}
+
+// write out every published message. returns how many there were.
+int Log_sink::drain()
+{
+  std::lock_guard<std::mutex> guard(draining);
+  int written = 0;
+  for (;;) {
+    Log::Record &r = ring[dequeue_pos & (capacity - 1)];
+    if (r.sequence.load(std::memory_order_acquire) != dequeue_pos + 1) {
+      break;
+    }
+    format(r);
+    // free the slot for the ticket one lap ahead.
+    r.sequence.store(dequeue_pos + capacity, std::memory_order_release);
+    ++dequeue_pos;
+    ++written;
+  }
+  std::size_t lost = dropped.exchange(0, std::memory_order_relaxed);
+  if (file != nullptr) {
+    if (lost > 0) {
+      std::fprintf(file, "(%zu messages dropped)\n", lost);
+    }
+    std::fflush(file);
+  }
+  return written;
+}
+
+// write out messages until stopped.
+void Log_sink::work()
+{
+  std::unique_lock<std::mutex> guard(lock);
+  while (!stopping) {
+    guard.unlock();
+    int written = drain();
+    guard.lock();
+    if (written == 0) {
+      wake.wait_for(guard, idle_wait);
+    }
+  }
+}
+
+// write r's message to the log file:
+// seconds since start, level, indent, then the message.
+void Log_sink::format(const Log::Record &r)
+{
+  static const char levels[] = "TDIWE";
+  char number[32];
+
+  line.clear();
+  std::snprintf(number, sizeof(number), "%11.6f %c ", r.time / 1e9,
+                levels[r.level]);
+  line.append(number);
+  line.append(4 * r.indent, ' ');
+
+  int next = 0;
+  for (const char *f = r.format; *f != '\0'; ++f) {
+    if (f[0] != '{' || f[1] != '}' || next == r.num_args) {
+      line.push_back(*f);
+      continue;
+    }
+    const Log::Arg &a = r.args[next++];
+    switch (a.type) {
+      case Log::Arg::signed_int:
+        std::snprintf(number, sizeof(number), "%lld", a.i);
+        line.append(number);
+        break;
+      case Log::Arg::unsigned_int:
+        std::snprintf(number, sizeof(number), "%llu", a.u);
+        line.append(number);
+        break;
+      case Log::Arg::floating:
+        std::snprintf(number, sizeof(number), "%g", a.d);
+        line.append(number);
+        break;
+      case Log::Arg::boolean:
+        line.append(a.b ? "true" : "false");
+        break;
+      case Log::Arg::letter:
+        line.push_back(a.c);
+        break;
+      case Log::Arg::text:
+        line.append(r.text + a.t.offset, a.t.length);
+        break;
+    }
+    ++f;
+  }
+  line.push_back('\n');
+  if (file != nullptr) {
+    std::fwrite(line.data(), 1, line.size(), file);
+  }
+}
+
+// slot for a new message, stamped with the time and indent,
+// or nullptr if the ring is full.
+Log::Record *Log::claim(Level level, const char *format)
+{
+  Log_sink &s = sink();
+  Record *r = s.claim();
+  if (r == nullptr) {
+    return nullptr;
+  }
+  r->time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      Clock::now() - s.epoch).count();
+  r->format = format;
+  r->level = level;
+  r->indent = depth;
+  r->num_args = 0;
+  r->text_used = 0;
+  return r;
+}
+
+// hand a filled slot to the writer.
+void Log::publish(Record *r)
+{
+  sink().publish(r);
+}
+
+// write out everything recorded so far. blocks until done.
+void Log::flush()
+{
+  sink().drain();
+}
+
+Log::Indent::Indent()
+{
+  ++depth;
+}
+
+Log::Indent::~Indent()
+{
+  --depth;
+}
@@ -0,0 +1,281 @@
+#ifndef LOG_H
+#define LOG_H
+
+// Log.h
+//
+// Logging for debugging.
+// Messages below the compile-time level LOG_LEVEL generate no code.
+// The rest are recorded unformatted into a lock-free ring buffer, and a
+// background thread formats them and writes them to the log file.
+//
+//   LOG_TRACE("moved {} lines down", num_lines);
+//   LOG_INDENT();  // indent this thread's messages to the end of scope
+
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+// levels, least important first.
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_WARN 3
+#define LOG_LEVEL_ERROR 4
+#define LOG_LEVEL_OFF 5
+
+// messages below this level are compiled out.
+#ifndef LOG_LEVEL
+#ifdef NDEBUG
+#define LOG_LEVEL LOG_LEVEL_WARN
+#else
+#define LOG_LEVEL LOG_LEVEL_TRACE
+#endif /* NDEBUG */
+#endif /* LOG_LEVEL */
+
+class Log {
+  public:
+    enum Level { trace, debug, info, warn, error };
+
+    // record a message. each "{}" in format is replaced by the next
+    // argument when the message is written out.
+    // format must be a string literal: only the pointer is kept.
+    // if the ring buffer is full, the message is dropped and counted.
+    template <std::size_t N, typename... Args>
+    static void write(Level level, const char (&format)[N],
+                      const Args &... args);
+
+    // write out everything recorded so far. blocks until done.
+    static void flush();
+
+    // indents messages from this thread for as long as it exists.
+    class Indent {
+      public:
+        Indent();
+        ~Indent();
+
+        Indent(const Indent &) = delete;
+        Indent &operator=(const Indent &) = delete;
+    };
+
+  private:
+    // the ring buffer and its writer thread.
+    friend class Log_sink;
+
+    static const int max_args = 8;
+    static const int text_size = 128;
+
+    // one argument of a message, kept as is until it is formatted.
+    struct Arg {
+      enum Type { signed_int, unsigned_int, floating, boolean, letter, text };
+
+      Type type;
+      union {
+        long long i;
+        unsigned long long u;
+        double d;
+        bool b;
+        char c;
+        // characters [offset, offset + length) of the Record's text.
+        struct {
+          unsigned short offset;
+          unsigned short length;
+        } t;
+      };
+    };
+
+    // slot of the ring buffer: a message waiting to be written out.
+    struct Record {
+      // slot's place in the ring's sequence; says who may use it.
+      std::atomic<std::size_t> sequence;
+      std::size_t ticket;
+      long long time;
+      const char *format;
+      Level level;
+      int indent;
+      int num_args;
+      int text_used;
+      Arg args[max_args];
+      // copies of string arguments.
+      char text[text_size];
+    };
+
+    // slot for a new message, stamped with the time and indent,
+    // or nullptr if the ring is full.
+    static Record *claim(Level level, const char *format);
+
+    // hand a filled slot to the writer.
+    static void publish(Record *r);
+
+    // next argument slot of r, or nullptr if it has no more.
+    static Arg *next_arg(Record &r, Arg::Type type);
+
+    // copy length characters into r's text.
+    static void add_text(Record &r, const char *chars, std::size_t length);
+
+    // capture one argument, by type.
+    static void add(Record &r, bool b);
+    static void add(Record &r, char c);
+    static void add(Record &r, const char *s);
+    static void add(Record &r, const std::string &s);
+    template <typename T>
+    static typename std::enable_if<std::is_integral<T>::value &&
+                                   std::is_signed<T>::value>::type
+    add(Record &r, T i);
+    template <typename T>
+    static typename std::enable_if<std::is_integral<T>::value &&
+                                   std::is_unsigned<T>::value>::type
+    add(Record &r, T u);
+    template <typename T>
+    static typename std::enable_if<std::is_floating_point<T>::value>::type
+    add(Record &r, T d);
+
+    // this thread's indent level.
+    static thread_local int depth;
+};
+
+// inline function definitions
+
+// record a message. each "{}" in format is replaced by the next
+// argument when the message is written out.
+template <std::size_t N, typename... Args>
+inline void Log::write(Level level, const char (&format)[N],
+                       const Args &... args)
+{
+  Record *r = claim(level, format);
+  if (r == nullptr) {
+    return;
+  }
+  // capture arguments in order.
+  int in_order[] = { 0, (add(*r, args), 0)... };
+  (void)in_order;
+  publish(r);
+}
+
+// next argument slot of r, or nullptr if it has no more.
+inline Log::Arg *Log::next_arg(Record &r, Arg::Type type)
+{
+  if (r.num_args == max_args) {
+    return nullptr;
+  }
+  Arg *a = &r.args[r.num_args++];
+  a->type = type;
+  return a;
+}
+
+// copy length characters into r's text.
+// whatever does not fit is cut off.
+inline void Log::add_text(Record &r, const char *chars, std::size_t length)
+{
+  Arg *a = next_arg(r, Arg::text);
+  if (a == nullptr) {
+    return;
+  }
+  std::size_t room = text_size - r.text_used;
+  if (length > room) {
+    length = room;
+  }
+  std::memcpy(r.text + r.text_used, chars, length);
+  a->t.offset = static_cast<unsigned short>(r.text_used);
+  a->t.length = static_cast<unsigned short>(length);
+  r.text_used += length;
+}
+
+inline void Log::add(Record &r, bool b)
+{
+  if (Arg *a = next_arg(r, Arg::boolean)) {
+    a->b = b;
+  }
+}
+
+inline void Log::add(Record &r, char c)
+{
+  if (Arg *a = next_arg(r, Arg::letter)) {
+    a->c = c;
+  }
+}
+
+inline void Log::add(Record &r, const char *s)
+{
+  add_text(r, s, std::strlen(s));
+}
+
+inline void Log::add(Record &r, const std::string &s)
+{
+  add_text(r, s.data(), s.size());
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value &&
+                               std::is_signed<T>::value>::type
+Log::add(Record &r, T i)
+{
+  if (Arg *a = next_arg(r, Arg::signed_int)) {
+    a->i = i;
+  }
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value &&
+                               std::is_unsigned<T>::value>::type
+Log::add(Record &r, T u)
+{
+  if (Arg *a = next_arg(r, Arg::unsigned_int)) {
+    a->u = u;
+  }
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_floating_point<T>::value>::type
+Log::add(Record &r, T d)
+{
+  if (Arg *a = next_arg(r, Arg::floating)) {
+    a->d = d;
+  }
+}
+
+// logging macros: a disabled level expands to nothing, arguments and all.
+
+#define LOG_CONCAT_(a, b) a##b
+#define LOG_CONCAT(a, b) LOG_CONCAT_(a, b)
+
+#if LOG_LEVEL <= LOG_LEVEL_TRACE
+#define LOG_TRACE(...) ::Log::write(::Log::trace, __VA_ARGS__)
+#else
+#define LOG_TRACE(...) ((void)0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) ::Log::write(::Log::debug, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void)0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...) ::Log::write(::Log::info, __VA_ARGS__)
+#else
+#define LOG_INFO(...) ((void)0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(...) ::Log::write(::Log::warn, __VA_ARGS__)
+#else
+#define LOG_WARN(...) ((void)0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) ::Log::write(::Log::error, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) ((void)0)
+#endif
+
+// indent this thread's messages until the end of the enclosing scope.
+// only trace messages are nested finely enough to need it.
+#if LOG_LEVEL <= LOG_LEVEL_TRACE
+#define LOG_INDENT() ::Log::Indent LOG_CONCAT(log_indent_, __LINE__)
+#else
+#define LOG_INDENT() ((void)0)
+#endif
+
+#endif /* LOG_H */
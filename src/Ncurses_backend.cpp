@@ -0,0 +1,68 @@
+// Ncurses_backend.cpp
+//
+// Draws on the terminal through ncurses' standard screen.
+
+#include <ncurses.h>
+
+#include "Ncurses_backend.h"
+
+// constructor:
+// starts ncurses: input unechoed and unbuffered, keypad on.
+// keys are read by the Event_loop, so ncurses never looks for them.
+Ncurses_backend::Ncurses_backend() : cursor_y(0), cursor_x(0)
+{
+  // allocate needed screen memory. usually clears screen.
+  initscr();
+  noecho();
+  // make keypresses immediately. let interrupt sequences still work.
+  cbreak();
+  // have special keys send what terminfo says they do.
+  keypad(stdscr, true);
+  typeahead(-1);
+}
+
+// ends ncurses, putting the terminal back.
+Ncurses_backend::~Ncurses_backend()
+{
+  endwin();
+}
+
+// size of the terminal, in rows and columns.
+void Ncurses_backend::size(int &rows, int &cols) const
+{
+  getmaxyx(stdscr, rows, cols);
+}
+
+// write length cells of text at row y, column x, highlighted or not.
+// highlighted cells are shown in reverse video.
+void Ncurses_backend::put(int y, int x, const char *text, int length,
+                          bool highlighted)
+{
+  if (highlighted) {
+    attron(A_REVERSE);
+  }
+  mvaddnstr(y, x, text, length);
+  if (highlighted) {
+    attroff(A_REVERSE);
+  }
+}
+
+// where flush leaves the cursor.
+void Ncurses_backend::set_cursor(int y, int x)
+{
+  cursor_y = y;
+  cursor_x = x;
+}
+
+// show everything put since the last flush, at once.
+void Ncurses_backend::flush()
+{
+  move(cursor_y, cursor_x);
+  refresh();
+}
+
+// the terminal has changed size.
+void Ncurses_backend::resize(int rows, int cols)
+{
+  resizeterm(rows, cols);
+}
@@ -0,0 +1,36 @@
+#ifndef NCURSES_BACKEND_H
+#define NCURSES_BACKEND_H
+
+// Ncurses_backend.h
+//
+// Draws on the terminal through ncurses' standard screen, for terminals
+// whose escape sequences only terminfo knows.
+
+#include "Backend.h"
+
+class Ncurses_backend : public Backend {
+  public:
+    // constructor:
+    // starts ncurses: input unechoed and unbuffered, keypad on.
+    // keys are read by the Event_loop, so ncurses never looks for them.
+    Ncurses_backend();
+
+    // ends ncurses, putting the terminal back.
+    ~Ncurses_backend() override;
+
+    Ncurses_backend(const Ncurses_backend &) = delete;
+    Ncurses_backend &operator=(const Ncurses_backend &) = delete;
+
+    void size(int &rows, int &cols) const override;
+    void put(int y, int x, const char *text, int length,
+             bool highlighted) override;
+    void set_cursor(int y, int x) override;
+    void flush() override;
+    void resize(int rows, int cols) override;
+
+  private:
+    int cursor_y;
+    int cursor_x;
+};
+
+#endif /* NCURSES_BACKEND_H */
@@ -0,0 +1,216 @@
+// Newline_scan.cpp
+//
+// Fast searches for line breaks in raw text.
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NEWLINE_SCAN_X86
+#endif
+
+#include "Newline_scan.h"
+
+namespace newline_scan {
+
+namespace {
+
+// set of functions making up one implementation.
+struct Scanner {
+  const char *name;
+  void (*find_all)(const char *, size_type, std::vector<std::uint32_t> &);
+  size_type (*find_first)(const char *, size_type);
+  size_type (*find_last)(const char *, size_type);
+};
+
+// byte-at-a-time versions, also used for the ragged ends of the
+// vectorized ones.
+
+void find_all_scalar(const char *text, size_type length,
+                     std::vector<std::uint32_t> &out)
+{
+  for (size_type i = 0; i < length; ++i) {
+    if (text[i] == '\n') {
+      out.push_back(static_cast<std::uint32_t>(i));
+    }
+  }
+}
+
+size_type find_first_scalar(const char *text, size_type length)
+{
+  const void *found = std::memchr(text, '\n', length);
+  if (found == nullptr) {
+    return length;
+  }
+  return static_cast<const char *>(found) - text;
+}
+
+size_type find_last_scalar(const char *text, size_type length)
+{
+  for (size_type i = length; i > 0; --i) {
+    if (text[i - 1] == '\n') {
+      return i - 1;
+    }
+  }
+  return std::string::npos;
+}
+
+#ifdef NEWLINE_SCAN_X86
+
+// offsets of the set bits of mask, relative to base.
+inline void push_mask(std::uint32_t mask, size_type base,
+                      std::vector<std::uint32_t> &out)
+{
+  while (mask != 0) {
+    out.push_back(static_cast<std::uint32_t>(base + __builtin_ctz(mask)));
+    mask &= mask - 1;
+  }
+}
+
+__attribute__((target("sse2")))
+void find_all_sse2(const char *text, size_type length,
+                   std::vector<std::uint32_t> &out)
+{
+  const __m128i newline = _mm_set1_epi8('\n');
+  size_type i = 0;
+  for (; i + 16 <= length; i += 16) {
+    __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + i));
+    std::uint32_t mask =
+        _mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+    push_mask(mask, i, out);
+  }
+  for (; i < length; ++i) {
+    if (text[i] == '\n') {
+      out.push_back(static_cast<std::uint32_t>(i));
+    }
+  }
+}
+
+__attribute__((target("sse2")))
+size_type find_last_sse2(const char *text, size_type length)
+{
+  const __m128i newline = _mm_set1_epi8('\n');
+  size_type i = length;
+  for (; i >= 16; i -= 16) {
+    __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + i - 16));
+    std::uint32_t mask =
+        _mm_movemask_epi8(_mm_cmpeq_epi8(block, newline));
+    if (mask != 0) {
+      return i - 16 + (31 - __builtin_clz(mask));
+    }
+  }
+  return find_last_scalar(text, i);
+}
+
+__attribute__((target("avx2")))
+void find_all_avx2(const char *text, size_type length,
+                   std::vector<std::uint32_t> &out)
+{
+  const __m256i newline = _mm256_set1_epi8('\n');
+  size_type i = 0;
+  for (; i + 64 <= length; i += 64) {
+    // two blocks per iteration: most 64-byte runs have no newline.
+    __m256i lo =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text + i));
+    __m256i hi =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text + i + 32));
+    std::uint32_t lo_mask =
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, newline));
+    std::uint32_t hi_mask =
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, newline));
+    push_mask(lo_mask, i, out);
+    push_mask(hi_mask, i + 32, out);
+  }
+  for (; i + 32 <= length; i += 32) {
+    __m256i block =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text + i));
+    push_mask(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline)),
+              i, out);
+  }
+  for (; i < length; ++i) {
+    if (text[i] == '\n') {
+      out.push_back(static_cast<std::uint32_t>(i));
+    }
+  }
+}
+
+__attribute__((target("avx2")))
+size_type find_last_avx2(const char *text, size_type length)
+{
+  const __m256i newline = _mm256_set1_epi8('\n');
+  size_type i = length;
+  for (; i >= 32; i -= 32) {
+    __m256i block =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text + i - 32));
+    std::uint32_t mask =
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline));
+    if (mask != 0) {
+      return i - 32 + (31 - __builtin_clz(mask));
+    }
+  }
+  return find_last_scalar(text, i);
+}
+
+#endif /* NEWLINE_SCAN_X86 */
+
+// best implementation this processor supports.
+Scanner choose()
+{
+#ifdef NEWLINE_SCAN_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    Scanner s = { "avx2", find_all_avx2, find_first_scalar, find_last_avx2 };
+    return s;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    Scanner s = { "sse2", find_all_sse2, find_first_scalar, find_last_sse2 };
+    return s;
+  }
+#endif /* NEWLINE_SCAN_X86 */
+  Scanner s = { "scalar", find_all_scalar, find_first_scalar,
+                find_last_scalar };
+  return s;
+}
+
+// implementation in use, chosen on first call.
+const Scanner &scanner()
+{
+  static const Scanner chosen = choose();
+  return chosen;
+}
+
+}
+
+// append the offset of every newline in text[0, length) to out.
+void find_all(const char *text, size_type length,
+              std::vector<std::uint32_t> &out)
+{
+  scanner().find_all(text, length, out);
+}
+
+// offset of the first newline in text[0, length).
+// memchr is already vectorized by the C library, so every
+// implementation uses it.
+size_type find_first(const char *text, size_type length)
+{
+  return scanner().find_first(text, length);
+}
+
+// offset of the last newline in text[0, length).
+size_type find_last(const char *text, size_type length)
+{
+  return scanner().find_last(text, length);
+}
+
+// name of the implementation in use.
+const char *implementation()
+{
+  return scanner().name;
+}
+
+}
@@ -0,0 +1,36 @@
+#ifndef NEWLINE_SCAN_H
+#define NEWLINE_SCAN_H
+
+// Newline_scan.h
+//
+// Fast searches for line breaks in raw text.
+// Uses AVX2 or SSE2 when the processor has them, chosen once at
+// runtime, and plain byte-at-a-time code otherwise.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace newline_scan {
+
+using size_type = std::string::size_type;
+
+// append the offset of every newline in text[0, length) to out.
+// length must be less than 4GiB.
+void find_all(const char *text, size_type length,
+              std::vector<std::uint32_t> &out);
+
+// offset of the first newline in text[0, length).
+// length if there is none.
+size_type find_first(const char *text, size_type length);
+
+// offset of the last newline in text[0, length).
+// std::string::npos if there is none.
+size_type find_last(const char *text, size_type length);
+
+// name of the implementation in use: "avx2", "sse2" or "scalar".
+const char *implementation();
+
+}
+
+#endif /* NEWLINE_SCAN_H */
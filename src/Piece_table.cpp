@@ -0,0 +1,895 @@
+// Piece_table.cpp
+//
+// Stores the text of a Buffer as a sequence of pieces.
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <memory>
+#include <new>
+#include <utility>
+
+#include "Piece_table.h"
+#include "Newline_scan.h"
+
+// node of the piece tree.
+// a treap: ordered by text position, heap-ordered by priority.
+// shared by every tree it is part of, and never changed while shared.
+struct Piece_table::Node {
+  Node(const Piece &p, unsigned prio) :
+    piece(p), priority(prio), length(p.length), newlines(p.newlines),
+    refs(1)
+  {
+    // empty
+  }
+
+  Piece piece;
+  unsigned priority;
+
+  // total number of characters in this subtree.
+  size_type length;
+
+  // total number of newlines in this subtree.
+  size_type newlines;
+
+  Node_ref left;
+  Node_ref right;
+
+  // references to this node: from its parents, the table's root and
+  // Snapshots. only a Snapshot's may be dropped on another thread.
+  std::atomic<unsigned> refs;
+};
+
+namespace {
+
+// total number of characters under the given node.
+template <typename Ptr>
+inline Piece_table::size_type subtree_length(const Ptr &t)
+{
+  return t ? t->length : 0;
+}
+
+// total number of newlines under the given node.
+template <typename Ptr>
+inline Piece_table::size_type subtree_newlines(const Ptr &t)
+{
+  return t ? t->newlines : 0;
+}
+
+// recompute the totals of t from its piece and children.
+template <typename Ptr>
+inline void update(const Ptr &t)
+{
+  t->length = subtree_length(t->left) + t->piece.length +
+              subtree_length(t->right);
+  t->newlines = subtree_newlines(t->left) + t->piece.newlines +
+                subtree_newlines(t->right);
+}
+
+}
+
+const Piece_table::size_type Piece_table::npos;
+const Piece_table::size_type Piece_table::add_chunk_size;
+
+// constructor:
+// empty text, allocating from the given arena.
+Piece_table::Piece_table(Arena &arena_) : Piece_table(File_map(), arena_)
+{
+  // empty
+}
+
+// constructor:
+// takes ownership of the original text.
+// the text is used in place, never copied.
+// allocates from the given arena, which must outlive the table.
+Piece_table::Piece_table(File_map original_, Arena &arena_) :
+  original(std::move(original_)),
+  original_lines(original.data(), original.size()),
+  arena(arena_),
+  add_chunks(Arena_allocator<Add_chunk>(&arena_)),
+  add_lines(Arena_allocator<size_type>(&arena_)),
+  lines_counted(false),
+  has_orphans(false),
+  seed(2463534242u)
+{
+  if (original.size() > 0) {
+    // newlines are counted later, once the index is done.
+    Piece whole = { Source::original, 0, original.size(), 0 };
+    root = make_node(whole);
+  }
+  if (original_lines.ready()) {
+    count_lines();
+  }
+}
+
+// every Snapshot must be gone by now.
+Piece_table::~Piece_table()
+{
+  free_orphans();
+}
+
+// number of characters in the text.
+Piece_table::size_type Piece_table::size() const
+{
+  return subtree_length(root);
+}
+
+// character at the given position.
+char Piece_table::at(size_type pos) const
+{
+  size_type length;
+  return *span_at(pos, length);
+}
+
+// insert count characters from text before position pos.
+void Piece_table::insert(size_type pos, const char *text, size_type count)
+{
+  if (count == 0) {
+    return;
+  }
+  free_orphans();
+  Node_ref l, r;
+  split(std::move(root), pos, l, r);
+
+  size_type added_lines = add_lines.size();
+  size_type start = append_text(text, count);
+  size_type newlines = add_lines.size() - added_lines;
+
+  // typing extends the piece that was last appended to
+  // rather than adding a node per character.
+  const Node *last = l.get();
+  while (last != nullptr && last->right) {
+    last = last->right.get();
+  }
+  if (last != nullptr &&
+      last->piece.source == Source::add &&
+      last->piece.start + last->piece.length == start) {
+    Node *t = nullptr;
+    for (Node_ref *ref = &l; *ref; ref = &t->right) {
+      t = own(*ref);
+      t->length += count;
+      t->newlines += newlines;
+    }
+    t->piece.length += count;
+    t->piece.newlines += newlines;
+  } else {
+    Piece p = { Source::add, start, count, newlines };
+    l = merge(std::move(l), make_node(p));
+  }
+  root = merge(std::move(l), std::move(r));
+}
+
+// insert pieces previously erased, in order, before position pos.
+// their newlines are recounted, in case the tree's counts were not
+// valid when they were erased.
+void Piece_table::insert(size_type pos, const Piece_list &pieces)
+{
+  if (pieces.empty()) {
+    return;
+  }
+  free_orphans();
+  Node_ref l, r;
+  split(std::move(root), pos, l, r);
+  for (Piece p : pieces) {
+    p.newlines = lines_counted ? count_newlines(p, p.length) : 0;
+    l = merge(std::move(l), make_node(p));
+  }
+  root = merge(std::move(l), std::move(r));
+}
+
+// erase count characters starting at position pos.
+// if removed is not null, the erased pieces are appended to it.
+void Piece_table::erase(size_type pos, size_type count,
+                        Piece_list *removed /* = nullptr */)
+{
+  if (count == 0) {
+    return;
+  }
+  free_orphans();
+  Node_ref l, m, r;
+  split(std::move(root), pos, l, r);
+  split(std::move(r), count, m, r);
+  if (removed != nullptr) {
+    collect(m.get(), *removed);
+  }
+  // m and its nodes are dropped here; the text they refer to stays.
+  root = merge(std::move(l), std::move(r));
+}
+
+// replace each of ranges, which are in order and do not overlap, by
+// its part of with[0, with_count), all as one edit.
+// if removed is not null, the pieces of the text from the start of the
+// first range to the end of the last are appended to it.
+// the new text is added once, however many ranges use it, and the
+// span from the first range to the last is rebuilt in one pass: the
+// text between ranges is cut from the old pieces, not copied.
+void Piece_table::replace_all(const std::vector<Replacement> &ranges,
+                              const char *with, size_type with_count,
+                              Piece_list *removed /* = nullptr */)
+{
+  if (ranges.empty()) {
+    return;
+  }
+  free_orphans();
+  auto first = ranges.front().start;
+  auto last = ranges.back().start + ranges.back().length;
+  Node_ref l, m, r;
+  split(std::move(root), first, l, r);
+  split(std::move(r), last - first, m, r);
+  Piece_list old{ Arena_allocator<Piece>(&arena) };
+  collect(m.get(), old);
+  m.reset();
+  size_type added = with_count > 0 ? append_text(with, with_count) : 0;
+
+  auto add_piece = [this, &l](Piece p) {
+    if (p.length == 0) {
+      return;
+    }
+    p.newlines = lines_counted || p.source == Source::add ?
+                 count_newlines(p, p.length) : 0;
+    l = merge(std::move(l), make_node(p));
+  };
+  // walk the old pieces, keeping the text between ranges.
+  size_type piece = 0;
+  size_type offset = 0;
+  auto advance = [&](size_type count, bool keep) {
+    while (count > 0) {
+      Piece p = old[piece];
+      auto length = std::min(p.length - offset, count);
+      if (keep) {
+        p.start += offset;
+        p.length = length;
+        add_piece(p);
+      }
+      offset += length;
+      count -= length;
+      if (offset == old[piece].length) {
+        ++piece;
+        offset = 0;
+      }
+    }
+  };
+  size_type pos = first;
+  for (auto &range : ranges) {
+    advance(range.start - pos, true);
+    advance(range.length, false);
+    Piece p = { Source::add, added + range.with_start, range.with_length, 0 };
+    add_piece(p);
+    pos = range.start + range.length;
+  }
+  if (removed != nullptr) {
+    removed->insert(removed->end(), old.begin(), old.end());
+  }
+  root = merge(std::move(l), std::move(r));
+}
+
+// append characters [pos, pos + count) to out.
+void Piece_table::copy(size_type pos, size_type count, std::string &out) const
+{
+  while (count > 0) {
+    size_type length;
+    const char *run = span_at(pos, length);
+    if (length > count) {
+      length = count;
+    }
+    out.append(run, length);
+    pos += length;
+    count -= length;
+  }
+}
+
+// contiguous run of characters starting at pos.
+const char *Piece_table::span_at(size_type pos, size_type &length) const
+{
+  const Node *t = find(root.get(), pos);
+  if (t == nullptr) {
+    length = 0;
+    return nullptr;
+  }
+  length = t->piece.length - pos;
+  return data(t->piece) + pos;
+}
+
+// contiguous run of characters ending just before pos.
+const char *Piece_table::span_before(size_type pos, size_type &length) const
+{
+  const Node *t = find_before(root.get(), pos);
+  length = t == nullptr ? 0 : pos;
+  return t == nullptr ? nullptr : data(t->piece);
+}
+
+// the text as it is now, for reading on any thread while this table
+// goes on being edited.
+// the snapshot shares the tree; the next edit copies the nodes it
+// changes rather than changing them. the characters pieces point to
+// stay put and unchanged anyway: the original buffer is never
+// modified, and the add buffer's chunks are only appended to.
+Piece_table::Snapshot Piece_table::snapshot() const
+{
+  Snapshot s;
+  s.table = this;
+  s.original = original.data();
+  s.chunks.assign(add_chunks.begin(), add_chunks.end());
+  s.root = root.get();
+  if (s.root != nullptr) {
+    s.root->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+  return s;
+}
+
+// position of first newline at or after pos.
+// runs of original text are looked up in the line index once it is
+// ready; anything else is scanned.
+Piece_table::size_type Piece_table::find_newline(size_type pos) const
+{
+  size_type total = size();
+  while (pos < total) {
+    size_type length;
+    const char *run = span_at(pos, length);
+    size_type found;
+    if (in_original(run) &&
+        original_lines.next_newline(run - original.data(), found)) {
+      found -= run - original.data();
+    } else {
+      found = newline_scan::find_first(run, length);
+    }
+    if (found < length) {
+      return pos + found;
+    }
+    pos += length;
+  }
+  return total;
+}
+
+// position of last newline before pos.
+// runs of original text are looked up in the line index once it is
+// ready; anything else is scanned.
+Piece_table::size_type Piece_table::rfind_newline(size_type pos) const
+{
+  while (pos > 0) {
+    size_type length;
+    const char *run = span_before(pos, length);
+    size_type found;
+    if (in_original(run) &&
+        original_lines.prev_newline(run - original.data() + length, found)) {
+      if (found != npos &&
+          found >= static_cast<size_type>(run - original.data())) {
+        return pos - length + (found - (run - original.data()));
+      }
+    } else {
+      found = newline_scan::find_last(run, length);
+      if (found != npos) {
+        return pos - length + found;
+      }
+    }
+    pos -= length;
+  }
+  return npos;
+}
+
+// number of lines in the text (newlines + 1).
+Piece_table::size_type Piece_table::line_count() const
+{
+  count_lines();
+  return subtree_newlines(root) + 1;
+}
+
+// line number (from 0) of the line containing pos.
+// counts the newlines before pos on the way down the tree.
+Piece_table::size_type Piece_table::line_of(size_type pos) const
+{
+  count_lines();
+  size_type line_num = 0;
+  const Node *t = root.get();
+  while (t != nullptr) {
+    size_type left_len = subtree_length(t->left);
+    if (pos < left_len) {
+      t = t->left.get();
+    } else if (pos < left_len + t->piece.length) {
+      line_num += subtree_newlines(t->left);
+      return line_num + count_newlines(t->piece, pos - left_len);
+    } else {
+      line_num += subtree_newlines(t->left) + t->piece.newlines;
+      pos -= left_len + t->piece.length;
+      t = t->right.get();
+    }
+  }
+  return line_num;
+}
+
+// position of the first character of line number line_num.
+// that is, just after newline number line_num (from 1).
+Piece_table::size_type Piece_table::line_offset(size_type line_num) const
+{
+  if (line_num == 0) {
+    return 0;
+  }
+  count_lines();
+  size_type pos = 0;
+  const Node *t = root.get();
+  while (t != nullptr) {
+    size_type left_lines = subtree_newlines(t->left);
+    if (line_num <= left_lines) {
+      t = t->left.get();
+    } else if (line_num <= left_lines + t->piece.newlines) {
+      pos += subtree_length(t->left);
+      return pos + nth_newline(t->piece, line_num - left_lines - 1) + 1;
+    } else {
+      line_num -= left_lines + t->piece.newlines;
+      pos += subtree_length(t->left) + t->piece.length;
+      t = t->right.get();
+    }
+  }
+  return size();
+}
+
+// node of tree t holding the character at pos, if any, with pos made
+// an offset into its piece.
+const Piece_table::Node *Piece_table::find(const Node *t, size_type &pos)
+{
+  while (t != nullptr) {
+    size_type left_len = subtree_length(t->left);
+    if (pos < left_len) {
+      t = t->left.get();
+    } else if (pos < left_len + t->piece.length) {
+      pos -= left_len;
+      return t;
+    } else {
+      pos -= left_len + t->piece.length;
+      t = t->right.get();
+    }
+  }
+  return nullptr;
+}
+
+// node of tree t holding the character just before pos, if any, with
+// pos made the length of its piece up to there.
+const Piece_table::Node *Piece_table::find_before(const Node *t,
+                                                  size_type &pos)
+{
+  while (t != nullptr) {
+    size_type left_len = subtree_length(t->left);
+    if (pos <= left_len) {
+      t = t->left.get();
+    } else if (pos <= left_len + t->piece.length) {
+      pos -= left_len;
+      return t;
+    } else {
+      pos -= left_len + t->piece.length;
+      t = t->right.get();
+    }
+  }
+  return nullptr;
+}
+
+// split tree t into the first pos characters and the rest.
+// nodes shared with a Snapshot are copied on the way down.
+void Piece_table::split(Node_ref t, size_type pos, Node_ref &l, Node_ref &r)
+{
+  if (!t) {
+    l.reset();
+    r.reset();
+    return;
+  }
+  own(t);
+  size_type left_len = subtree_length(t->left);
+  if (pos <= left_len) {
+    split(std::move(t->left), pos, l, t->left);
+    update(t);
+    r = std::move(t);
+  } else if (pos >= left_len + t->piece.length) {
+    split(std::move(t->right), pos - left_len - t->piece.length,
+          t->right, r);
+    update(t);
+    l = std::move(t);
+  } else {
+    // cut the piece: head stays in t, tail gets a node of its own.
+    size_type inner = pos - left_len;
+    size_type head_lines =
+        lines_counted ? count_newlines(t->piece, inner) : 0;
+    Piece tail = t->piece;
+    tail.start += inner;
+    tail.length -= inner;
+    tail.newlines -= head_lines;
+    t->piece.length = inner;
+    t->piece.newlines = head_lines;
+    Node_ref right = std::move(t->right);
+    update(t);
+    l = std::move(t);
+    r = merge(make_node(tail), std::move(right));
+  }
+}
+
+// join two trees, all of a's text preceding all of b's.
+// nodes shared with a Snapshot are copied on the way down.
+Piece_table::Node_ref Piece_table::merge(Node_ref a, Node_ref b)
+{
+  if (!a) {
+    return b;
+  }
+  if (!b) {
+    return a;
+  }
+  if (a->priority > b->priority) {
+    own(a);
+    a->right = merge(std::move(a->right), std::move(b));
+    update(a);
+    return a;
+  } else {
+    own(b);
+    b->left = merge(std::move(a), std::move(b->left));
+    update(b);
+    return b;
+  }
+}
+
+// append the pieces of tree t to out, in order.
+void Piece_table::collect(const Node *t, Piece_list &out)
+{
+  while (t != nullptr) {
+    collect(t->left.get(), out);
+    out.push_back(t->piece);
+    t = t->right.get();
+  }
+}
+
+// newlines in the first count characters of p.
+Piece_table::size_type
+Piece_table::count_newlines(const Piece &p, size_type count) const
+{
+  if (p.source == Source::original) {
+    return original_lines.rank(p.start + count) -
+           original_lines.rank(p.start);
+  }
+  auto first = std::lower_bound(begin(add_lines), end(add_lines), p.start);
+  auto last = std::lower_bound(first, end(add_lines), p.start + count);
+  return last - first;
+}
+
+// offset within p of its newline number k (from 0).
+Piece_table::size_type
+Piece_table::nth_newline(const Piece &p, size_type k) const
+{
+  if (p.source == Source::original) {
+    return original_lines.nth(original_lines.rank(p.start) + k) - p.start;
+  }
+  auto first = std::lower_bound(begin(add_lines), end(add_lines), p.start);
+  return first[k] - p.start;
+}
+
+// fill in newline counts for the whole tree.
+void Piece_table::count_lines() const
+{
+  if (lines_counted) {
+    return;
+  }
+  original_lines.wait();
+  lines_counted = true;
+  count_lines(root);
+}
+
+// recount the newlines of t and everything under it.
+// nodes shared with a Snapshot are copied, leaving it its own counts.
+void Piece_table::count_lines(Node_ref &t) const
+{
+  if (!t) {
+    return;
+  }
+  Node *node = const_cast<Piece_table *>(this)->own(t);
+  count_lines(node->left);
+  count_lines(node->right);
+  node->piece.newlines = count_newlines(node->piece, node->piece.length);
+  update(node);
+}
+
+// first character of the given piece.
+const char *Piece_table::data(const Piece &p) const
+{
+  if (p.source == Source::original) {
+    return original.data() + p.start;
+  }
+  return add_data(add_chunks.data(), add_chunks.data() + add_chunks.size(),
+                  p.start);
+}
+
+// new tree node holding p, from the arena.
+Piece_table::Node_ref Piece_table::make_node(const Piece &p)
+{
+  void *memory = arena.allocate(sizeof(Node), alignof(Node));
+  return Node_ref(new (memory) Node(p, next_priority()), &arena);
+}
+
+// make t the only reference to its node, copying the node if it is
+// shared, so that it can be changed. returns the node.
+// the copy shares the children, so they become shared in turn.
+Piece_table::Node *Piece_table::own(Node_ref &t)
+{
+  if (t->refs.load(std::memory_order_acquire) > 1) {
+    void *memory = arena.allocate(sizeof(Node), alignof(Node));
+    Node *copy = new (memory) Node(t->piece, t->priority);
+    copy->length = t->length;
+    copy->newlines = t->newlines;
+    copy->left = t->left;
+    copy->right = t->right;
+    t = Node_ref(copy, &arena);
+  }
+  return t.get();
+}
+
+// free the nodes whose last reference was dropped by a Snapshot,
+// which may have been on another thread. only the table's own thread
+// touches the arena.
+void Piece_table::free_orphans()
+{
+  if (!has_orphans.load(std::memory_order_acquire)) {
+    return;
+  }
+  std::vector<Node *> dead;
+  {
+    std::lock_guard<std::mutex> guard(orphan_lock);
+    dead.swap(orphans);
+    has_orphans.store(false, std::memory_order_relaxed);
+  }
+  for (Node *t : dead) {
+    // the reference the Snapshot gave up, given back to be dropped.
+    t->refs.store(1, std::memory_order_relaxed);
+    Node_ref(t, &arena).reset();
+  }
+}
+
+// hand a node whose last reference was just dropped to the owner's
+// thread to free. any thread may call it.
+void Piece_table::orphan(Node *t) const
+{
+  std::lock_guard<std::mutex> guard(orphan_lock);
+  orphans.push_back(t);
+  has_orphans.store(true, std::memory_order_release);
+}
+
+// copy count characters onto the end of the add buffer.
+// returns the position of the first one.
+// text that does not fit in the last chunk starts a new one, big enough
+// for all of it, so that it stays in one piece.
+Piece_table::size_type Piece_table::append_add(const char *text,
+                                               size_type count)
+{
+  if (add_chunks.empty() ||
+      add_chunks.back().capacity - add_chunks.back().used < count) {
+    Add_chunk chunk;
+    chunk.capacity = std::max(add_chunk_size, count);
+    chunk.data = static_cast<char *>(arena.allocate(chunk.capacity, 1));
+    chunk.start = add_chunks.empty() ?
+                  0 :
+                  add_chunks.back().start + add_chunks.back().capacity + 1;
+    chunk.used = 0;
+    add_chunks.push_back(chunk);
+  }
+  Add_chunk &chunk = add_chunks.back();
+  std::memcpy(chunk.data + chunk.used, text, count);
+  size_type pos = chunk.start + chunk.used;
+  chunk.used += count;
+  return pos;
+}
+
+// append_add, noting where the newlines land.
+Piece_table::size_type Piece_table::append_text(const char *text,
+                                                size_type count)
+{
+  size_type start = append_add(text, count);
+  for (size_type i = newline_scan::find_first(text, count); i < count;
+       i += 1 + newline_scan::find_first(text + i + 1, count - i - 1)) {
+    add_lines.push_back(start + i);
+  }
+  return start;
+}
+
+// character at position pos of the add buffer, whose chunks are
+// [first, last).
+// edits mostly touch the newest chunk, so it is tried first.
+const char *Piece_table::add_data(const Add_chunk *first,
+                                  const Add_chunk *last, size_type pos)
+{
+  const Add_chunk *chunk = last - 1;
+  if (pos < chunk->start) {
+    chunk = std::upper_bound(
+        first, last, pos,
+        [](size_type p, const Add_chunk &c) { return p < c.start; }) - 1;
+  }
+  return chunk->data + (pos - chunk->start);
+}
+
+// if run points into the original buffer.
+bool Piece_table::in_original(const char *run) const
+{
+  return run >= original.data() && run < original.data() + original.size();
+}
+
+// priority for a new tree node.
+// xorshift: cheap, and good enough to keep the tree balanced.
+unsigned Piece_table::next_priority()
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+Piece_table::Node_ref::Node_ref() : node(nullptr), arena(nullptr)
+{
+  // empty
+}
+
+// constructor:
+// takes over a reference already counted in node_'s refs.
+Piece_table::Node_ref::Node_ref(Node *node_, Arena *arena_) :
+  node(node_), arena(arena_)
+{
+  // empty
+}
+
+Piece_table::Node_ref::Node_ref(const Node_ref &other) :
+  node(other.node), arena(other.arena)
+{
+  if (node != nullptr) {
+    node->refs.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+Piece_table::Node_ref::Node_ref(Node_ref &&other) :
+  node(other.node), arena(other.arena)
+{
+  other.node = nullptr;
+}
+
+Piece_table::Node_ref &Piece_table::Node_ref::operator=(Node_ref other)
+{
+  std::swap(node, other.node);
+  std::swap(arena, other.arena);
+  return *this;
+}
+
+Piece_table::Node_ref::~Node_ref()
+{
+  reset();
+}
+
+Piece_table::Node *Piece_table::Node_ref::get() const
+{
+  return node;
+}
+
+Piece_table::Node *Piece_table::Node_ref::operator->() const
+{
+  return node;
+}
+
+Piece_table::Node_ref::operator bool() const
+{
+  return node != nullptr;
+}
+
+// drop the reference.
+// the last one destroys the node, dropping its children in turn, and
+// hands its memory back to the arena.
+void Piece_table::Node_ref::reset()
+{
+  if (node != nullptr &&
+      node->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    node->~Node();
+    arena->recycle(node, sizeof(Node));
+  }
+  node = nullptr;
+}
+
+// default constructor:
+// an empty text.
+Piece_table::Snapshot::Snapshot() :
+  table(nullptr), original(nullptr), root(nullptr)
+{
+  // empty
+}
+
+Piece_table::Snapshot::Snapshot(Snapshot &&other) :
+  table(other.table), original(other.original),
+  chunks(std::move(other.chunks)), root(other.root)
+{
+  other.root = nullptr;
+}
+
+Piece_table::Snapshot &Piece_table::Snapshot::operator=(Snapshot &&other)
+{
+  if (this != &other) {
+    release();
+    table = other.table;
+    original = other.original;
+    chunks = std::move(other.chunks);
+    root = other.root;
+    other.root = nullptr;
+  }
+  return *this;
+}
+
+Piece_table::Snapshot::~Snapshot()
+{
+  release();
+}
+
+// number of characters in the text.
+Piece_table::size_type Piece_table::Snapshot::size() const
+{
+  return subtree_length(root);
+}
+
+// character at the given position.
+char Piece_table::Snapshot::at(size_type pos) const
+{
+  size_type length;
+  return *span_at(pos, length);
+}
+
+// append characters [pos, pos + count) to out.
+void Piece_table::Snapshot::copy(size_type pos, size_type count,
+                                 std::string &out) const
+{
+  while (count > 0) {
+    size_type length;
+    const char *run = span_at(pos, length);
+    if (length > count) {
+      length = count;
+    }
+    out.append(run, length);
+    pos += length;
+    count -= length;
+  }
+}
+
+// contiguous run of characters starting at pos.
+const char *Piece_table::Snapshot::span_at(size_type pos,
+                                           size_type &length) const
+{
+  const Node *t = find(root, pos);
+  if (t == nullptr) {
+    length = 0;
+    return nullptr;
+  }
+  length = t->piece.length - pos;
+  return data(t->piece) + pos;
+}
+
+// append the whole text to out as runs, in order.
+void Piece_table::Snapshot::runs(std::vector<Run> &out) const
+{
+  collect(root, out);
+}
+
+// append the runs of tree t to out, in order.
+void Piece_table::Snapshot::collect(const Node *t,
+                                    std::vector<Run> &out) const
+{
+  while (t != nullptr) {
+    collect(t->left.get(), out);
+    Run run = { data(t->piece), t->piece.length };
+    out.push_back(run);
+    t = t->right.get();
+  }
+}
+
+// first character of the given piece.
+const char *Piece_table::Snapshot::data(const Piece &p) const
+{
+  if (p.source == Source::original) {
+    return original + p.start;
+  }
+  return add_data(chunks.data(), chunks.data() + chunks.size(), p.start);
+}
+
+// drop the reference to the tree.
+// the table frees the nodes, on its own thread, if this was the last.
+void Piece_table::Snapshot::release()
+{
+  if (root != nullptr &&
+      root->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    table->orphan(root);
+  }
+  root = nullptr;
+}
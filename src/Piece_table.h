@@ -0,0 +1,368 @@
+#ifndef PIECE_TABLE_H
+#define PIECE_TABLE_H
+
+// Piece_table.h
+//
+// Stores the text of a Buffer as a sequence of pieces.
+// Each piece refers to a run of characters in either the read-only
+// original buffer (the file as it was loaded) or the append-only add
+// buffer (everything typed since). Pieces are kept in a balanced tree
+// ordered by position in the text, so edits never move the text itself.
+// Each tree node also counts the newlines beneath it, which turns
+// line number <-> position lookups into a walk down the tree.
+// Tree nodes and the add buffer are allocated from the owner's Arena.
+// Neither buffer's text ever changes, so a piece stays valid after it
+// is erased, and can be put back later without copying its text.
+// Tree nodes are reference counted and copied before they are changed
+// if anything else shares them, so a Snapshot of the text costs one
+// reference, and edits after it copy only the O(log n) nodes they touch.
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <memory>
+#include <vector>
+
+#include "Arena.h"
+#include "File_map.h"
+#include "Line_index.h"
+
+class Piece_table {
+  public:
+    using size_type = std::string::size_type;
+
+    // returned by searches that find nothing.
+    static const size_type npos = std::string::npos;
+
+    // which buffer a piece refers to.
+    enum class Source { original, add };
+
+    // run of characters in one of the buffers.
+    struct Piece {
+      Source source;
+      size_type start;
+      size_type length;
+      size_type newlines;
+    };
+
+    // pieces taken out of the text, in order.
+    using Piece_list = std::vector<Piece, Arena_allocator<Piece>>;
+
+    // one of the ranges replace_all replaces: length characters at
+    // start, by with_length characters of the new text from with_start.
+    struct Replacement {
+      size_type start;
+      size_type length;
+      size_type with_start;
+      size_type with_length;
+    };
+
+    // contiguous characters of the text.
+    struct Run {
+      const char *data;
+      size_type length;
+    };
+
+    // the text as it was at one moment, unchanged by later edits.
+    class Snapshot;
+
+    // constructor:
+    // empty text, allocating from the given arena.
+    explicit Piece_table(Arena &arena_);
+
+    // constructor:
+    // takes ownership of the original text.
+    // the text is used in place, never copied.
+    // allocates from the given arena, which must outlive the table.
+    Piece_table(File_map original_, Arena &arena_);
+
+    ~Piece_table();
+
+    Piece_table(const Piece_table &) = delete;
+    Piece_table &operator=(const Piece_table &) = delete;
+
+    // number of characters in the text.
+    size_type size() const;
+
+    // character at the given position.
+    // pos must be less than size().
+    char at(size_type pos) const;
+
+    // insert count characters from text before position pos.
+    void insert(size_type pos, const char *text, size_type count);
+
+    // insert pieces previously erased, in order, before position pos.
+    void insert(size_type pos, const Piece_list &pieces);
+
+    // erase count characters starting at position pos.
+    // if removed is not null, the erased pieces are appended to it.
+    void erase(size_type pos, size_type count,
+               Piece_list *removed = nullptr);
+
+    // replace each of ranges, which are in order and do not overlap,
+    // by its part of with[0, with_count), all as one edit.
+    // if removed is not null, the pieces of the text from the start of
+    // the first range to the end of the last are appended to it.
+    void replace_all(const std::vector<Replacement> &ranges,
+                     const char *with, size_type with_count,
+                     Piece_list *removed = nullptr);
+
+    // append characters [pos, pos + count) to out.
+    void copy(size_type pos, size_type count, std::string &out) const;
+
+    // contiguous run of characters starting at pos.
+    // length is set to the number of characters in the run.
+    // pos must be less than size().
+    const char *span_at(size_type pos, size_type &length) const;
+
+    // contiguous run of characters ending just before pos.
+    // returns the start of the run; length is set to its size.
+    // pos must be greater than 0.
+    const char *span_before(size_type pos, size_type &length) const;
+
+    // the text as it is now, for reading on any thread while this
+    // table goes on being edited.
+    // O(number of add buffer chunks): no text or tree is copied.
+    Snapshot snapshot() const;
+
+    // position of first newline at or after pos.
+    // size() if there is none.
+    size_type find_newline(size_type pos) const;
+
+    // position of last newline before pos.
+    // npos if there is none.
+    size_type rfind_newline(size_type pos) const;
+
+    // number of lines in the text (newlines + 1).
+    // O(log n), but the first line query waits for the original
+    // buffer to finish indexing.
+    size_type line_count() const;
+
+    // line number (from 0) of the line containing pos.
+    size_type line_of(size_type pos) const;
+
+    // position of the first character of line number line_num.
+    // size() if there is no such line.
+    size_type line_offset(size_type line_num) const;
+
+    // where this table allocates.
+    Arena &memory() const;
+
+    // if the file the original text is mapped from was cut short on
+    // disk, and part of it has read as zeros.
+    bool original_changed() const;
+
+  private:
+    struct Node;
+
+    // counted reference to a tree node.
+    // the node goes back to the arena with its last reference.
+    class Node_ref {
+      public:
+        Node_ref();
+        Node_ref(Node *node_, Arena *arena_);
+        Node_ref(const Node_ref &other);
+        Node_ref(Node_ref &&other);
+        Node_ref &operator=(Node_ref other);
+        ~Node_ref();
+
+        Node *get() const;
+        Node *operator->() const;
+        explicit operator bool() const;
+
+        // drop the reference.
+        void reset();
+
+      private:
+        Node *node;
+        Arena *arena;
+    };
+
+    // run of the add buffer.
+    // chunks never move or grow once made, so the text in them stays
+    // put while more is added.
+    struct Add_chunk {
+      char *data;
+      // position of data[0] in the add buffer.
+      size_type start;
+      size_type capacity;
+      size_type used;
+    };
+
+    // new tree node holding p, from the arena.
+    Node_ref make_node(const Piece &p);
+
+    // make t the only reference to its node, copying the node if it
+    // is shared, so that it can be changed. returns the node.
+    Node *own(Node_ref &t);
+
+    // free the nodes whose last reference was dropped by a Snapshot,
+    // which may have been on another thread.
+    void free_orphans();
+
+    // hand a node whose last reference was just dropped to the owner's
+    // thread to free. any thread may call it.
+    void orphan(Node *t) const;
+
+    // copy count characters onto the end of the add buffer.
+    // returns the position of the first one.
+    size_type append_add(const char *text, size_type count);
+
+    // append_add, noting where the newlines land.
+    size_type append_text(const char *text, size_type count);
+
+    // character at position pos of the add buffer, whose chunks are
+    // [first, last).
+    static const char *add_data(const Add_chunk *first,
+                                const Add_chunk *last, size_type pos);
+
+    // node of tree t holding the character at pos, if any, with pos
+    // made an offset into its piece.
+    static const Node *find(const Node *t, size_type &pos);
+
+    // node of tree t holding the character just before pos, if any,
+    // with pos made the length of its piece up to there.
+    static const Node *find_before(const Node *t, size_type &pos);
+
+    // split tree t into the first pos characters and the rest.
+    // a piece straddling pos is cut in two.
+    void split(Node_ref t, size_type pos, Node_ref &l, Node_ref &r);
+
+    // join two trees, all of a's text preceding all of b's.
+    Node_ref merge(Node_ref a, Node_ref b);
+
+    // append the pieces of tree t to out, in order.
+    static void collect(const Node *t, Piece_list &out);
+
+    // newlines in the first count characters of p.
+    size_type count_newlines(const Piece &p, size_type count) const;
+
+    // offset within p of its newline number k (from 0).
+    size_type nth_newline(const Piece &p, size_type k) const;
+
+    // fill in newline counts for the whole tree.
+    // done once, when the original buffer's index is first needed.
+    void count_lines() const;
+
+    // recount the newlines of t and everything under it.
+    void count_lines(Node_ref &t) const;
+
+    // first character of the given piece.
+    const char *data(const Piece &p) const;
+
+    // if run points into the original buffer.
+    bool in_original(const char *run) const;
+
+    // priority for a new tree node.
+    unsigned next_priority();
+
+    // text as loaded. never modified.
+    File_map original;
+
+    // newlines in the original buffer, built in the background.
+    Line_index original_lines;
+
+    // where nodes and added text are allocated.
+    Arena &arena;
+
+    // text added by edits, in chunks. only ever appended to.
+    // positions run on from one chunk to the next, with a gap between
+    // so that no piece can span two chunks.
+    std::vector<Add_chunk, Arena_allocator<Add_chunk>> add_chunks;
+
+    // positions of the newlines in the add buffer.
+    std::vector<size_type, Arena_allocator<size_type>> add_lines;
+
+    // smallest chunk of the add buffer.
+    static const size_type add_chunk_size = 64 << 10;
+
+    // if the tree's newline counts are valid.
+    // until then edits leave them alone, so that editing never
+    // waits for the original buffer to be indexed.
+    mutable bool lines_counted;
+
+    // root of the piece tree.
+    // counting the lines may copy nodes shared with a Snapshot.
+    mutable Node_ref root;
+
+    // nodes let go of by Snapshots, for the owner to free.
+    mutable std::mutex orphan_lock;
+    mutable std::vector<Node *> orphans;
+    mutable std::atomic<bool> has_orphans;
+
+    // state of the priority generator.
+    unsigned seed;
+};
+
+// the text as it was at one moment, unchanged by later edits.
+// can be read from any thread, without locking, while the table goes
+// on being edited. must be destroyed before the table.
+class Piece_table::Snapshot {
+  public:
+    // default constructor:
+    // an empty text.
+    Snapshot();
+
+    Snapshot(Snapshot &&other);
+    Snapshot &operator=(Snapshot &&other);
+    ~Snapshot();
+
+    Snapshot(const Snapshot &) = delete;
+    Snapshot &operator=(const Snapshot &) = delete;
+
+    // number of characters in the text.
+    size_type size() const;
+
+    // character at the given position.
+    // pos must be less than size().
+    char at(size_type pos) const;
+
+    // append characters [pos, pos + count) to out.
+    void copy(size_type pos, size_type count, std::string &out) const;
+
+    // contiguous run of characters starting at pos.
+    // length is set to the number of characters in the run.
+    // pos must be less than size().
+    const char *span_at(size_type pos, size_type &length) const;
+
+    // append the whole text to out as runs, in order.
+    void runs(std::vector<Run> &out) const;
+
+  private:
+    friend class Piece_table;
+
+    // append the runs of tree t to out, in order.
+    void collect(const Node *t, std::vector<Run> &out) const;
+
+    // first character of the given piece.
+    const char *data(const Piece &p) const;
+
+    // drop the reference to the tree.
+    void release();
+
+    // table taken from, its original text, and its add buffer's
+    // chunks as they were.
+    const Piece_table *table;
+    const char *original;
+    std::vector<Add_chunk> chunks;
+
+    // root of the tree as it was, with a reference of its own.
+    Node *root;
+};
+
+// inline function definitions
+
+// where this table allocates.
+inline Arena &Piece_table::memory() const
+{
+  return arena;
+}
+
+// if the file the original text is mapped from was cut short on
+// disk, and part of it has read as zeros.
+inline bool Piece_table::original_changed() const
+{
+  return original.changed();
+}
+
+#endif /* PIECE_TABLE_H */
@@ -0,0 +1,742 @@
+// Regex.cpp
+//
+// Regular expressions, matched with DFAs that are built lazily.
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Regex.h"
+#include "Log.h"
+
+// parsed pattern.
+struct Regex::Node {
+  enum Kind {
+    set,          // a byte in sets[arg]
+    concatenate,  // children one after another
+    alternate,    // any one of children
+    repeat,       // children[0], from min to max times; max < 0: no limit
+    line_begin,   // ^
+    line_end,     // $
+    empty         // nothing
+  };
+
+  explicit Node(int kind_) : kind(kind_), arg(0), min(0), max(0)
+  {
+    // empty
+  }
+
+  int kind;
+  int arg;
+  int min;
+  int max;
+  std::vector<const Node *> children;
+};
+
+const int Regex::max_repeat;
+const std::size_t Regex::max_insts;
+const std::size_t Regex::Matcher::max_states;
+const int Regex::Matcher::Dfa::dead;
+const int Regex::Matcher::Dfa::unknown;
+
+namespace {
+
+// how deeply groups may nest.
+const int max_depth = 1000;
+
+// set of every byte a line can hold.
+std::bitset<256> any_byte()
+{
+  std::bitset<256> all;
+  all.set();
+  all.reset('\n');
+  return all;
+}
+
+}
+
+// constructor:
+// compiles pattern. if it cannot be, ok() is false and error()
+// says why.
+Regex::Regex(const std::string &pattern_) : pattern(pattern_), num_classes(0)
+{
+  size_type pos = 0;
+  const Node *tree = parse_alternation(pos, 0);
+  if (failure.empty() && pos < pattern.size()) {
+    fail("unmatched )", pos);
+  }
+  if (failure.empty()) {
+    Inst done = { Inst::match, -1, 0 };
+    forward_program.insts.push_back(done);
+    forward_program.start = compile(tree, forward_program, 0, false);
+    backward_program.insts.push_back(done);
+    backward_program.start = compile(tree, backward_program, 0, true);
+    if (forward_program.insts.size() > max_insts ||
+        backward_program.insts.size() > max_insts) {
+      failure = "pattern too big";
+    }
+  }
+  free_nodes();
+  if (!failure.empty()) {
+    LOG_DEBUG("regex \"{}\": {}", pattern, failure);
+    forward_program.insts.clear();
+    backward_program.insts.clear();
+    return;
+  }
+  make_classes();
+  LOG_TRACE("regex \"{}\": {} instructions, {} byte classes", pattern,
+            forward_program.insts.size(), num_classes);
+}
+
+// alternation := concatenation ('|' concatenation)*
+Regex::Node *Regex::parse_alternation(size_type &pos, int depth)
+{
+  Node *first = parse_concatenation(pos, depth);
+  if (!failure.empty() || pos >= pattern.size() || pattern[pos] != '|') {
+    return first;
+  }
+  Node *node = make_node(Node::alternate);
+  node->children.push_back(first);
+  while (failure.empty() && pos < pattern.size() && pattern[pos] == '|') {
+    ++pos;
+    node->children.push_back(parse_concatenation(pos, depth));
+  }
+  return node;
+}
+
+// concatenation := repeat*, up to '|', ')' or the end.
+Regex::Node *Regex::parse_concatenation(size_type &pos, int depth)
+{
+  Node *node = make_node(Node::concatenate);
+  while (failure.empty() && pos < pattern.size() && pattern[pos] != '|' &&
+         pattern[pos] != ')') {
+    node->children.push_back(parse_repeat(pos, depth));
+  }
+  return node;
+}
+
+// repeat := atom ('*' | '+' | '?' | '{m}' | '{m,}' | '{m,n}')*
+// a '{' that does not start a repeat is an ordinary character.
+Regex::Node *Regex::parse_repeat(size_type &pos, int depth)
+{
+  Node *atom = parse_atom(pos, depth);
+  while (failure.empty() && pos < pattern.size()) {
+    int min;
+    int max;
+    char c = pattern[pos];
+    size_type end = pos + 1;
+    if (c == '*') {
+      min = 0;
+      max = -1;
+    } else if (c == '+') {
+      min = 1;
+      max = -1;
+    } else if (c == '?') {
+      min = 0;
+      max = 1;
+    } else if (c == '{') {
+      min = parse_number(end);
+      if (min < 0) {
+        break;
+      }
+      max = min;
+      if (end < pattern.size() && pattern[end] == ',') {
+        ++end;
+        max = parse_number(end);
+      }
+      if (end >= pattern.size() || pattern[end] != '}') {
+        break;
+      }
+      ++end;
+      if (min > max_repeat || max > max_repeat ||
+          (max >= 0 && max < min)) {
+        return fail("bad repeat", pos);
+      }
+    } else {
+      break;
+    }
+    if (atom->kind == Node::line_begin || atom->kind == Node::line_end) {
+      return fail("nothing to repeat", pos);
+    }
+    Node *node = make_node(Node::repeat);
+    node->children.push_back(atom);
+    node->min = min;
+    node->max = max;
+    atom = node;
+    pos = end;
+  }
+  return atom;
+}
+
+// atom := '(' alternation ')' | '[' class ']' | '.' | '^' | '$' |
+//         '\' escape | character
+Regex::Node *Regex::parse_atom(size_type &pos, int depth)
+{
+  char c = pattern[pos];
+  if (c == '(') {
+    if (depth >= max_depth) {
+      return fail("groups nested too deeply", pos);
+    }
+    auto open = pos++;
+    Node *node = parse_alternation(pos, depth + 1);
+    if (!failure.empty()) {
+      return node;
+    }
+    if (pos >= pattern.size()) {
+      return fail("unmatched (", open);
+    }
+    ++pos;
+    return node;
+  }
+  if (c == '[') {
+    return parse_class(pos);
+  }
+  if (c == '*' || c == '+' || c == '?') {
+    return fail("nothing to repeat", pos);
+  }
+  ++pos;
+  if (c == '^') {
+    return make_node(Node::line_begin);
+  }
+  if (c == '$') {
+    return make_node(Node::line_end);
+  }
+  std::bitset<256> set;
+  if (c == '.') {
+    set = any_byte();
+  } else if (c == '\\') {
+    if (pos >= pattern.size()) {
+      return fail("\\ at end of pattern", pos - 1);
+    }
+    set = escape_set(pattern[pos]);
+    if (!failure.empty()) {
+      return fail(failure, pos - 1);
+    }
+    ++pos;
+  } else {
+    set.set(static_cast<unsigned char>(c));
+  }
+  Node *node = make_node(Node::set);
+  node->arg = add_set(set);
+  return node;
+}
+
+// class := '[' '^'? (escape | character ('-' character)?)+ ']'
+// a ']' first is an ordinary character, as is a '-' first or last.
+Regex::Node *Regex::parse_class(size_type &pos)
+{
+  auto open = pos++;
+  bool negated = pos < pattern.size() && pattern[pos] == '^';
+  if (negated) {
+    ++pos;
+  }
+  std::bitset<256> set;
+  bool first = true;
+  while (pos < pattern.size() && (first || pattern[pos] != ']')) {
+    first = false;
+    unsigned char low = pattern[pos++];
+    if (low == '\\') {
+      if (pos >= pattern.size()) {
+        break;
+      }
+      auto escaped = escape_set(pattern[pos]);
+      if (!failure.empty()) {
+        return fail(failure, pos - 1);
+      }
+      ++pos;
+      if (escaped.count() != 1) {
+        set |= escaped;
+        continue;
+      }
+      low = 0;
+      while (!escaped.test(low)) {
+        ++low;
+      }
+    }
+    unsigned char high = low;
+    if (pos + 1 < pattern.size() && pattern[pos] == '-' &&
+        pattern[pos + 1] != ']') {
+      high = pattern[pos + 1];
+      pos += 2;
+      if (high == '\\') {
+        if (pos >= pattern.size()) {
+          break;
+        }
+        auto escaped = escape_set(pattern[pos]);
+        if (!failure.empty() || escaped.count() != 1) {
+          return fail("bad range", pos - 1);
+        }
+        ++pos;
+        high = 0;
+        while (!escaped.test(high)) {
+          ++high;
+        }
+      }
+      if (high < low) {
+        return fail("bad range", pos - 1);
+      }
+    }
+    for (unsigned b = low; b <= high; ++b) {
+      set.set(b);
+    }
+  }
+  if (pos >= pattern.size()) {
+    return fail("unmatched [", open);
+  }
+  ++pos;
+  if (negated) {
+    set = ~set & any_byte();
+  }
+  Node *node = make_node(Node::set);
+  node->arg = add_set(set);
+  return node;
+}
+
+// parse a decimal number at pos, as in {m,n}. -1 if there is none.
+int Regex::parse_number(size_type &pos)
+{
+  int n = -1;
+  while (pos < pattern.size() && std::isdigit(
+             static_cast<unsigned char>(pattern[pos]))) {
+    n = std::min((n < 0 ? 0 : n * 10) + (pattern[pos] - '0'),
+                 max_repeat + 1);
+    ++pos;
+  }
+  return n;
+}
+
+// set of the bytes an escape \letter stands for.
+// letters other than these are kept for later use; anything else
+// stands for itself.
+std::bitset<256> Regex::escape_set(char letter)
+{
+  std::bitset<256> set;
+  auto lower = std::tolower(static_cast<unsigned char>(letter));
+  if (lower == 'd' || lower == 'w' || lower == 's') {
+    for (int b = 0; b < 128; ++b) {
+      if ((lower == 'd' && std::isdigit(b)) ||
+          (lower == 'w' && (std::isalnum(b) || b == '_')) ||
+          (lower == 's' && std::isspace(b) && b != '\n')) {
+        set.set(b);
+      }
+    }
+    if (letter != lower) {
+      set = ~set & any_byte();
+    }
+  } else if (letter == 't') {
+    set.set('\t');
+  } else if (letter == 'n') {
+    set.set('\n');
+  } else if (std::isalnum(static_cast<unsigned char>(letter))) {
+    failure = std::string("unknown escape \\") + letter;
+  } else {
+    set.set(static_cast<unsigned char>(letter));
+  }
+  return set;
+}
+
+// new node of the given kind, owned by nodes.
+Regex::Node *Regex::make_node(int kind)
+{
+  nodes.push_back(nullptr);
+  nodes.back() = new Node(kind);
+  return nodes.back();
+}
+
+// free every node.
+void Regex::free_nodes()
+{
+  for (auto node : nodes) {
+    delete node;
+  }
+  nodes.clear();
+}
+
+// index of set in sets, adding it if it is new.
+int Regex::add_set(const std::bitset<256> &set)
+{
+  auto found = std::find(sets.begin(), sets.end(), set);
+  if (found != sets.end()) {
+    return found - sets.begin();
+  }
+  sets.push_back(set);
+  return sets.size() - 1;
+}
+
+// compile node into program, to go on to next when it has matched.
+// reversed compiles it to match the text backward.
+// returns its first instruction.
+// instructions are added after those they go on to, so a program that
+// grows too big is cut short here and rejected by the caller.
+int Regex::compile(const Node *node, Program &program, int next,
+                   bool reversed) const
+{
+  auto &insts = program.insts;
+  if (insts.size() > max_insts) {
+    return next;
+  }
+  auto add = [&insts](Inst::Op op, int to, int arg) {
+    Inst inst = { op, to, arg };
+    insts.push_back(inst);
+    return static_cast<int>(insts.size() - 1);
+  };
+  switch (node->kind) {
+    case Node::set:
+      return add(Inst::byte_set, next, node->arg);
+    case Node::line_begin:
+      return add(reversed ? Inst::line_end : Inst::line_begin, next, 0);
+    case Node::line_end:
+      return add(reversed ? Inst::line_begin : Inst::line_end, next, 0);
+    case Node::concatenate: {
+      auto &children = node->children;
+      if (reversed) {
+        for (auto child = children.begin(); child != children.end();
+             ++child) {
+          next = compile(*child, program, next, reversed);
+        }
+      } else {
+        for (auto child = children.rbegin(); child != children.rend();
+             ++child) {
+          next = compile(*child, program, next, reversed);
+        }
+      }
+      return next;
+    }
+    case Node::alternate: {
+      auto &children = node->children;
+      int first = compile(children.back(), program, next, reversed);
+      for (auto child = children.rbegin() + 1; child != children.rend();
+           ++child) {
+        int entry = compile(*child, program, next, reversed);
+        first = add(Inst::split, entry, first);
+      }
+      return first;
+    }
+    case Node::repeat: {
+      const Node *body = node->children[0];
+      int tail = next;
+      if (node->max < 0) {
+        // a loop: split to the body, which comes back, or on.
+        tail = add(Inst::split, -1, next);
+        int entry = compile(body, program, tail, reversed);
+        insts[tail].next = entry;
+      } else {
+        // each optional copy may be skipped, and with it all after it.
+        for (int k = node->min; k < node->max; ++k) {
+          int entry = compile(body, program, tail, reversed);
+          tail = add(Inst::split, entry, next);
+        }
+      }
+      for (int k = 0; k < node->min; ++k) {
+        tail = compile(body, program, tail, reversed);
+      }
+      return tail;
+    }
+    default:
+      return next;
+  }
+}
+
+// group bytes that every set treats alike into classes, so that DFA
+// states need a transition per class rather than per byte.
+void Regex::make_classes()
+{
+  std::vector<int> classes(256, 0);
+  num_classes = 1;
+  for (auto &set : sets) {
+    std::map<std::pair<int, bool>, int> split;
+    for (unsigned b = 0; b < 256; ++b) {
+      auto key = std::make_pair(classes[b], bool(set.test(b)));
+      auto found = split.find(key);
+      if (found == split.end()) {
+        found = split.insert(std::make_pair(key, int(split.size()))).first;
+      }
+      classes[b] = found->second;
+    }
+    num_classes = split.size();
+  }
+  class_byte.assign(num_classes, 0);
+  for (int b = 255; b >= 0; --b) {
+    byte_class[b] = classes[b];
+    class_byte[classes[b]] = b;
+  }
+}
+
+// stop parsing with the given complaint.
+Regex::Node *Regex::fail(const std::string &why, size_type pos)
+{
+  failure = why + " at " + std::to_string(pos + 1);
+  // parsing stops at the first failure, but callers still want a node.
+  return make_node(Node::empty);
+}
+
+// constructor:
+// matches regex_, which must outlive it and have compiled.
+Regex::Matcher::Matcher(const Regex &regex_) :
+  forward(regex_, regex_.forward_program, false),
+  backward(regex_, regex_.backward_program, true)
+{
+  // empty
+}
+
+// append every match in text[0, length) to out, offset by base.
+// the text must hold whole lines.
+void Regex::Matcher::find_all(const char *text, size_type length,
+                              size_type base, std::vector<Match> &out)
+{
+  size_type begin = 0;
+  while (begin < length) {
+    auto newline = static_cast<const char *>(
+        std::memchr(text + begin, '\n', length - begin));
+    size_type end = newline != nullptr ? newline - text : length;
+    find_in_line(text + begin, end - begin, base + begin, out);
+    begin = end + 1;
+  }
+}
+
+// append the matches in the line text[0, length) to out.
+// one pass backward over the line finds every place a match starts;
+// then, from the first, the forward DFA runs for as long as it can to
+// find the longest match there, and the next is looked for after it.
+// a scan that comes to a position in a state an earlier scan was in
+// there goes on just as that one did, so it stops and takes its end:
+// each position is scanned at most once per state, and a scan running
+// on far past its match (a*b|a over a line of a's) is not repeated
+// from every start after it.
+void Regex::Matcher::find_in_line(const char *text, size_type length,
+                                  size_type base, std::vector<Match> &out)
+{
+  if (length == 0) {
+    return;
+  }
+  starts.assign(length, 0);
+  bool any = false;
+  // the backward program has ^ and $ swapped, so it starts at a line's
+  // start: the end of this one.
+  int s = backward.start(true);
+  for (size_type i = length; i-- > 0;) {
+    // with nothing left going, only matches starting here are.
+    if (s == Dfa::dead) {
+      s = backward.start(false);
+    }
+    s = backward.next(s, text[i]);
+    if (s != Dfa::dead && (backward.matched(s) ||
+                           (i == 0 && backward.matched_at_end(s)))) {
+      starts[i] = 1;
+      any = true;
+    }
+  }
+  if (!any) {
+    return;
+  }
+  scan_ends.clear();
+  visits.clear();
+  first_visit.assign(length, -1);
+  size_type from = 0;
+  while (from < length) {
+    while (from < length && !starts[from]) {
+      ++from;
+    }
+    if (from == length) {
+      break;
+    }
+    size_type end = from;
+    int scan = scan_ends.size();
+    s = forward.start(from == 0);
+    for (size_type i = from; i < length; ++i) {
+      s = forward.next(s, text[i]);
+      if (s == Dfa::dead) {
+        break;
+      }
+      unsigned generation = forward.generation();
+      int seen = first_visit[i];
+      while (seen >= 0 && (visits[seen].state != s ||
+                           visits[seen].generation != generation)) {
+        seen = visits[seen].next;
+      }
+      if (seen >= 0) {
+        // the earlier scan's last match, if it was from here on.
+        if (scan_ends[visits[seen].scan] > i) {
+          end = scan_ends[visits[seen].scan];
+        }
+        break;
+      }
+      Visit visit = { s, generation, scan, first_visit[i] };
+      first_visit[i] = visits.size();
+      visits.push_back(visit);
+      if (forward.matched(s) ||
+          (i + 1 == length && forward.matched_at_end(s))) {
+        end = i + 1;
+      }
+    }
+    scan_ends.push_back(end);
+    if (end == from) {
+      // cannot happen if the DFAs agree; don't loop on it if they don't.
+      ++from;
+      continue;
+    }
+    Match m = { base + from, end - from };
+    out.push_back(m);
+    from = end;
+  }
+}
+
+// constructor:
+// runs program of regex_. unanchored, it looks for matches starting
+// anywhere, not only where it starts.
+Regex::Matcher::Dfa::Dfa(const Regex &regex_, const Program &program_,
+                         bool unanchored_) :
+  regex(regex_), program(program_), unanchored(unanchored_),
+  num_classes(regex.num_classes), marks(program.insts.size(), 0), round(0),
+  cleared(0)
+{
+  starts[0] = starts[1] = unknown;
+  if (unanchored) {
+    ++round;
+    close(program.start, false, false, restart);
+  }
+}
+
+// state to start in, at the start of a line or not.
+int Regex::Matcher::Dfa::start(bool at_line_begin)
+{
+  int &s = starts[at_line_begin];
+  if (s == unknown) {
+    ++round;
+    scratch.clear();
+    close(program.start, at_line_begin, false, scratch);
+    std::sort(scratch.begin(), scratch.end());
+    s = add_state(scratch);
+  }
+  return s;
+}
+
+// state after s reads byte, which has not been worked out before.
+int Regex::Matcher::Dfa::build(int s, unsigned char byte)
+{
+  int c = regex.byte_class[byte];
+  ++round;
+  scratch.clear();
+  auto step = [this, byte](const std::vector<int> &from) {
+    for (int pc : from) {
+      auto &inst = program.insts[pc];
+      if (inst.op == Inst::byte_set && regex.sets[inst.arg].test(byte)) {
+        close(inst.next, false, false, scratch);
+      }
+    }
+  };
+  step(states[s].insts);
+  // a match may start at the byte just read, as well as anywhere
+  // before; threads that start here come in with it.
+  if (unanchored) {
+    step(restart);
+  }
+  int t = dead;
+  if (!scratch.empty()) {
+    std::sort(scratch.begin(), scratch.end());
+    auto found = index.find(scratch);
+    if (found != index.end()) {
+      t = found->second;
+    } else {
+      if (states.size() >= max_states) {
+        LOG_TRACE("regex DFA cache full at {} states; emptying it",
+                  states.size());
+        clear();
+        return add_state(scratch);
+      }
+      t = add_state(scratch);
+    }
+  }
+  transitions[s * num_classes + c] = t;
+  return t;
+}
+
+// add inst and everything reachable from it without consuming a byte
+// to out, skipping what is already marked.
+void Regex::Matcher::Dfa::close(int inst, bool at_line_begin,
+                                bool at_line_end, std::vector<int> &out)
+{
+  stack.push_back(inst);
+  while (!stack.empty()) {
+    int pc = stack.back();
+    stack.pop_back();
+    if (marks[pc] == round) {
+      continue;
+    }
+    marks[pc] = round;
+    auto &i = program.insts[pc];
+    switch (i.op) {
+      case Inst::byte_set:
+      case Inst::match:
+        out.push_back(pc);
+        break;
+      case Inst::split:
+        stack.push_back(i.arg);
+        stack.push_back(i.next);
+        break;
+      case Inst::jump:
+        stack.push_back(i.arg);
+        break;
+      case Inst::line_begin:
+        if (at_line_begin) {
+          stack.push_back(i.next);
+        }
+        break;
+      case Inst::line_end:
+        if (at_line_end) {
+          stack.push_back(i.next);
+        } else {
+          out.push_back(pc);
+        }
+        break;
+    }
+  }
+}
+
+// index of the state at insts, which are sorted, making it if it is
+// new.
+int Regex::Matcher::Dfa::add_state(const std::vector<int> &insts)
+{
+  auto found = index.find(insts);
+  if (found != index.end()) {
+    return found->second;
+  }
+  State state;
+  state.insts = insts;
+  state.matched = false;
+  state.matched_at_end = false;
+  std::vector<int> at_end;
+  ++round;
+  for (int pc : insts) {
+    auto op = program.insts[pc].op;
+    if (op == Inst::match) {
+      state.matched = state.matched_at_end = true;
+    } else if (op == Inst::line_end) {
+      close(program.insts[pc].next, false, true, at_end);
+    }
+  }
+  for (int pc : at_end) {
+    if (program.insts[pc].op == Inst::match) {
+      state.matched_at_end = true;
+    }
+  }
+  int s = states.size();
+  states.push_back(std::move(state));
+  transitions.resize(transitions.size() + num_classes, unknown);
+  index.insert(std::make_pair(insts, s));
+  return s;
+}
+
+// forget every state.
+void Regex::Matcher::Dfa::clear()
+{
+  states.clear();
+  transitions.clear();
+  index.clear();
+  starts[0] = starts[1] = unknown;
+  ++cleared;
+}
@@ -0,0 +1,306 @@
+#ifndef REGEX_H
+#define REGEX_H
+
+// Regex.h
+//
+// Regular expressions, matched with DFAs that are built lazily, a state
+// at a time as the text calls for them, and cached. Every character of
+// the text is looked at a bounded number of times, whatever the
+// pattern, so there are no pathological cases as with backtracking.
+//
+// Supported: literal characters, '.', [classes] and [^classes] with
+// ranges, the escapes \d \D \w \W \s \S \t and \ before any
+// punctuation, grouping with ( ), alternation with |, the repeats
+// * + ? {m} {m,} {m,n}, and ^ and $ for the start and end of a line.
+// Matches never span lines, are never empty, and are found leftmost
+// first, each as long as it can be.
+
+#include <bitset>
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+class Regex {
+  public:
+    using size_type = std::string::size_type;
+
+    // where a match is in the text.
+    struct Match {
+      size_type start;
+      size_type length;
+    };
+
+    // finds matches, keeping the DFA states it builds.
+    // one per thread: the Regex itself is never changed by matching.
+    class Matcher;
+
+    // constructor:
+    // compiles pattern. if it cannot be, ok() is false and error()
+    // says why.
+    explicit Regex(const std::string &pattern);
+
+    // if the pattern compiled.
+    bool ok() const;
+
+    // why the pattern did not compile.
+    const std::string &error() const;
+
+    // longest a {m,n} repeat may be.
+    static const int max_repeat = 1000;
+
+  private:
+    // parsed pattern.
+    struct Node;
+
+    // one instruction of a compiled program: a Thompson NFA.
+    struct Inst {
+      enum Op {
+        byte_set,    // consume a byte in sets[arg], go on to next
+        split,       // go on to next and to arg
+        jump,        // go on to arg
+        line_begin,  // go on to next at the start of a line only
+        line_end,    // go on to next at the end of a line only
+        match        // the pattern has matched
+      };
+      Op op;
+      int next;
+      int arg;
+    };
+
+    // compiled pattern, run forward, or backward over the text.
+    struct Program {
+      std::vector<Inst> insts;
+      int start;
+    };
+
+    // parsing: each parses from pos and advances it, or sets failure.
+    Node *parse_alternation(size_type &pos, int depth);
+    Node *parse_concatenation(size_type &pos, int depth);
+    Node *parse_repeat(size_type &pos, int depth);
+    Node *parse_atom(size_type &pos, int depth);
+    Node *parse_class(size_type &pos);
+
+    // parse a decimal number at pos, as in {m,n}. -1 if there is none.
+    int parse_number(size_type &pos);
+
+    // set of the bytes an escape \letter stands for.
+    // sets failure if there is no such escape.
+    std::bitset<256> escape_set(char letter);
+
+    // new node of the given kind, owned by nodes.
+    Node *make_node(int kind);
+
+    // free every node.
+    void free_nodes();
+
+    // index of set in sets, adding it if it is new.
+    int add_set(const std::bitset<256> &set);
+
+    // compile node into program, to go on to next when it has matched.
+    // reversed compiles it to match the text backward.
+    // returns its first instruction.
+    int compile(const Node *node, Program &program, int next,
+                bool reversed) const;
+
+    // group bytes that every set treats alike into classes.
+    void make_classes();
+
+    // stop parsing with the given complaint.
+    Node *fail(const std::string &why, size_type pos);
+
+    std::string pattern;
+    std::string failure;
+
+    // every node parsed; freed when compiling is done.
+    std::vector<Node *> nodes;
+
+    // sets of bytes the programs consume.
+    std::vector<std::bitset<256>> sets;
+
+    Program forward_program;
+    Program backward_program;
+
+    // class of each byte, a byte of each class, and number of classes.
+    unsigned char byte_class[256];
+    std::vector<unsigned char> class_byte;
+    int num_classes;
+
+    // most instructions a program may have.
+    static const std::size_t max_insts = 100000;
+};
+
+// finds matches, keeping the DFA states it builds.
+// one per thread: the Regex itself is never changed by matching.
+class Regex::Matcher {
+  public:
+    // constructor:
+    // matches regex_, which must outlive it and have compiled.
+    explicit Matcher(const Regex &regex_);
+
+    // append every match in text[0, length) to out, offset by base.
+    // the text must hold whole lines.
+    void find_all(const char *text, size_type length, size_type base,
+                  std::vector<Match> &out);
+
+    // most DFA states kept at once, each way. past this the cache is
+    // emptied and built again.
+    static const std::size_t max_states = 4096;
+
+  private:
+    // a DFA, built lazily from a program.
+    class Dfa {
+      public:
+        // no state: no match can continue.
+        static const int dead = -1;
+
+        // constructor:
+        // runs program of regex_. unanchored, it looks for matches
+        // starting anywhere, not only where it starts.
+        Dfa(const Regex &regex_, const Program &program_, bool unanchored_);
+
+        // state to start in, at the start of a line or not.
+        int start(bool at_line_begin);
+
+        // state after s reads byte. may empty the cache, so only the
+        // state returned is valid afterwards.
+        int next(int s, unsigned char byte);
+
+        // if s has matched, or would if the line ended here.
+        bool matched(int s) const;
+        bool matched_at_end(int s) const;
+
+        // how many times the cache has been emptied: states from before
+        // are not the same states after.
+        unsigned generation() const;
+
+      private:
+        struct State {
+          // instructions the DFA is at: byte_set, line_end and match.
+          std::vector<int> insts;
+          bool matched;
+          bool matched_at_end;
+        };
+
+        // state after s reads byte, which has not been worked out
+        // before.
+        int build(int s, unsigned char byte);
+
+        // add inst and everything reachable from it without consuming a
+        // byte to out, skipping what is already marked. at_line_begin
+        // and at_line_end say if ^ and $ can be passed; $ is kept in
+        // out if it cannot yet.
+        void close(int inst, bool at_line_begin, bool at_line_end,
+                   std::vector<int> &out);
+
+        // index of the state at insts, which are sorted, making it if
+        // it is new.
+        int add_state(const std::vector<int> &insts);
+
+        // forget every state.
+        void clear();
+
+        const Regex &regex;
+        const Program &program;
+        bool unanchored;
+        int num_classes;
+
+        std::vector<State> states;
+
+        // next state for each state and byte class, or unknown.
+        std::vector<int> transitions;
+
+        // states by their instructions.
+        std::map<std::vector<int>, int> index;
+
+        // start states, or unknown.
+        int starts[2];
+
+        // instructions reached at the start of a match, part way
+        // through a line; stepped with every state when unanchored.
+        std::vector<int> restart;
+
+        // scratch space for building states: instructions reached, and
+        // which were marked in this round.
+        std::vector<int> scratch;
+        std::vector<unsigned> marks;
+        std::vector<int> stack;
+        unsigned round;
+
+        // times the cache has been emptied.
+        unsigned cleared;
+
+        static const int unknown = -2;
+    };
+
+    // append the matches in the line text[0, length) to out.
+    void find_in_line(const char *text, size_type length, size_type base,
+                      std::vector<Match> &out);
+
+    // the DFAs: forward from a known start, for the longest match, and
+    // backward, for where matches may start.
+    Dfa forward;
+    Dfa backward;
+
+    // a forward scan having been at a position in a state.
+    struct Visit {
+      int state;
+      unsigned generation;
+
+      // which scan it was, and the next visit at the same position.
+      int scan;
+      int next;
+    };
+
+    // for each position in the line, if a match starts there.
+    std::vector<char> starts;
+
+    // the forward scans of the line: where each ended its match, and
+    // the visits at each position, in lists from first_visit.
+    std::vector<size_type> scan_ends;
+    std::vector<Visit> visits;
+    std::vector<int> first_visit;
+};
+
+// inline function definitions
+
+// if the pattern compiled.
+inline bool Regex::ok() const
+{
+  return failure.empty();
+}
+
+// why the pattern did not compile.
+inline const std::string &Regex::error() const
+{
+  return failure;
+}
+
+// state after s reads byte. may empty the cache, so only the state
+// returned is valid afterwards.
+inline int Regex::Matcher::Dfa::next(int s, unsigned char byte)
+{
+  int t = transitions[s * num_classes + regex.byte_class[byte]];
+  return t != unknown ? t : build(s, byte);
+}
+
+// if s has matched.
+inline bool Regex::Matcher::Dfa::matched(int s) const
+{
+  return states[s].matched;
+}
+
+// if s would have matched if the line ended here.
+inline bool Regex::Matcher::Dfa::matched_at_end(int s) const
+{
+  return states[s].matched_at_end;
+}
+
+// how many times the cache has been emptied: states from before are not
+// the same states after.
+inline unsigned Regex::Matcher::Dfa::generation() const
+{
+  return cleared;
+}
+
+#endif /* REGEX_H */
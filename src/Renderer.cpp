@@ -0,0 +1,195 @@
+// Renderer.cpp
+//
+// Draws on the terminal on a thread of its own.
+
+#include <atomic>
+#include <utility>
+
+#include "Renderer.h"
+#include "Log.h"
+
+const int Renderer::default_interval;
+
+namespace {
+
+// how many Frames may wait to be drawn before submit waits.
+const std::size_t queue_size = 256;
+
+}
+
+// constructor:
+// starts drawing with backend_, bringing the terminal up to date at most
+// once every interval_ms milliseconds.
+Renderer::Renderer(Backend &backend_,
+                   int interval_ms_ /* = default_interval */) :
+  backend(backend_), interval(interval_ms_), queue(queue_size), cursor_win(nullptr),
+  num_frames(0), num_refreshes(0), sleeping(false), stopping(false)
+{
+  worker = std::thread([this] { work(); });
+}
+
+// draws every Frame queued, then stops.
+Renderer::~Renderer()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping.store(true);
+  }
+  ready.notify_one();
+  worker.join();
+}
+
+// queue frame to be drawn. from one thread only, the one editing.
+// waits if the renderer is far behind.
+// the renderer is only woken, which takes the lock, if it may be
+// asleep. the fence keeps the Frame being pushed from being ordered
+// after sleeping is read: the renderer, setting sleeping and then
+// looking at the queue, fences the other way, so at least one of them
+// sees what the other did.
+void Renderer::submit(Frame &&frame)
+{
+  num_frames.fetch_add(1, std::memory_order_relaxed);
+  while (!queue.push(std::move(frame))) {
+    std::this_thread::yield();
+  }
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (sleeping.load()) {
+    std::lock_guard<std::mutex> guard(lock);
+    ready.notify_one();
+  }
+}
+
+// have the terminal be rows by cols from the next Frame on.
+// from the thread editing, as submit.
+void Renderer::resize(int rows, int cols)
+{
+  Frame frame;
+  frame.source = nullptr;
+  frame.top = frame.left = 0;
+  frame.rows = rows;
+  frame.cols = cols;
+  frame.cursor_y = frame.cursor_x = 0;
+  submit(std::move(frame));
+}
+
+// forget the window source drew, which is going.
+// from the thread editing, as submit.
+void Renderer::forget(const Screen *source)
+{
+  Frame frame;
+  frame.source = source;
+  frame.top = frame.left = 0;
+  frame.rows = frame.cols = 0;
+  frame.cursor_y = frame.cursor_x = 0;
+  submit(std::move(frame));
+}
+
+// draw Frames as they come, until stopped.
+// the first Frame after a quiet spell is drawn at once; Frames that
+// follow it within the interval are drawn together once it is up.
+void Renderer::work()
+{
+  auto last_refresh = Clock::now() - interval;
+  for (;;) {
+    if (!apply_queued()) {
+      if (stopping.load()) {
+        break;
+      }
+      // sleep until there is something to draw. sleeping is set before
+      // the queue is looked at again, so that a Frame submitted
+      // meanwhile either is seen here or wakes the renderer.
+      std::unique_lock<std::mutex> guard(lock);
+      sleeping.store(true);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      ready.wait(guard, [this] {
+        return !queue.empty() || stopping.load();
+      });
+      sleeping.store(false);
+      continue;
+    }
+    auto due = last_refresh + interval;
+    if (Clock::now() < due) {
+      std::this_thread::sleep_until(due);
+      apply_queued();
+    }
+    refresh();
+    last_refresh = Clock::now();
+  }
+}
+
+// apply every Frame queued to its window's Screen.
+// returns false if there were none.
+bool Renderer::apply_queued()
+{
+  bool any = false;
+  Frame frame;
+  while (queue.pop(frame)) {
+    apply(frame);
+    any = true;
+  }
+  return any;
+}
+
+// apply frame to its window's Screen, or resize the terminal, or forget
+// a window.
+// a window moved or of a new size is moved first, which redraws it all.
+// so is a new window: what was drawn where it is now is not known.
+void Renderer::apply(Frame &frame)
+{
+  if (frame.source == nullptr) {
+    backend.resize(frame.rows, frame.cols);
+    return;
+  }
+  if (frame.rows == 0) {
+    screens.erase(frame.source);
+    if (cursor_win == frame.source) {
+      cursor_win = nullptr;
+    }
+    return;
+  }
+  auto &screen = screens[frame.source];
+  if (!screen) {
+    screen.reset(new Screen(&backend, nullptr, frame.top, frame.left,
+                            frame.rows, frame.cols));
+    screen->place(frame.top, frame.left, frame.rows, frame.cols);
+  } else if (screen->top() != frame.top || screen->left() != frame.left ||
+      screen->height() != frame.rows || screen->width() != frame.cols) {
+    screen->place(frame.top, frame.left, frame.rows, frame.cols);
+  }
+  for (auto &row : frame.changed) {
+    screen->put_line(row.y, row.cells.data(), row.cells.size());
+    int x = 0;
+    int cols = static_cast<int>(row.marks.size());
+    while (x < cols) {
+      if (!row.marks[x]) {
+        ++x;
+        continue;
+      }
+      int first = x;
+      while (x < cols && row.marks[x]) {
+        ++x;
+      }
+      screen->highlight(row.y, first, x);
+    }
+  }
+  screen->set_cursor(frame.cursor_y, frame.cursor_x);
+  cursor_win = frame.source;
+}
+
+// send what changed in every window to the terminal.
+// the window the cursor was last left in goes last, so that the
+// cursor ends up there.
+void Renderer::refresh()
+{
+  for (auto &entry : screens) {
+    if (entry.first != cursor_win) {
+      entry.second->stage();
+    }
+  }
+  auto found = screens.find(cursor_win);
+  if (found != screens.end()) {
+    found->second->stage();
+  }
+  backend.flush();
+  num_refreshes.fetch_add(1, std::memory_order_relaxed);
+}
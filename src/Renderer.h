@@ -0,0 +1,146 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+// Renderer.h
+//
+// Draws on the terminal on a thread of its own, so that a slow terminal
+// or a large redraw never holds up editing.
+// The editing thread describes what changed as Frames, the rows of a
+// window that differ from the last Frame and where the cursor is, and
+// queues them without locking. The renderer applies every Frame queued
+// to a Screen per window, and brings the terminal up to date at most
+// once per refresh interval: a burst of edits costs one refresh.
+// Once there is a Renderer, nothing else may draw on the terminal.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Backend.h"
+#include "Screen.h"
+#include "Spsc_queue.h"
+
+class Renderer {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    // what changed in a window, to draw.
+    struct Frame {
+      // a row of cells, and which of them are highlighted.
+      struct Row {
+        int y;
+        std::string cells;
+        std::vector<bool> marks;
+      };
+
+      // the Screen of the window drawn in, where the window is on the
+      // terminal, and its size; the renderer's Screen for it is moved
+      // to match.
+      // a Frame from no Screen says the terminal is now rows by cols;
+      // a Frame of no size, that its Screen has gone.
+      const Screen *source;
+      int top;
+      int left;
+      int rows;
+      int cols;
+
+      std::vector<Row> changed;
+
+      // where the cursor is left.
+      int cursor_y;
+      int cursor_x;
+    };
+
+    // constructor:
+    // starts drawing with backend_, bringing the terminal up to date at
+    // most once every interval_ms milliseconds.
+    explicit Renderer(Backend &backend_, int interval_ms_ = default_interval);
+
+    // draws every Frame queued, then stops.
+    ~Renderer();
+
+    Renderer(const Renderer &) = delete;
+    Renderer &operator=(const Renderer &) = delete;
+
+    // queue frame to be drawn. from one thread only, the one editing.
+    // waits if the renderer is far behind.
+    void submit(Frame &&frame);
+
+    // have the terminal be rows by cols from the next Frame on.
+    // from the thread editing, as submit.
+    void resize(int rows, int cols);
+
+    // forget the window source drew, which is going.
+    // from the thread editing, as submit.
+    void forget(const Screen *source);
+
+    // number of Frames submitted, and of times the terminal was brought
+    // up to date.
+    std::size_t frames() const;
+    std::size_t refreshes() const;
+
+    static const int default_interval = 16;
+
+  private:
+    // draw Frames as they come, until stopped.
+    void work();
+
+    // apply every Frame queued to its window's Screen.
+    // returns false if there were none.
+    bool apply_queued();
+
+    // apply frame to its window's Screen, or resize the terminal, or
+    // forget a window.
+    void apply(Frame &frame);
+
+    // send what changed in every window to the terminal.
+    void refresh();
+
+    Backend &backend;
+
+    std::chrono::milliseconds interval;
+
+    Spsc_queue<Frame> queue;
+
+    // what each window shows, by the Screen that sends its Frames;
+    // renderer thread only.
+    std::map<const Screen *, std::unique_ptr<Screen>> screens;
+
+    // window the cursor was last left in.
+    const Screen *cursor_win;
+
+    std::atomic<std::size_t> num_frames;
+    std::atomic<std::size_t> num_refreshes;
+
+    // the renderer sleeps on ready when there is nothing to draw.
+    // sleeping is set first, so that submit only takes the lock to
+    // wake it when it may be asleep.
+    std::atomic<bool> sleeping;
+    std::atomic<bool> stopping;
+    std::mutex lock;
+    std::condition_variable ready;
+
+    std::thread worker;
+};
+
+// inline function definitions
+
+// number of Frames submitted.
+inline std::size_t Renderer::frames() const
+{
+  return num_frames.load(std::memory_order_relaxed);
+}
+
+// number of times the terminal was brought up to date.
+inline std::size_t Renderer::refreshes() const
+{
+  return num_refreshes.load(std::memory_order_relaxed);
+}
+
+#endif /* RENDERER_H */
@@ -0,0 +1,205 @@
+// Screen.cpp
+//
+// Double-buffered grid of character cells for one window, a rectangle
+// of the terminal.
+
+#include <algorithm>
+#include <string>
+
+#include "Screen.h"
+#include "Backend.h"
+#include "Renderer.h"
+
+const int Screen::min_gap;
+
+// constructor:
+// rows_ by cols_ cells with its top left corner at row top_, column
+// left_ of the terminal, drawn by backend_; or handed to renderer_ to
+// draw, as Frames, if there is one.
+// a new window starts out blank, as far as the Renderer knows too.
+Screen::Screen(Backend *backend_, Renderer *renderer_, int top_, int left_,
+               int rows_, int cols_) :
+  backend(backend_), renderer(renderer_), top_row(top_), left_col(left_),
+  rows(rows_), cols(cols_), cursor_y(0), cursor_x(0)
+{
+  front.assign(rows * cols, ' ');
+  back.assign(rows * cols, ' ');
+  front_marks.assign(rows * cols, false);
+  back_marks.assign(rows * cols, false);
+}
+
+// tells the Renderer, if there is one, that the window has gone.
+Screen::~Screen()
+{
+  if (renderer != nullptr) {
+    renderer->forget(this);
+  }
+}
+
+// move to the given place on the terminal and change to the given
+// size, e.g. after the terminal resizes.
+// everything is redrawn on the next flush.
+void Screen::place(int top_, int left_, int rows_, int cols_)
+{
+  top_row = top_;
+  left_col = left_;
+  rows = rows_;
+  cols = cols_;
+  cursor_y = std::min(cursor_y, rows - 1);
+  cursor_x = std::min(cursor_x, cols - 1);
+  // no cell ever holds '\0', so every cell will differ.
+  front.assign(rows * cols, '\0');
+  back.assign(rows * cols, ' ');
+  front_marks.assign(rows * cols, false);
+  back_marks.assign(rows * cols, false);
+}
+
+// replace row y of the back grid with the given text.
+// text past the right edge is cut off; the rest of the row is blank.
+// control characters (tabs included) take one cell, like any other,
+// so that columns match cursor positions.
+// none of the row is highlighted.
+void Screen::put_line(int y, const char *text, std::string::size_type length)
+{
+  if (y < 0 || y >= rows) {
+    return;
+  }
+  char *row = &back[y * cols];
+  int shown = static_cast<int>(std::min<std::string::size_type>(length, cols));
+  for (int x = 0; x < shown; ++x) {
+    unsigned char letter = text[x];
+    if (letter == '\t') {
+      row[x] = ' ';
+    } else if (letter < ' ' || letter == 127) {
+      row[x] = '?';
+    } else {
+      row[x] = letter;
+    }
+  }
+  std::fill(row + shown, row + cols, ' ');
+  std::fill(back_marks.begin() + y * cols,
+            back_marks.begin() + (y + 1) * cols, false);
+}
+
+// highlight cells [first, last) of row y of the back grid, as far as
+// they are on the screen.
+void Screen::highlight(int y, int first, int last)
+{
+  if (y < 0 || y >= rows) {
+    return;
+  }
+  first = std::max(first, 0);
+  last = std::min(last, cols);
+  for (int x = first; x < last; ++x) {
+    back_marks[y * cols + x] = true;
+  }
+}
+
+// blank row y of the back grid.
+void Screen::clear_line(int y)
+{
+  put_line(y, "", 0);
+}
+
+// forget what the terminal shows on row y.
+// no cell ever holds '\0', so every cell of the row will differ.
+void Screen::touch_line(int y)
+{
+  if (y < 0 || y >= rows) {
+    return;
+  }
+  std::fill(&front[y * cols], &front[y * cols] + cols, '\0');
+}
+
+// send every cell that differs between back and front to the
+// terminal, or the rows they are on to the Renderer, then make front
+// match back.
+// returns the number of cells sent.
+int Screen::flush()
+{
+  if (renderer == nullptr) {
+    int sent = stage();
+    backend->flush();
+    return sent;
+  }
+  Renderer::Frame frame;
+  frame.source = this;
+  frame.top = top_row;
+  frame.left = left_col;
+  frame.rows = rows;
+  frame.cols = cols;
+  frame.cursor_y = cursor_y;
+  frame.cursor_x = cursor_x;
+  int sent = 0;
+  for (int y = 0; y < rows; ++y) {
+    int row = y * cols;
+    for (int x = 0; x < cols; ++x) {
+      if (!same(row + x)) {
+        frame.changed.push_back(Renderer::Frame::Row{
+            y, std::string(&back[row], cols),
+            std::vector<bool>(back_marks.begin() + row,
+                              back_marks.begin() + row + cols) });
+        sent += cols;
+        break;
+      }
+    }
+  }
+  front = back;
+  front_marks = back_marks;
+  renderer->submit(std::move(frame));
+  return sent;
+}
+
+// flush, but leave the terminal to be brought up to date with
+// everything else staged, by flushing the Backend.
+// changed cells close together are sent as one run.
+int Screen::stage()
+{
+  int sent = 0;
+  for (int y = 0; y < rows; ++y) {
+    int row = y * cols;
+    int x = 0;
+    while (x < cols) {
+      if (same(row + x)) {
+        ++x;
+        continue;
+      }
+      int first = x;
+      int last = x + 1;
+      int unchanged = 0;
+      for (int k = x + 1; k < cols && unchanged < min_gap; ++k) {
+        if (same(row + k)) {
+          ++unchanged;
+        } else {
+          unchanged = 0;
+          last = k + 1;
+        }
+      }
+      emit(y, first, last);
+      sent += last - first;
+      x = last;
+    }
+  }
+  front = back;
+  front_marks = back_marks;
+
+  backend->set_cursor(top_row + cursor_y, left_col + cursor_x);
+  return sent;
+}
+
+// send cells [first, last) of row y, in runs that are all highlighted
+// or all not.
+void Screen::emit(int y, int first, int last)
+{
+  int row = y * cols;
+  while (first < last) {
+    bool marked = back_marks[row + first];
+    int end = first + 1;
+    while (end < last && back_marks[row + end] == marked) {
+      ++end;
+    }
+    backend->put(top_row + y, left_col + first, &back[row + first],
+                 end - first, marked);
+    first = end;
+  }
+}
@@ -0,0 +1,141 @@
+#ifndef SCREEN_H
+#define SCREEN_H
+
+// Screen.h
+//
+// Double-buffered grid of character cells for one window, a rectangle
+// of the terminal.
+// Drawing goes into the back grid; flush() compares it with the front
+// grid (what the terminal is showing) and sends only the cells that
+// differ to a Backend. A cell may be highlighted, e.g. to show a search
+// match.
+// A Screen may instead hand what changed to a Renderer, which draws it
+// on a thread of its own.
+
+#include <string>
+#include <vector>
+
+class Backend;
+class Renderer;
+
+class Screen {
+  public:
+    // constructor:
+    // rows_ by cols_ cells with its top left corner at row top_,
+    // column left_ of the terminal, drawn by backend_; or handed to
+    // renderer_ to draw, as Frames, if there is one.
+    Screen(Backend *backend_, Renderer *renderer_, int top_, int left_,
+           int rows_, int cols_);
+
+    // tells the Renderer, if there is one, that the window has gone.
+    ~Screen();
+
+    Screen(const Screen &) = delete;
+    Screen &operator=(const Screen &) = delete;
+
+    // move to the given place on the terminal and change to the given
+    // size, e.g. after the terminal resizes.
+    // everything is redrawn on the next flush.
+    void place(int top_, int left_, int rows_, int cols_);
+
+    int top() const;
+    int left() const;
+    int height() const;
+    int width() const;
+
+    // replace row y of the back grid with the given text.
+    // text past the right edge is cut off; the rest of the row is blank.
+    // none of the row is highlighted.
+    void put_line(int y, const char *text, std::string::size_type length);
+
+    // highlight cells [first, last) of row y of the back grid, as far
+    // as they are on the screen.
+    void highlight(int y, int first, int last);
+
+    // blank row y of the back grid.
+    void clear_line(int y);
+
+    // forget what the terminal shows on row y, e.g. after something
+    // else drew over it. the row is resent on the next flush.
+    void touch_line(int y);
+
+    // where the cursor is left after the next flush.
+    void set_cursor(int y, int x);
+
+    // send every cell that differs between back and front to the
+    // terminal, or the rows they are on to the Renderer, then make
+    // front match back.
+    // returns the number of cells sent.
+    int flush();
+
+    // flush, but leave the terminal to be brought up to date with
+    // everything else staged, by flushing the Backend.
+    int stage();
+
+  private:
+    // if cell i looks the same in front and back.
+    bool same(int i) const;
+
+    // send cells [first, last) of row y.
+    void emit(int y, int first, int last);
+
+    // a gap of unchanged cells shorter than this between two changed
+    // runs is resent rather than moved over.
+    static const int min_gap = 4;
+
+    Backend *backend;
+
+    // nullptr unless drawing is left to a Renderer.
+    Renderer *renderer;
+
+    // where the window is on the terminal, and its size.
+    int top_row;
+    int left_col;
+    int rows;
+    int cols;
+    int cursor_y;
+    int cursor_x;
+
+    // rows * cols cells, row by row, and which of them are highlighted.
+    std::vector<char> front;
+    std::vector<char> back;
+    std::vector<bool> front_marks;
+    std::vector<bool> back_marks;
+};
+
+// inline function definitions
+
+inline int Screen::top() const
+{
+  return top_row;
+}
+
+inline int Screen::left() const
+{
+  return left_col;
+}
+
+inline int Screen::height() const
+{
+  return rows;
+}
+
+inline int Screen::width() const
+{
+  return cols;
+}
+
+// if cell i looks the same in front and back.
+inline bool Screen::same(int i) const
+{
+  return front[i] == back[i] && front_marks[i] == back_marks[i];
+}
+
+// where the cursor is left after the next flush.
+inline void Screen::set_cursor(int y, int x)
+{
+  cursor_y = y;
+  cursor_x = x;
+}
+
+#endif /* SCREEN_H */
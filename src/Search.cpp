@@ -0,0 +1,307 @@
+// Search.cpp
+//
+// Finds every match of a literal pattern or a Regex in a snapshot of a
+// Buffer's text, in the background.
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Search.h"
+#include "Substring_search.h"
+#include "Thread_pool.h"
+#include "Log.h"
+
+const Search::size_type Search::chunk_size;
+
+namespace {
+
+// orders matches by where they start.
+bool starts_before(const Search::Match &m, Search::size_type pos)
+{
+  return m.start < pos;
+}
+
+}
+
+Search::Chunk::Chunk() : lines_from(Piece_table::npos), scanned(false)
+{
+  // empty
+}
+
+// constructor:
+// starts looking for pattern_ in text_, as a Regex if regex_.
+// the chunks holding [first, last) are scanned before this returns;
+// the rest are queued on the shared Thread_pool in the order they are
+// likeliest to be wanted: onward from first in the direction of the
+// search, wrapping around.
+// an empty pattern, or a regex that does not compile, matches nothing.
+Search::Search(Piece_table::Snapshot text_, const std::string &pattern_,
+               size_type first, size_type last, bool forward /* = true */,
+               bool regex_ /* = false */) :
+  text(std::move(text_)), what(pattern_),
+  regex(regex_ ? new Regex(what) : nullptr),
+  num_chunks(what.empty() || (regex && !regex->ok()) ? 0 :
+             (text.size() + chunk_size - 1) / chunk_size),
+  chunks(new Chunk[num_chunks]), num_scanned(0), num_found(0),
+  longest(regex ? 0 : what.size()), cancelled(false), jobs(0)
+{
+  if (num_chunks == 0) {
+    return;
+  }
+  auto in_view = chunk_of(first);
+  auto view_end = chunk_of(last > first ? last - 1 : first);
+  for (auto i = in_view; i <= view_end; ++i) {
+    scan(i);
+  }
+  LOG_TRACE("search for \"{}\": {} of {} chunks scanned at once",
+            what, view_end - in_view + 1, num_chunks);
+
+  auto &pool = Thread_pool::shared();
+  for (size_type k = 1; k < num_chunks; ++k) {
+    auto i = forward ? (in_view + k) % num_chunks :
+                       (in_view + num_chunks - k) % num_chunks;
+    if (chunks[i].scanned.load(std::memory_order_relaxed)) {
+      continue;
+    }
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      ++jobs;
+    }
+    pool.submit([this, i] {
+      scan(i);
+      finish_job();
+    });
+  }
+}
+
+// stops the search, waiting for chunks being scanned.
+// chunks not yet started are skipped.
+Search::~Search()
+{
+  cancelled.store(true, std::memory_order_relaxed);
+  std::unique_lock<std::mutex> guard(lock);
+  idle.wait(guard, [this] { return jobs == 0; });
+}
+
+// first match starting at or after pos, wrapping around to the start.
+// each chunk on the way must have been scanned to be sure.
+Search::Result Search::next(size_type pos, Match &found) const
+{
+  size_type start;
+  if (num_chunks == 0) {
+    return Result::none;
+  }
+  if (!owner_of(pos, start)) {
+    return Result::pending;
+  }
+  for (size_type k = 0; k <= num_chunks; ++k) {
+    const Chunk &c = chunks[(start + k) % num_chunks];
+    if (!c.scanned.load(std::memory_order_acquire)) {
+      return Result::pending;
+    }
+    // in the first chunk, only matches from pos on; coming back round
+    // to it, any.
+    auto match = k == 0 ?
+                 std::lower_bound(c.found.begin(), c.found.end(), pos,
+                                  starts_before) :
+                 c.found.begin();
+    if (match != c.found.end()) {
+      found = *match;
+      return Result::found;
+    }
+  }
+  return Result::none;
+}
+
+// last match starting before pos, wrapping around to the end.
+// each chunk on the way must have been scanned to be sure.
+Search::Result Search::previous(size_type pos, Match &found) const
+{
+  size_type start;
+  if (num_chunks == 0) {
+    return Result::none;
+  }
+  if (!owner_of(pos, start)) {
+    return Result::pending;
+  }
+  for (size_type k = 0; k <= num_chunks; ++k) {
+    const Chunk &c = chunks[(start + num_chunks - k % num_chunks) %
+                            num_chunks];
+    if (!c.scanned.load(std::memory_order_acquire)) {
+      return Result::pending;
+    }
+    auto match = k == 0 ?
+                 std::lower_bound(c.found.begin(), c.found.end(), pos,
+                                  starts_before) :
+                 c.found.end();
+    if (match != c.found.begin()) {
+      found = *(match - 1);
+      return Result::found;
+    }
+  }
+  return Result::none;
+}
+
+// append every match found so far that overlaps [first, last) to out,
+// in order.
+void Search::matches(size_type first, size_type last,
+                     std::vector<Match> &out) const
+{
+  if (num_chunks == 0 || first >= last) {
+    return;
+  }
+  // a match starting up to this far before first may reach into it.
+  auto reach = longest.load(std::memory_order_acquire);
+  auto from = first - std::min(first, reach > 0 ? reach - 1 : 0);
+  // what is not scanned yet is left out.
+  size_type owner;
+  owner_of(from, owner);
+  for (auto i = owner; i <= chunk_of(last - 1); ++i) {
+    const Chunk &c = chunks[i];
+    if (!c.scanned.load(std::memory_order_acquire)) {
+      continue;
+    }
+    auto match = std::lower_bound(c.found.begin(), c.found.end(), from,
+                                  starts_before);
+    for (; match != c.found.end() && match->start < last; ++match) {
+      if (match->start + match->length > first) {
+        out.push_back(*match);
+      }
+    }
+  }
+}
+
+// chunk holding pos. the last one for the end of the text.
+Search::size_type Search::chunk_of(size_type pos) const
+{
+  return std::min(pos / chunk_size, num_chunks - 1);
+}
+
+// set owner to the chunk holding the matches that start at pos.
+// false if that is not known yet: owner is then a chunk before it that
+// has yet to be scanned.
+// for a regex, that is the chunk the line pos is on starts in, which
+// may be some way back if the line is long.
+bool Search::owner_of(size_type pos, size_type &owner) const
+{
+  owner = chunk_of(pos);
+  if (!regex) {
+    return true;
+  }
+  for (;; --owner) {
+    const Chunk &c = chunks[owner];
+    if (!c.scanned.load(std::memory_order_acquire)) {
+      return false;
+    }
+    // the first chunk's first line starts at 0.
+    if (c.lines_from <= pos) {
+      return true;
+    }
+  }
+}
+
+// scan chunk number i, unless the search was stopped.
+void Search::scan(size_type i)
+{
+  if (cancelled.load(std::memory_order_relaxed)) {
+    return;
+  }
+  Chunk &c = chunks[i];
+  if (regex) {
+    scan_regex(c, i * chunk_size);
+  } else {
+    scan_literal(c, i * chunk_size);
+  }
+  num_found.fetch_add(c.found.size(), std::memory_order_relaxed);
+  c.scanned.store(true, std::memory_order_release);
+  num_scanned.fetch_add(1, std::memory_order_release);
+}
+
+// scan chunk c, which starts at begin, for the literal pattern.
+// a match may run on past the end of the chunk, so the scan does too.
+// the text is scanned where it lies if it is all in one run, as most
+// of a file that was loaded is; otherwise it is copied first.
+void Search::scan_literal(Chunk &c, size_type begin)
+{
+  c.lines_from = begin;
+  auto end = std::min(begin + chunk_size + what.size() - 1, text.size());
+  size_type length;
+  const char *run = text.span_at(begin, length);
+  std::string copied;
+  if (length < end - begin) {
+    text.copy(begin, end - begin, copied);
+    run = copied.data();
+  }
+  std::vector<size_type> starts;
+  substring_search::find_all(run, end - begin, what.data(), what.size(),
+                             starts);
+  c.found.reserve(starts.size());
+  for (auto start : starts) {
+    Match m = { begin + start, what.size() };
+    c.found.push_back(m);
+  }
+}
+
+// scan the lines starting in chunk c, which starts at begin, for the
+// regex.
+// the last of them may run on past the end of the chunk, so the scan
+// does too; a chunk in the middle of a line has nothing to do.
+// the text is scanned where it lies if it is all in one run, as for a
+// literal pattern.
+void Search::scan_regex(Chunk &c, size_type begin)
+{
+  auto end = std::min(begin + chunk_size, text.size());
+  auto first = begin == 0 ? 0 : find_newline(begin - 1, end) + 1;
+  if (first >= end) {
+    return;
+  }
+  c.lines_from = first;
+  auto last = find_newline(end - 1, text.size());
+  size_type length;
+  const char *run = text.span_at(first, length);
+  std::string copied;
+  if (length < last - first) {
+    text.copy(first, last - first, copied);
+    run = copied.data();
+  }
+  Regex::Matcher matcher(*regex);
+  matcher.find_all(run, last - first, first, c.found);
+  size_type most = 0;
+  for (auto &m : c.found) {
+    most = std::max(most, m.length);
+  }
+  auto known = longest.load(std::memory_order_relaxed);
+  while (known < most &&
+         !longest.compare_exchange_weak(known, most,
+                                        std::memory_order_release)) {
+    // known has been reloaded; try again.
+  }
+}
+
+// position of the first newline in [pos, last), or last.
+Search::size_type Search::find_newline(size_type pos, size_type last) const
+{
+  while (pos < last) {
+    size_type length;
+    const char *run = text.span_at(pos, length);
+    length = std::min(length, last - pos);
+    auto newline = static_cast<const char *>(std::memchr(run, '\n', length));
+    if (newline != nullptr) {
+      return pos + (newline - run);
+    }
+    pos += length;
+  }
+  return last;
+}
+
+// record that a background job has finished.
+void Search::finish_job()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  if (--jobs == 0) {
+    idle.notify_all();
+  }
+}
@@ -0,0 +1,187 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+// Search.h
+//
+// Finds every match of a literal pattern or a Regex in a snapshot of a
+// Buffer's text, in the background, so that editing and drawing go on
+// while a large file is searched.
+// The text is cut into chunks that are scanned on the shared
+// Thread_pool. The chunks in view are scanned first, at once, then the
+// rest in order onward from there, so results come in where they are
+// wanted soonest, and can be used as they do.
+// A regex is matched a line at a time, so each chunk takes the lines
+// that start in it.
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Piece_table.h"
+#include "Regex.h"
+
+class Search {
+  public:
+    using size_type = Piece_table::size_type;
+    using Match = Regex::Match;
+
+    // what a lookup among the matches came to.
+    enum class Result {
+      found,    // there is a match
+      none,     // there is no match anywhere
+      pending   // not known until more of the text has been scanned
+    };
+
+    // constructor:
+    // starts looking for pattern_ in text_, as a Regex if regex_.
+    // the chunks holding [first, last), e.g. the lines in view, are
+    // scanned before this returns; the rest follow in the background,
+    // going forward from there if forward, otherwise backward, and
+    // wrapping around.
+    // a regex that does not compile matches nothing; error() says why.
+    Search(Piece_table::Snapshot text_, const std::string &pattern_,
+           size_type first, size_type last, bool forward = true,
+           bool regex_ = false);
+
+    // stops the search, waiting for chunks being scanned.
+    ~Search();
+
+    Search(const Search &) = delete;
+    Search &operator=(const Search &) = delete;
+
+    // what is being looked for.
+    const std::string &pattern() const;
+
+    // why the pattern is not a valid regex; empty if it is, or is not
+    // a regex.
+    const std::string &error() const;
+
+    // if the whole text has been scanned.
+    bool done() const;
+
+    // number of chunks scanned so far.
+    // when it changes, there may be new matches.
+    size_type progress() const;
+
+    // number of matches found so far.
+    size_type count() const;
+
+    // first match starting at or after pos, wrapping around to the
+    // start.
+    Result next(size_type pos, Match &found) const;
+
+    // last match starting before pos, wrapping around to the end.
+    Result previous(size_type pos, Match &found) const;
+
+    // append every match found so far that overlaps [first, last) to
+    // out, in order.
+    void matches(size_type first, size_type last,
+                 std::vector<Match> &out) const;
+
+    // number of characters scanned by each job.
+    static const size_type chunk_size = 1 << 20;
+
+  private:
+    // part of the text, scanned as one job.
+    struct Chunk {
+      Chunk();
+
+      // matches the chunk holds, in order: those starting in it, or,
+      // for a regex, on the lines starting in it.
+      // written once, before scanned is set.
+      std::vector<Match> found;
+
+      // start of the first line starting in the chunk, for a regex;
+      // npos if none does. the chunk's start for a literal pattern.
+      size_type lines_from;
+
+      std::atomic<bool> scanned;
+    };
+
+    // chunk holding pos. the last one for the end of the text.
+    size_type chunk_of(size_type pos) const;
+
+    // set owner to the chunk holding the matches that start at pos.
+    // false if that is not known yet: owner is then a chunk before it
+    // that has yet to be scanned.
+    bool owner_of(size_type pos, size_type &owner) const;
+
+    // scan chunk number i, unless the search was stopped.
+    void scan(size_type i);
+
+    // scan chunk c, which starts at begin, for the literal pattern.
+    void scan_literal(Chunk &c, size_type begin);
+
+    // scan the lines starting in chunk c, which starts at begin, for
+    // the regex.
+    void scan_regex(Chunk &c, size_type begin);
+
+    // position of the first newline in [pos, last), or last.
+    size_type find_newline(size_type pos, size_type last) const;
+
+    // record that a background job has finished.
+    void finish_job();
+
+    Piece_table::Snapshot text;
+    std::string what;
+
+    // the pattern compiled, if it is a regex. shared by every job,
+    // each of which matches it with a Matcher of its own.
+    std::unique_ptr<Regex> regex;
+
+    size_type num_chunks;
+    std::unique_ptr<Chunk[]> chunks;
+
+    std::atomic<size_type> num_scanned;
+    std::atomic<size_type> num_found;
+
+    // longest match found so far.
+    std::atomic<size_type> longest;
+
+    // set by the destructor to skip unstarted chunks.
+    std::atomic<bool> cancelled;
+
+    // jobs queued or running, guarded by lock.
+    size_type jobs;
+    std::mutex lock;
+    std::condition_variable idle;
+};
+
+// inline function definitions
+
+// what is being looked for.
+inline const std::string &Search::pattern() const
+{
+  return what;
+}
+
+// why the pattern is not a valid regex; empty if it is, or is not a
+// regex.
+inline const std::string &Search::error() const
+{
+  static const std::string none;
+  return regex ? regex->error() : none;
+}
+
+// if the whole text has been scanned.
+inline bool Search::done() const
+{
+  return progress() == num_chunks;
+}
+
+// number of chunks scanned so far.
+inline Search::size_type Search::progress() const
+{
+  return num_scanned.load(std::memory_order_acquire);
+}
+
+// number of matches found so far.
+inline Search::size_type Search::count() const
+{
+  return num_found.load(std::memory_order_relaxed);
+}
+
+#endif /* SEARCH_H */
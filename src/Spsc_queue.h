@@ -0,0 +1,109 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+// Spsc_queue.h
+//
+// Fixed-size queue between exactly one thread that pushes and one that
+// pops, without locks.
+// Items live in a ring. The pushing thread alone moves the tail and
+// the popping thread alone moves the head, so each only has to see the
+// other's index to know how full the ring is: an item is written before
+// the tail is moved past it, and read before the head is.
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+template <typename T>
+class Spsc_queue {
+  public:
+    // constructor:
+    // room for at least capacity items.
+    explicit Spsc_queue(std::size_t capacity);
+
+    Spsc_queue(const Spsc_queue &) = delete;
+    Spsc_queue &operator=(const Spsc_queue &) = delete;
+
+    // add item at the tail. pushing thread only.
+    // returns false, leaving item alone, if the queue is full.
+    bool push(T &&item);
+
+    // take the item at the head. popping thread only.
+    // returns false if the queue is empty.
+    bool pop(T &item);
+
+    // if there is nothing to pop. exact only on the popping thread.
+    bool empty() const;
+
+  private:
+    // bytes in a cache line, on the processors the editor runs on.
+    static const std::size_t cache_line = 64;
+
+    std::vector<T> items;
+    std::size_t mask;
+
+    // next item to pop and next slot to push into, counted from the
+    // start and wrapped by mask. padded apart, so that the threads do
+    // not fight over a cache line: alignas would do it too, but new
+    // does not honour extended alignment before C++17.
+    char pad_before[cache_line];
+    std::atomic<std::size_t> head;
+    char pad_between[cache_line];
+    std::atomic<std::size_t> tail;
+    char pad_after[cache_line];
+};
+
+// inline function definitions
+
+// constructor:
+// room for at least capacity items.
+// the ring is a power of two in size, so that wrapping is a mask.
+template <typename T>
+Spsc_queue<T>::Spsc_queue(std::size_t capacity) : head(0), tail(0)
+{
+  std::size_t size = 1;
+  while (size < capacity) {
+    size *= 2;
+  }
+  items.resize(size);
+  mask = size - 1;
+}
+
+// add item at the tail. pushing thread only.
+// returns false, leaving item alone, if the queue is full.
+template <typename T>
+bool Spsc_queue<T>::push(T &&item)
+{
+  auto at = tail.load(std::memory_order_relaxed);
+  if (at - head.load(std::memory_order_acquire) == items.size()) {
+    return false;
+  }
+  items[at & mask] = std::move(item);
+  tail.store(at + 1, std::memory_order_release);
+  return true;
+}
+
+// take the item at the head. popping thread only.
+// returns false if the queue is empty.
+template <typename T>
+bool Spsc_queue<T>::pop(T &item)
+{
+  auto at = head.load(std::memory_order_relaxed);
+  if (at == tail.load(std::memory_order_acquire)) {
+    return false;
+  }
+  item = std::move(items[at & mask]);
+  head.store(at + 1, std::memory_order_release);
+  return true;
+}
+
+// if there is nothing to pop. exact only on the popping thread.
+template <typename T>
+bool Spsc_queue<T>::empty() const
+{
+  return head.load(std::memory_order_relaxed) ==
+         tail.load(std::memory_order_acquire);
+}
+
+#endif /* SPSC_QUEUE_H */
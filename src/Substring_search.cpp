@@ -0,0 +1,201 @@
+// Substring_search.cpp
+//
+// Fast searches for a literal pattern in raw text.
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SUBSTRING_SEARCH_X86
+#endif
+
+#include "Substring_search.h"
+
+namespace substring_search {
+
+namespace {
+
+const size_type npos = std::string::npos;
+
+// one implementation: finds occurrences of pattern[0, m) in
+// text[0, length). with out, appends every one to it and returns
+// npos; without, returns the first.
+using Scan = size_type (*)(const char *text, size_type length,
+                           const char *pattern, size_type m,
+                           std::vector<size_type> *out);
+
+// implementation and its name.
+struct Searcher {
+  const char *name;
+  Scan scan;
+};
+
+// byte-at-a-time version, also used for the ragged ends of the
+// vectorized ones: occurrences starting at or after from.
+// memchr is already vectorized by the C library.
+size_type scan_scalar(const char *text, size_type length,
+                      const char *pattern, size_type m,
+                      std::vector<size_type> *out, size_type from)
+{
+  if (m == 0 || m > length) {
+    return npos;
+  }
+  const char *p = text + from;
+  const char *end = text + length - m + 1;
+  while (p < end) {
+    p = static_cast<const char *>(std::memchr(p, pattern[0], end - p));
+    if (p == nullptr) {
+      break;
+    }
+    if (std::memcmp(p + 1, pattern + 1, m - 1) == 0) {
+      if (out == nullptr) {
+        return p - text;
+      }
+      out->push_back(p - text);
+    }
+    ++p;
+  }
+  return npos;
+}
+
+size_type scan_plain(const char *text, size_type length,
+                     const char *pattern, size_type m,
+                     std::vector<size_type> *out)
+{
+  return scan_scalar(text, length, pattern, m, out, 0);
+}
+
+#ifdef SUBSTRING_SEARCH_X86
+
+// check the candidates in mask, a bit per position from base, against
+// the middle of the pattern. returns the first match if out is null.
+inline size_type check_mask(std::uint32_t mask, const char *text,
+                            size_type base, const char *pattern,
+                            size_type m, std::vector<size_type> *out)
+{
+  while (mask != 0) {
+    size_type i = base + __builtin_ctz(mask);
+    // the first and last characters already match.
+    if (m <= 2 || std::memcmp(text + i + 1, pattern + 1, m - 2) == 0) {
+      if (out == nullptr) {
+        return i;
+      }
+      out->push_back(i);
+    }
+    mask &= mask - 1;
+  }
+  return npos;
+}
+
+__attribute__((target("sse2")))
+size_type scan_sse2(const char *text, size_type length,
+                    const char *pattern, size_type m,
+                    std::vector<size_type> *out)
+{
+  if (m == 0 || m > length) {
+    return npos;
+  }
+  const __m128i first = _mm_set1_epi8(pattern[0]);
+  const __m128i last = _mm_set1_epi8(pattern[m - 1]);
+  size_type i = 0;
+  // the block of candidates at i ends its last comparison at
+  // i + m - 1 + 16.
+  for (; i + m - 1 + 16 <= length; i += 16) {
+    __m128i heads =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + i));
+    __m128i tails =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + i + m - 1));
+    std::uint32_t mask = _mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(heads, first),
+                      _mm_cmpeq_epi8(tails, last)));
+    size_type found = check_mask(mask, text, i, pattern, m, out);
+    if (found != npos) {
+      return found;
+    }
+  }
+  return scan_scalar(text, length, pattern, m, out, i);
+}
+
+__attribute__((target("avx2")))
+size_type scan_avx2(const char *text, size_type length,
+                    const char *pattern, size_type m,
+                    std::vector<size_type> *out)
+{
+  if (m == 0 || m > length) {
+    return npos;
+  }
+  const __m256i first = _mm256_set1_epi8(pattern[0]);
+  const __m256i last = _mm256_set1_epi8(pattern[m - 1]);
+  size_type i = 0;
+  for (; i + m - 1 + 32 <= length; i += 32) {
+    __m256i heads =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text + i));
+    __m256i tails = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i *>(text + i + m - 1));
+    std::uint32_t mask = _mm256_movemask_epi8(
+        _mm256_and_si256(_mm256_cmpeq_epi8(heads, first),
+                         _mm256_cmpeq_epi8(tails, last)));
+    size_type found = check_mask(mask, text, i, pattern, m, out);
+    if (found != npos) {
+      return found;
+    }
+  }
+  return scan_scalar(text, length, pattern, m, out, i);
+}
+
+#endif /* SUBSTRING_SEARCH_X86 */
+
+// best implementation this processor supports.
+Searcher choose()
+{
+#ifdef SUBSTRING_SEARCH_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    Searcher s = { "avx2", scan_avx2 };
+    return s;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    Searcher s = { "sse2", scan_sse2 };
+    return s;
+  }
+#endif /* SUBSTRING_SEARCH_X86 */
+  Searcher s = { "scalar", scan_plain };
+  return s;
+}
+
+// implementation in use, chosen on first call.
+const Searcher &searcher()
+{
+  static const Searcher chosen = choose();
+  return chosen;
+}
+
+}
+
+// append the offset of every occurrence of pattern[0, pattern_length)
+// in text[0, length) to out, in order.
+void find_all(const char *text, size_type length,
+              const char *pattern, size_type pattern_length,
+              std::vector<size_type> &out)
+{
+  searcher().scan(text, length, pattern, pattern_length, &out);
+}
+
+// offset of the first occurrence of pattern[0, pattern_length) in
+// text[0, length).
+size_type find_first(const char *text, size_type length,
+                     const char *pattern, size_type pattern_length)
+{
+  return searcher().scan(text, length, pattern, pattern_length, nullptr);
+}
+
+// name of the implementation in use.
+const char *implementation()
+{
+  return searcher().name;
+}
+
+}
@@ -0,0 +1,37 @@
+#ifndef SUBSTRING_SEARCH_H
+#define SUBSTRING_SEARCH_H
+
+// Substring_search.h
+//
+// Fast searches for a literal pattern in raw text.
+// Candidates are found a block at a time by comparing every position
+// with the pattern's first and last characters at once, using AVX2 or
+// SSE2 when the processor has them, chosen once at runtime; only
+// positions where both agree are compared in full.
+
+#include <string>
+#include <vector>
+
+namespace substring_search {
+
+using size_type = std::string::size_type;
+
+// append the offset of every occurrence of pattern[0, pattern_length)
+// in text[0, length) to out, in order. occurrences may overlap.
+// an empty pattern occurs nowhere.
+void find_all(const char *text, size_type length,
+              const char *pattern, size_type pattern_length,
+              std::vector<size_type> &out);
+
+// offset of the first occurrence of pattern[0, pattern_length) in
+// text[0, length).
+// std::string::npos if there is none.
+size_type find_first(const char *text, size_type length,
+                     const char *pattern, size_type pattern_length);
+
+// name of the implementation in use: "avx2", "sse2" or "scalar".
+const char *implementation();
+
+}
+
+#endif /* SUBSTRING_SEARCH_H */
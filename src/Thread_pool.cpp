@@ -0,0 +1,76 @@
+// Thread_pool.cpp
+//
+// Fixed set of worker threads that run submitted jobs in order.
+
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "Thread_pool.h"
+
+// constructor:
+// starts the given number of workers (at least one).
+Thread_pool::Thread_pool(unsigned num_threads) : stopping(false)
+{
+  if (num_threads == 0) {
+    num_threads = 1;
+  }
+  for (unsigned i = 0; i < num_threads; ++i) {
+    workers.emplace_back(&Thread_pool::work, this);
+  }
+}
+
+// finishes every queued job, then stops the workers.
+Thread_pool::~Thread_pool()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+// queue a job to run on some worker.
+void Thread_pool::submit(std::function<void()> job)
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    jobs.push_back(std::move(job));
+  }
+  wake.notify_one();
+}
+
+// number of workers.
+unsigned Thread_pool::size() const
+{
+  return workers.size();
+}
+
+// pool shared by the whole editor, one worker per processor.
+Thread_pool &Thread_pool::shared()
+{
+  static Thread_pool pool(std::thread::hardware_concurrency());
+  return pool;
+}
+
+// run jobs until stopped.
+void Thread_pool::work()
+{
+  for (;;) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      wake.wait(guard, [this] { return stopping || !jobs.empty(); });
+      if (jobs.empty()) {
+        return;
+      }
+      job = std::move(jobs.front());
+      jobs.pop_front();
+    }
+    job();
+  }
+}
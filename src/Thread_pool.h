@@ -0,0 +1,47 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+// Thread_pool.h
+//
+// Fixed set of worker threads that run submitted jobs in order.
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class Thread_pool {
+  public:
+    // constructor:
+    // starts the given number of workers (at least one).
+    explicit Thread_pool(unsigned num_threads);
+
+    // finishes every queued job, then stops the workers.
+    ~Thread_pool();
+
+    Thread_pool(const Thread_pool &) = delete;
+    Thread_pool &operator=(const Thread_pool &) = delete;
+
+    // queue a job to run on some worker.
+    void submit(std::function<void()> job);
+
+    // number of workers.
+    unsigned size() const;
+
+    // pool shared by the whole editor, one worker per processor.
+    static Thread_pool &shared();
+
+  private:
+    // run jobs until stopped.
+    void work();
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stopping;
+};
+
+#endif /* THREAD_POOL_H */
@@ -0,0 +1,129 @@
+// Timer_wheel.cpp
+//
+// Callbacks to run after a delay, for a single thread that checks on
+// them now and then.
+
+#include <algorithm>
+#include <utility>
+
+#include "Timer_wheel.h"
+
+const int Timer_wheel::tick_ms;
+const int Timer_wheel::num_slots;
+
+// constructor:
+// no timers; ticks are counted from now.
+Timer_wheel::Timer_wheel(Clock::time_point now /* = Clock::now() */) :
+  origin(now), current(0), slots(num_slots), next_id(1)
+{
+  // empty
+}
+
+// run callback once, at least ms milliseconds after now.
+// returns an ID to cancel it by, never 0.
+// a timer is never due on a tick already gone by.
+int Timer_wheel::add(int ms, Callback callback,
+                     Clock::time_point now /* = Clock::now() */)
+{
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      now - origin).count();
+  long long tick = (elapsed + std::max(ms, 0) + tick_ms - 1) / tick_ms;
+  tick = std::max(tick, current + 1);
+  int id = next_id++;
+  if (next_id <= 0) {
+    next_id = 1;
+  }
+  slot_of(tick).push_back(Timer{ id, tick, std::move(callback) });
+  due[id] = tick;
+  return id;
+}
+
+// stop the timer with the given ID from running.
+// returns false if it has run or been cancelled already.
+bool Timer_wheel::cancel(int id)
+{
+  auto found = due.find(id);
+  if (found == due.end()) {
+    return false;
+  }
+  auto &slot = slot_of(found->second);
+  slot.erase(std::find_if(slot.begin(), slot.end(),
+                          [id](const Timer &t) { return t.id == id; }));
+  due.erase(found);
+  return true;
+}
+
+// run every timer due by now, in the order they are due.
+// callbacks may add and cancel timers.
+// returns the number run.
+// the timers are taken out of the wheel before any of them runs.
+int Timer_wheel::advance(Clock::time_point now /* = Clock::now() */)
+{
+  long long target = tick_of(now);
+  if (target <= current) {
+    return 0;
+  }
+  // more than a turn: every slot may have timers due.
+  long long first = std::max(current + 1, target - num_slots + 1);
+  std::vector<Timer> ready;
+  for (long long tick = first; tick <= target; ++tick) {
+    auto &slot = slot_of(tick);
+    auto kept = std::partition(slot.begin(), slot.end(),
+                               [target](const Timer &t) {
+                                 return t.tick > target;
+                               });
+    for (auto it = kept; it != slot.end(); ++it) {
+      due.erase(it->id);
+      ready.push_back(std::move(*it));
+    }
+    slot.erase(kept, slot.end());
+  }
+  current = target;
+
+  std::stable_sort(ready.begin(), ready.end(),
+                   [](const Timer &a, const Timer &b) {
+                     return a.tick < b.tick ||
+                            (a.tick == b.tick && a.id < b.id);
+                   });
+  for (auto &timer : ready) {
+    timer.callback();
+  }
+  return static_cast<int>(ready.size());
+}
+
+// milliseconds from now until the next timer is due, 0 if one is
+// overdue, or -1 if there are none.
+// the slots of the next turn are looked at first; timers further off
+// than that are all looked at.
+int Timer_wheel::next_due(Clock::time_point now /* = Clock::now() */) const
+{
+  if (due.empty()) {
+    return -1;
+  }
+  long long next = -1;
+  for (long long tick = current + 1; tick <= current + num_slots; ++tick) {
+    for (auto &timer : slots[tick % num_slots]) {
+      if (timer.tick == tick) {
+        next = tick;
+        break;
+      }
+    }
+    if (next >= 0) {
+      break;
+    }
+  }
+  if (next < 0) {
+    for (auto &entry : due) {
+      if (next < 0 || entry.second < next) {
+        next = entry.second;
+      }
+    }
+  }
+  auto at = origin + std::chrono::milliseconds(next * tick_ms);
+  if (at <= now) {
+    return 0;
+  }
+  auto wait = std::chrono::duration_cast<std::chrono::microseconds>(
+      at - now).count();
+  return static_cast<int>((wait + 999) / 1000);
+}
@@ -0,0 +1,98 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+// Timer_wheel.h
+//
+// Callbacks to run after a delay, for a single thread that checks on
+// them now and then.
+// Time is counted in ticks, and a timer goes in the slot of the tick it
+// is due on, wrapping around the wheel: adding and cancelling a timer
+// touch one slot, and going on a tick looks at one slot, however many
+// timers there are. Timers due further off than a turn of the wheel
+// share slots with nearer ones and wait for their turn.
+
+#include <chrono>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+class Timer_wheel {
+  public:
+    using Clock = std::chrono::steady_clock;
+    using Callback = std::function<void()>;
+
+    // constructor:
+    // no timers; ticks are counted from now.
+    explicit Timer_wheel(Clock::time_point now = Clock::now());
+
+    // run callback once, at least ms milliseconds after now.
+    // returns an ID to cancel it by, never 0.
+    int add(int ms, Callback callback, Clock::time_point now = Clock::now());
+
+    // stop the timer with the given ID from running.
+    // returns false if it has run or been cancelled already.
+    bool cancel(int id);
+
+    // run every timer due by now, in the order they are due.
+    // callbacks may add and cancel timers.
+    // returns the number run.
+    int advance(Clock::time_point now = Clock::now());
+
+    // milliseconds from now until the next timer is due, 0 if one is
+    // overdue, or -1 if there are none.
+    int next_due(Clock::time_point now = Clock::now()) const;
+
+    // if there are no timers waiting.
+    bool empty() const;
+
+    // milliseconds in a tick, and ticks in a turn of the wheel.
+    static const int tick_ms = 10;
+    static const int num_slots = 256;
+
+  private:
+    struct Timer {
+      int id;
+      long long tick;
+      Callback callback;
+    };
+
+    // tick that now falls in.
+    long long tick_of(Clock::time_point now) const;
+
+    // slot timers due on tick go in.
+    std::vector<Timer> &slot_of(long long tick);
+
+    Clock::time_point origin;
+
+    // last tick whose timers have been run.
+    long long current;
+
+    std::vector<std::vector<Timer>> slots;
+
+    // tick each timer waiting is due on, by ID.
+    std::unordered_map<int, long long> due;
+    int next_id;
+};
+
+// inline function definitions
+
+// if there are no timers waiting.
+inline bool Timer_wheel::empty() const
+{
+  return due.empty();
+}
+
+// tick that now falls in.
+inline long long Timer_wheel::tick_of(Clock::time_point now) const
+{
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      now - origin).count() / tick_ms;
+}
+
+// slot timers due on tick go in.
+inline std::vector<Timer_wheel::Timer> &Timer_wheel::slot_of(long long tick)
+{
+  return slots[tick % num_slots];
+}
+
+#endif /* TIMER_WHEEL_H */
@@ -0,0 +1,269 @@
+// Undo_history.cpp
+//
+// Edits made to a Buffer, kept so that they can be undone and redone.
+
+#include <utility>
+
+#include "Undo_history.h"
+#include "Log.h"
+
+namespace {
+
+using Piece = Piece_table::Piece;
+using Piece_list = Piece_table::Piece_list;
+
+// if b carries on from the end of a in the same buffer.
+inline bool continues(const Piece &a, const Piece &b)
+{
+  return a.source == b.source && a.start + a.length == b.start;
+}
+
+// total characters in pieces.
+Piece_table::size_type length(const Piece_list &pieces)
+{
+  Piece_table::size_type n = 0;
+  for (const auto &p : pieces) {
+    n += p.length;
+  }
+  return n;
+}
+
+// append the pieces of from to to, joining pieces that carry on from
+// one another, as a run of deletes leaves them.
+void join(Piece_list &to, const Piece_list &from)
+{
+  for (const auto &p : from) {
+    if (!to.empty() && continues(to.back(), p)) {
+      to.back().length += p.length;
+      to.back().newlines += p.newlines;
+    } else {
+      to.push_back(p);
+    }
+  }
+}
+
+}
+
+const std::size_t Undo_history::default_budget;
+
+Undo_history::Edit::Edit(Arena &arena) :
+  offset(0), removed(Arena_allocator<Piece>(&arena)), inserted(0)
+{
+  // empty
+}
+
+Undo_history::Step::Step(Arena &arena) :
+  kind(Kind::other), cursor(0),
+  edits(Arena_allocator<Edit>(&arena)), bytes(0)
+{
+  // empty
+}
+
+// constructor:
+// allocates from the given arena, keeping about budget_ bytes of
+// history.
+Undo_history::Undo_history(Arena &arena_,
+                           std::size_t budget_ /* = default_budget */) :
+  arena(arena_), open(false), groups(0), group_started(false),
+  budget(budget_), total(0)
+{
+  // empty
+}
+
+// record an edit made with the cursor at cursor: inserted
+// characters now replace the removed pieces at offset.
+// merges into the last step if it continues a run of its kind.
+// forgets everything that could be redone.
+void Undo_history::record(Kind kind, size_type cursor, size_type offset,
+                          Piece_list &&removed, size_type inserted)
+{
+  if (removed.empty() && inserted == 0) {
+    return;
+  }
+  for (auto &step : undone) {
+    total -= step.bytes;
+  }
+  undone.clear();
+
+  bool grow;
+  if (groups > 0) {
+    grow = group_started;
+    group_started = true;
+  } else {
+    grow = open && done.back().kind == kind && kind != Kind::other;
+  }
+  Step *step = grow ? &done.back() : nullptr;
+  if (step == nullptr ||
+      !extend(step->edits.back(), kind, offset, removed, inserted)) {
+    if (step == nullptr || groups == 0) {
+      done.emplace_back(arena);
+      step = &done.back();
+      step->kind = kind;
+      step->cursor = cursor;
+    }
+    step->edits.emplace_back(arena);
+    Edit &e = step->edits.back();
+    e.offset = offset;
+    e.removed = std::move(removed);
+    e.inserted = inserted;
+  }
+  open = true;
+  recount(*step);
+  trim();
+}
+
+// start a compound command: every edit recorded until the matching
+// end_group is a single step. groups may nest.
+void Undo_history::begin_group()
+{
+  if (groups++ == 0) {
+    seal();
+    group_started = false;
+  }
+}
+
+// end a compound command.
+void Undo_history::end_group()
+{
+  if (groups > 0 && --groups == 0) {
+    seal();
+  }
+}
+
+// stop the last step from growing, so the next edit starts a new one.
+// its lists are trimmed to size, now that they are done growing.
+void Undo_history::seal()
+{
+  if (open && groups == 0) {
+    for (auto &e : done.back().edits) {
+      e.removed.shrink_to_fit();
+    }
+    recount(done.back());
+  }
+  open = false;
+}
+
+// undo the last step on text, telling changed of each change.
+// returns false if there is none. otherwise sets cursor to where
+// it was before the step.
+bool Undo_history::undo(Piece_table &text, size_type &cursor,
+                        const Changed &changed)
+{
+  seal();
+  if (done.empty()) {
+    return false;
+  }
+  LOG_TRACE("undoing a step of {} edits", done.back().edits.size());
+  undone.push_back(std::move(done.back()));
+  done.pop_back();
+  Step &step = undone.back();
+  // later edits were made on the text the earlier ones left.
+  for (auto e = step.edits.rbegin(); e != step.edits.rend(); ++e) {
+    apply(text, *e, changed);
+  }
+  cursor = step.cursor;
+  recount(step);
+  return true;
+}
+
+// redo the last step undone on text, telling changed of each change.
+// returns false if there is none. otherwise sets cursor to the end
+// of the step's last edit.
+bool Undo_history::redo(Piece_table &text, size_type &cursor,
+                        const Changed &changed)
+{
+  seal();
+  if (undone.empty()) {
+    return false;
+  }
+  LOG_TRACE("redoing a step of {} edits", undone.back().edits.size());
+  done.push_back(std::move(undone.back()));
+  undone.pop_back();
+  Step &step = done.back();
+  for (auto &e : step.edits) {
+    apply(text, e, changed);
+    // e now undoes the redone edit, so it would take back what that
+    // inserted.
+    cursor = e.offset + e.inserted;
+  }
+  recount(step);
+  return true;
+}
+
+// keep about bytes of history, forgetting the oldest steps.
+// the newest step is always kept.
+void Undo_history::set_budget(std::size_t bytes)
+{
+  budget = bytes;
+  trim();
+}
+
+// replace e's inserted characters in text with its removed pieces,
+// and make e the edit that reverses that.
+void Undo_history::apply(Piece_table &text, Edit &e,
+                         const Changed &changed)
+{
+  Piece_list taken{ Arena_allocator<Piece>(&arena) };
+  text.erase(e.offset, e.inserted, &taken);
+  text.insert(e.offset, e.removed);
+  changed(e.offset, e.inserted, length(e.removed));
+  e.inserted = length(e.removed);
+  e.removed = std::move(taken);
+}
+
+// merge the edit into e if it continues a run of typing or deleting.
+// returns false if it does not.
+bool Undo_history::extend(Edit &e, Kind kind, size_type offset,
+                          Piece_list &removed, size_type inserted)
+{
+  if (kind == Kind::typing) {
+    // typing on from the end of what e inserted.
+    if (!removed.empty() || offset != e.offset + e.inserted) {
+      return false;
+    }
+    e.inserted += inserted;
+    return true;
+  }
+  if (kind == Kind::deleting && inserted == 0 && e.inserted == 0) {
+    if (offset == e.offset) {
+      // deleting forward: the text removed follows e's.
+      join(e.removed, removed);
+      return true;
+    }
+    if (offset + length(removed) == e.offset) {
+      // backspacing: the text removed precedes e's.
+      join(removed, e.removed);
+      e.removed = std::move(removed);
+      e.offset = offset;
+      return true;
+    }
+  }
+  return false;
+}
+
+// count the bytes step keeps, updating total.
+void Undo_history::recount(Step &step)
+{
+  total -= step.bytes;
+  step.bytes = sizeof(Step) + step.edits.capacity() * sizeof(Edit);
+  for (const auto &e : step.edits) {
+    step.bytes += e.removed.capacity() * sizeof(Piece);
+  }
+  total += step.bytes;
+}
+
+// forget the oldest steps until the history is within budget.
+// steps that could be redone go first, furthest first, then those that
+// could be undone, oldest first.
+void Undo_history::trim()
+{
+  while (total > budget && !undone.empty()) {
+    total -= undone.front().bytes;
+    undone.pop_front();
+  }
+  while (total > budget && done.size() > 1) {
+    LOG_TRACE("undo history over budget: forgetting a step");
+    total -= done.front().bytes;
+    done.pop_front();
+  }
+}
@@ -0,0 +1,161 @@
+#ifndef UNDO_HISTORY_H
+#define UNDO_HISTORY_H
+
+// Undo_history.h
+//
+// Edits made to a Buffer, kept so that they can be undone and redone.
+// Each edit is stored as its inverse: where it was, how much it
+// inserted, and the pieces of text it removed. Pieces refer to text
+// that never changes, so undoing or redoing an edit costs time and
+// memory in proportion to the number of pieces it touched, however
+// many characters they hold.
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include "Arena.h"
+#include "Piece_table.h"
+
+class Undo_history {
+  public:
+    using size_type = Piece_table::size_type;
+    using Piece_list = Piece_table::Piece_list;
+
+    // told of each change undo or redo makes, as it is made: at
+    // offset, removed characters were replaced by inserted ones.
+    using Changed = std::function<void(size_type offset, size_type removed,
+                                       size_type inserted)>;
+
+    // kinds of edit. runs of typing or deleting at one place are
+    // grouped into a single step; other edits are steps of their own.
+    enum class Kind { typing, deleting, other };
+
+    // one change to the text: at offset, inserted characters replaced
+    // the removed pieces.
+    struct Edit {
+      explicit Edit(Arena &arena);
+
+      size_type offset;
+      Piece_list removed;
+      size_type inserted;
+    };
+
+    // constructor:
+    // allocates from the given arena, keeping about budget_ bytes of
+    // history.
+    explicit Undo_history(Arena &arena_,
+                          std::size_t budget_ = default_budget);
+
+    Undo_history(const Undo_history &) = delete;
+    Undo_history &operator=(const Undo_history &) = delete;
+
+    // record an edit made with the cursor at cursor: inserted
+    // characters now replace the removed pieces at offset.
+    // merges into the last step if it continues a run of its kind.
+    // forgets everything that could be redone.
+    void record(Kind kind, size_type cursor, size_type offset,
+                Piece_list &&removed, size_type inserted);
+
+    // start a compound command: every edit recorded until the matching
+    // end_group is a single step. groups may nest.
+    void begin_group();
+
+    // end a compound command.
+    void end_group();
+
+    // stop the last step from growing, so the next edit starts a new
+    // one.
+    void seal();
+
+    // undo the last step on text, telling changed of each change.
+    // returns false if there is none. otherwise sets cursor to where
+    // it was before the step.
+    bool undo(Piece_table &text, size_type &cursor, const Changed &changed);
+
+    // redo the last step undone on text, telling changed of each change.
+    // returns false if there is none. otherwise sets cursor to the end
+    // of the step's last edit.
+    bool redo(Piece_table &text, size_type &cursor, const Changed &changed);
+
+    // keep about bytes of history, forgetting the oldest steps.
+    // the newest step is always kept.
+    void set_budget(std::size_t bytes);
+
+    // bytes of history kept.
+    std::size_t size() const;
+
+    // number of steps that can be undone and redone.
+    size_type undo_steps() const;
+    size_type redo_steps() const;
+
+    // history kept when none is asked for.
+    static const std::size_t default_budget = 4 << 20;
+
+  private:
+    // edits undone or redone together, in the order they were made.
+    struct Step {
+      explicit Step(Arena &arena);
+
+      Kind kind;
+      // where the cursor was before the first edit.
+      size_type cursor;
+      std::vector<Edit, Arena_allocator<Edit>> edits;
+      // bytes this step keeps, as last counted.
+      std::size_t bytes;
+    };
+
+    // replace e's inserted characters in text with its removed pieces,
+    // and make e the edit that reverses that.
+    void apply(Piece_table &text, Edit &e, const Changed &changed);
+
+    // merge the edit into e if it continues a run of typing or deleting.
+    // returns false if it does not.
+    static bool extend(Edit &e, Kind kind, size_type offset,
+                       Piece_list &removed, size_type inserted);
+
+    // count the bytes step keeps, updating total.
+    void recount(Step &step);
+
+    // forget the oldest steps until the history is within budget.
+    void trim();
+
+    Arena &arena;
+
+    std::deque<Step> undone;
+    std::deque<Step> done;
+
+    // if the last done step may still grow.
+    bool open;
+
+    // depth of begin_group calls, and whether the outermost group has
+    // made its step yet.
+    int groups;
+    bool group_started;
+
+    std::size_t budget;
+    std::size_t total;
+};
+
+// inline function definitions
+
+// bytes of history kept.
+inline std::size_t Undo_history::size() const
+{
+  return total;
+}
+
+// number of steps that can be undone.
+inline Undo_history::size_type Undo_history::undo_steps() const
+{
+  return done.size();
+}
+
+// number of steps that can be redone.
+inline Undo_history::size_type Undo_history::redo_steps() const
+{
+  return undone.size();
+}
+
+#endif /* UNDO_HISTORY_H */
@@ -0,0 +1,239 @@
+// Vt_backend.cpp
+//
+// Draws on the terminal by writing VT100/xterm escape sequences itself.
+
+#include <cerrno>
+#include <cstring>
+
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <ncurses.h>
+#include <term.h>
+
+#include "Vt_backend.h"
+#include "Log.h"
+
+const std::string::size_type Vt_backend::initial_capacity;
+
+namespace {
+
+// enter and leave the alternate screen, clearing it.
+const char enter_screen[] = "\033[?1049h\033[H\033[2J";
+const char leave_screen[] = "\033[?1049l";
+
+// start and end a synchronized update, hiding the cursor meanwhile.
+const char frame_start[] = "\033[?2026h\033[?25l";
+const char frame_end[] = "\033[?25h\033[?2026l";
+
+const char reverse_on[] = "\033[7m";
+const char reverse_off[] = "\033[27m";
+const char clear_all[] = "\033[2J";
+
+// the length of a string literal.
+template <std::size_t N>
+constexpr std::string::size_type length_of(const char (&)[N])
+{
+  return N - 1;
+}
+
+// what TERM starts with for terminals known to speak VT100/xterm.
+const char *const vt_terms[] = {
+  "xterm", "screen", "tmux", "rxvt", "linux", "vt1", "vt2", "alacritty",
+  "kitty", "foot", "wezterm", "st", "konsole", "gnome", "putty",
+};
+
+}
+
+// constructor:
+// takes over the terminal at fd_: input unechoed and unbuffered,
+// interrupt keys still working, drawing on the alternate screen.
+// carriage returns are read as they are, for the Key_parser to take as
+// line breaks.
+// terminfo is loaded, without touching the terminal, so that keys are
+// known by the sequences it gives them too.
+Vt_backend::Vt_backend(int fd_ /* = 1 */) :
+  fd(fd_), restore(false), in_frame(false), term_rows(24), term_cols(80),
+  cursor_y(0), cursor_x(0), at_y(-1), at_x(-1), reversed(false)
+{
+  out.reserve(initial_capacity);
+  int error;
+  if (setupterm(nullptr, fd, &error) != OK) {
+    LOG_INFO("vt backend: no terminfo for this terminal");
+  }
+  if (tcgetattr(fd, &saved) == 0) {
+    restore = true;
+    termios raw = saved;
+    raw.c_iflag &= ~(ICRNL | INLCR | IGNCR);
+    raw.c_lflag &= ~(ICANON | ECHO | IEXTEN);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(fd, TCSADRAIN, &raw);
+  }
+  size(term_rows, term_cols);
+  write_all(enter_screen, length_of(enter_screen));
+}
+
+// puts the terminal back as it was.
+Vt_backend::~Vt_backend()
+{
+  flush();
+  write_all(leave_screen, length_of(leave_screen));
+  if (restore) {
+    tcsetattr(fd, TCSADRAIN, &saved);
+  }
+}
+
+// size of the terminal, in rows and columns; 24 by 80 if it will not
+// say.
+void Vt_backend::size(int &rows, int &cols) const
+{
+  winsize window;
+  if (ioctl(fd, TIOCGWINSZ, &window) == 0 &&
+      window.ws_row > 0 && window.ws_col > 0) {
+    rows = window.ws_row;
+    cols = window.ws_col;
+  } else {
+    rows = 24;
+    cols = 80;
+  }
+}
+
+// write length cells of text at row y, column x, highlighted or not.
+// highlighted cells are shown in reverse video.
+// the cursor is only moved if the text does not follow on from what was
+// written last.
+void Vt_backend::put(int y, int x, const char *text, int length,
+                     bool highlighted)
+{
+  if (length <= 0) {
+    return;
+  }
+  begin_frame();
+  if (y != at_y || x != at_x) {
+    move_cursor(y, x);
+  }
+  if (highlighted != reversed) {
+    if (highlighted) {
+      out.append(reverse_on, length_of(reverse_on));
+    } else {
+      out.append(reverse_off, length_of(reverse_off));
+    }
+    reversed = highlighted;
+  }
+  out.append(text, length);
+  at_x += length;
+  // past the last column, terminals differ as to where the cursor is.
+  if (at_x >= term_cols) {
+    at_y = at_x = -1;
+  }
+}
+
+// where flush leaves the cursor.
+void Vt_backend::set_cursor(int y, int x)
+{
+  cursor_y = y;
+  cursor_x = x;
+}
+
+// show everything put since the last flush, at once: the frame is
+// ended, with the cursor where it is to be left, and written with one
+// write.
+// nothing is written if nothing has changed.
+void Vt_backend::flush()
+{
+  if (!in_frame && cursor_y == at_y && cursor_x == at_x) {
+    return;
+  }
+  begin_frame();
+  if (reversed) {
+    out.append(reverse_off, length_of(reverse_off));
+    reversed = false;
+  }
+  move_cursor(cursor_y, cursor_x);
+  out.append(frame_end, length_of(frame_end));
+  write_all(out.data(), out.size());
+  // clear keeps the room allocated.
+  out.clear();
+  in_frame = false;
+}
+
+// the terminal has changed size.
+// what it shows is cleared, in the next frame, along with whatever it
+// kept of it: every window is drawn again anyway.
+void Vt_backend::resize(int rows, int cols)
+{
+  term_rows = rows;
+  term_cols = cols;
+  begin_frame();
+  out.append(clear_all, length_of(clear_all));
+  at_y = at_x = -1;
+}
+
+// if a terminal of type term, as TERM names it, speaks the escape
+// sequences written here.
+bool Vt_backend::speaks(const char *term)
+{
+  if (term == nullptr) {
+    return false;
+  }
+  for (const char *known : vt_terms) {
+    if (std::strncmp(term, known, std::strlen(known)) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// start a frame in the output buffer, if there is none yet.
+void Vt_backend::begin_frame()
+{
+  if (!in_frame) {
+    out.append(frame_start, length_of(frame_start));
+    in_frame = true;
+  }
+}
+
+// add the escape sequence moving the cursor to row y, column x.
+void Vt_backend::move_cursor(int y, int x)
+{
+  out.append("\033[", 2);
+  append_number(y + 1);
+  out.push_back(';');
+  append_number(x + 1);
+  out.push_back('H');
+  at_y = y;
+  at_x = x;
+}
+
+// add n in decimal.
+void Vt_backend::append_number(int n)
+{
+  char digits[12];
+  int count = 0;
+  do {
+    digits[count++] = static_cast<char>('0' + n % 10);
+    n /= 10;
+  } while (n > 0);
+  while (count > 0) {
+    out.push_back(digits[--count]);
+  }
+}
+
+// write all of data to the terminal, however many writes it takes.
+// a terminal that has gone is given up on.
+void Vt_backend::write_all(const char *data, std::string::size_type length)
+{
+  while (length > 0) {
+    ssize_t written = write(fd, data, length);
+    if (written < 0) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+      LOG_ERROR("vt backend: cannot write to the terminal");
+      return;
+    }
+    data += written;
+    length -= written;
+  }
+}
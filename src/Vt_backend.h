@@ -0,0 +1,86 @@
+#ifndef VT_BACKEND_H
+#define VT_BACKEND_H
+
+// Vt_backend.h
+//
+// Draws on the terminal by writing VT100/xterm escape sequences itself.
+// Everything drawn between flushes is gathered in one buffer, allocated
+// up front, and each flush writes it with a single write(2). A frame is
+// wrapped in synchronized update mode, so that terminals that have it
+// show it all at once rather than as it arrives; others ignore the mode,
+// as they do every private mode they do not know, and the cursor is
+// hidden while it draws.
+
+#include <string>
+
+#include <termios.h>
+
+#include "Backend.h"
+
+class Vt_backend : public Backend {
+  public:
+    // constructor:
+    // takes over the terminal at fd_: input unechoed and unbuffered,
+    // interrupt keys still working, drawing on the alternate screen.
+    explicit Vt_backend(int fd_ = 1);
+
+    // puts the terminal back as it was.
+    ~Vt_backend() override;
+
+    Vt_backend(const Vt_backend &) = delete;
+    Vt_backend &operator=(const Vt_backend &) = delete;
+
+    void size(int &rows, int &cols) const override;
+    void put(int y, int x, const char *text, int length,
+             bool highlighted) override;
+    void set_cursor(int y, int x) override;
+    void flush() override;
+    void resize(int rows, int cols) override;
+
+    // if a terminal of type term, as TERM names it, speaks the escape
+    // sequences written here.
+    static bool speaks(const char *term);
+
+    // bytes the output buffer starts out with room for.
+    static const std::string::size_type initial_capacity = 64 * 1024;
+
+  private:
+    // start a frame in the output buffer, if there is none yet.
+    void begin_frame();
+
+    // add the escape sequence moving the cursor to row y, column x.
+    void move_cursor(int y, int x);
+
+    // add n in decimal.
+    void append_number(int n);
+
+    // write all of data to the terminal, however many writes it takes.
+    void write_all(const char *data, std::string::size_type length);
+
+    int fd;
+
+    // terminal settings to put back, if there are any.
+    termios saved;
+    bool restore;
+
+    // escape sequences and text not yet written.
+    std::string out;
+    bool in_frame;
+
+    int term_rows;
+    int term_cols;
+
+    // where flush leaves the cursor.
+    int cursor_y;
+    int cursor_x;
+
+    // where the terminal's cursor is as of what is in out; -1 if not
+    // known.
+    int at_y;
+    int at_x;
+
+    // if cells written now are shown in reverse video.
+    bool reversed;
+};
+
+#endif /* VT_BACKEND_H */
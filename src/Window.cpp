@@ -7,130 +7,935 @@
 
 #include "Window.h"
 #include "Buffer.h"
+#include "Utility.h"
 
-#ifndef NDEBUG
-#include <sstream>
-#include "Debug.h"
-#endif /* NDEBUG */
+#include "Log.h"
 
 // constructor:
-// uses given ncurses window.
+// a window of the given size with its top left corner at row top,
+// column left of the terminal, drawn by the manager's renderer.
 // shows the given buffer.
-Window::Window(Window_manager *manager_, int buff_id, WINDOW *active)
-  : manager(manager_), buffer_id(buff_id), active_window(active)
+Window::Window(Window_manager *manager_, int buff_id, int top, int left,
+               int height, int width)
+  : manager(manager_), buffer_id(buff_id),
+    screen(&manager->backend(), manager->renderer(), top, left, height,
+           width),
+    view_top(0), view_left(0),
+    shown_top(-1), shown_left(-1), switched(false),
+    own_cursor(manager->get_buffer(buff_id).cursor), closing(false),
+    status_shown(false), latency(&manager->stats()),
+    events(manager->events()), save_timer(-1), last_regex(false),
+    last_directory(".")
 {
-  // empty
+  bind_default_keys();
+}
+
+// constructor:
+// headless: a window of the given size that draws to the manager's
+// Null_backend and takes no input of its own, e.g. for benchmarks.
+Window::Window(Window_manager *manager_, int buff_id, int height, int width)
+  : manager(manager_), buffer_id(buff_id),
+    screen(&manager->backend(), nullptr, 0, 0, height, width),
+    view_top(0), view_left(0),
+    shown_top(-1), shown_left(-1), switched(false),
+    own_cursor(manager->get_buffer(buff_id).cursor), closing(false),
+    status_shown(false), latency(&manager->stats()), events(nullptr),
+    save_timer(-1), last_regex(false), last_directory(".")
+{
+  bind_default_keys();
+}
+
+// stops the timers it has running.
+Window::~Window()
+{
+  if (events != nullptr && save_timer >= 0) {
+    events->cancel_timer(save_timer);
+  }
 }
 
 // do edit mode:
-// interpret user input while updating buffer and screen.
-void Window::edit_text()
+// interpret user input while updating buffer and screen, until editing
+// stops or another window is selected.
+// edits are shown in the other windows showing the same buffer too.
+// returns true if another window was selected.
+bool Window::edit_text()
 {
   int last_key;
   bool done = false;
-  Buffer &front = manager->get_buffer(buffer_id);
-  std::unique_ptr<Buffer::Changeset> last_change(nullptr);
-#ifndef NDEBUG
-  Debug::indent();
-  Debug::log("entering editing loop");
-  Debug::indent();
-#endif /* NDEBUG */
+  // show the first screen before waiting for input, with the cursor
+  // where this window left it, if another window has moved it since.
+  Buffer &first = manager->get_buffer(buffer_id);
+  Buffer::Changeset last_change = own_cursor == first.cursor
+                                      ? first.do_redraw(0)
+                                      : first.do_goto_offset(own_cursor);
+  LOG_INDENT();
+  LOG_TRACE("entering editing loop");
+
+  update(last_change, manager->get_buffer(buffer_id));
 
   // edit until user exits session
   do {
-#ifndef NDEBUG
-    Debug::log("starting an editing iteration");
-#endif /* NDEBUG */
-    last_key = wgetch(active_window);
-#ifndef NDEBUG
-  Debug::log("got key");
-#endif /* NDEBUG */
+    LOG_TRACE("starting an editing iteration");
+    // the buffer shown changes with commands that switch buffers.
+    Buffer &front = manager->get_buffer(buffer_id);
+    // saves and finds in files running wake the loop to show how they
+    // are going.
+    last_key = read_key(-1);
+    LOG_TRACE("got key");
     if (last_key != ERR) {
-      last_change = do_keystroke(last_key, front);
-      if (last_change != nullptr) {
-        update(std::move(last_change));
+      // time from the key arriving to the screen showing what it did.
+      auto start = Latency_stats::Clock::now();
+      status.clear();
+      if (do_burst(last_key, front, last_change)) {
+        switched = false;
+        Buffer &shown = manager->get_buffer(buffer_id);
+        if (&shown == &front) {
+          manager->show_change(buffer_id, last_change, this);
+        }
+        if (closing) {
+          break;
+        }
+        auto background = background_status(shown);
+        if (!background.empty()) {
+          status = background;
+        }
+        update(last_change, shown);
+        latency->record(Latency_stats::total, Latency_stats::since(start));
       } else {
         done = true;
       }
+    } else {
+      if (manager->poll_find() && manager->is_results(buffer_id)) {
+        // results may have come in anywhere below.
+        shown_top = -1;
+      }
+      status = background_status(front);
+      update(front.do_redraw(0), front);
     }
-#ifndef NDEBUG
-    Debug::log("ending an editing iteration");
-#endif /* NDEBUG */
-  } while (!done);
-#ifndef NDEBUG
-  Debug::outdent();
-  Debug::log("exiting editing loop");
-  Debug::outdent();
-#endif /* NDEBUG */
-}
-
-// choose and execute appropriate buffer-editing function.
-// returns nullptr on ESC.
-std::unique_ptr<Buffer::Changeset>
-Window::do_keystroke(const int &key, Buffer &front)
-{
-#ifndef NDEBUG
-  Debug::indent();
-  std::stringstream ss;
-  ss << "performing keystroke for ";
-  ss << key;
-  ss << ", aka " << static_cast<char>(key);
-  Debug::log(ss.str());
-  Debug::outdent();
-#endif /* NDEBUG */
-  //TODO: change to a lookup table. Look up each key in table and if
-  //something is found then call that, otherwise use default (type it).
-  //then can probably make this inline.
-  switch(key) {
-    case KEY_UP:
-      return front.do_up();
-      break;
-    case KEY_DOWN:
-      return front.do_down();
-      break;
-    case KEY_LEFT:
-      return front.do_left();
-      break;
-    case KEY_RIGHT:
-      return front.do_right();
-      break;
-    case KEY_BACKSPACE:
-      return front.do_backspace();
-      break;
-    case KEY_DC:
-      return front.do_delete();
-      break;
-    case '\n':
-    case KEY_ENTER: // for keypad enter
-      return front.do_enter();
-      break;
-    case KEY_HOME:
-      return front.do_home();
-      break;
-    case KEY_END:
-      return front.do_end();
-      break;
-    case KEY_ESC:
-      return nullptr;
-      break;
-    default:
-      return front.insert(key);
+    LOG_TRACE("ending an editing iteration");
+  } while (!done && manager->selected->get() == this);
+  LOG_TRACE("exiting editing loop");
+  own_cursor = manager->get_buffer(buffer_id).cursor;
+  return !done;
+}
+
+// act as though key was pressed count times in a row,
+// and update the screen. returns false if editing should stop.
+bool Window::replay_key(int key, int count /* = 1 */)
+{
+  Buffer &front = manager->get_buffer(buffer_id);
+  Buffer::Changeset change = front.do_redraw(0);
+  if (!do_keystroke(key, count, front, change)) {
+    return false;
+  }
+  switched = false;
+  Buffer &shown = manager->get_buffer(buffer_id);
+  if (&shown == &front) {
+    manager->show_change(buffer_id, change, this);
+  }
+  update(change, shown);
+  return true;
+}
+
+// do a burst of input: the given key and every key already waiting
+// behind it, e.g. a paste. runs of plain text become one insert.
+// queued runs of a repeating command's key become one call.
+// a command that shows another buffer ends the burst; the keys after
+// it are left for the next one.
+// sets change to everything done; returns false on ESC.
+// the screen is left alone; the caller updates it once for the lot.
+bool Window::do_burst(int key, Buffer &front, Buffer::Changeset &change)
+{
+  bool started = false;
+  bool keep_going = true;
+  // fold the next change into what the burst has done so far.
+  auto add_change = [&](Buffer::Changeset next) {
+    auto start = Latency_stats::Clock::now();
+    if (started) {
+      change.append(next);
+    } else {
+      change = std::move(next);
+      started = true;
+    }
+    latency->record(Latency_stats::changeset, Latency_stats::since(start));
+  };
+  // insert the text gathered so far.
+  auto insert_text = [&]() {
+    auto start = Latency_stats::Clock::now();
+    Buffer::Changeset next = front.insert(burst_text.data(),
+                                          burst_text.size());
+    auto ns = Latency_stats::since(start);
+    latency->record(Latency_stats::command, ns);
+    latency->record_command("insert text", ns);
+    burst_text.clear();
+    add_change(std::move(next));
+  };
+  // only take keys that have already arrived.
+  auto next_key = [this]() {
+    auto start = Latency_stats::Clock::now();
+    int key = read_key(0);
+    latency->record(Latency_stats::input, Latency_stats::since(start));
+    return key;
+  };
+
+  burst_text.clear();
+  while (key != ERR && keep_going) {
+    // only keys left unbound are gathered as text; a bound key, line
+    // breaks included, runs its command, and a run of it is one call
+    // if the command repeats.
+    const Command *command = keys.find(key);
+    if (command == nullptr &&
+        ((key >= ' ' && key < 127) || key == '\t' || key == '\n')) {
+      burst_text.push_back(static_cast<char>(key));
+      key = next_key();
+      continue;
+    }
+    if (!burst_text.empty()) {
+      insert_text();
+    }
+
+    // count how many times in a row the key was pressed.
+    // the key after the run is kept for the next time around.
+    int count = 1;
+    int after = ERR;
+    bool looked_ahead = false;
+    if (command != nullptr && command->repeats) {
+      after = next_key();
+      while (after == key) {
+        ++count;
+        after = next_key();
+      }
+      looked_ahead = true;
+    }
+
+    Buffer::Changeset next = front.do_redraw(0);
+    keep_going = do_keystroke(key, count, front, next);
+    if (keep_going) {
+      add_change(std::move(next));
+    }
+    key = looked_ahead ? after : next_key();
+    if (switched) {
+      if (key != ERR) {
+        events->unget_key(key);
+      }
       break;
+    }
+  }
+
+  LOG_TRACE("burst ended with {} characters to insert", burst_text.size());
+  if (!burst_text.empty()) {
+    insert_text();
+  }
+  return keep_going;
+}
+
+// run the command bound to key, count times over.
+// unbound keys are typed.
+// sets change to what it did; returns false to stop editing.
+// the time taken is counted under the command's name.
+bool Window::do_keystroke(int key, int count, Buffer &front,
+                          Buffer::Changeset &change)
+{
+  LOG_TRACE("performing keystroke for {}, aka {}, {} times",
+            key, static_cast<char>(key), count);
+  auto start = Latency_stats::Clock::now();
+  const Command *command = keys.find(key);
+  bool keep_going = true;
+  if (command != nullptr) {
+    keep_going = command->run(*this, front, count, change);
+  } else {
+    change = front.insert(key);
+  }
+  auto ns = Latency_stats::since(start);
+  latency->record(Latency_stats::command, ns);
+  latency->record_command(command != nullptr ? command->name : "type", ns);
+  return keep_going;
+}
+
+// the keys a new Window starts out with.
+void Window::bind_default_keys()
+{
+  using Changeset = Buffer::Changeset;
+  keys.bind(KEY_UP, "up",
+            [](Window &, Buffer &front, int n, Changeset &change) {
+    change = front.do_up(n);
+    return true;
+  }, true);
+  keys.bind(KEY_DOWN, "down",
+            [](Window &, Buffer &front, int n, Changeset &change) {
+    change = front.do_down(n);
+    return true;
+  }, true);
+  keys.bind(KEY_LEFT, "left",
+            [](Window &, Buffer &front, int n, Changeset &change) {
+    change = front.do_left(n);
+    return true;
+  }, true);
+  keys.bind(KEY_RIGHT, "right",
+            [](Window &, Buffer &front, int n, Changeset &change) {
+    change = front.do_right(n);
+    return true;
+  }, true);
+  keys.bind(KEY_BACKSPACE, "backspace",
+            [](Window &, Buffer &front, int n, Changeset &change) {
+    change = front.do_backspace(n);
+    return true;
+  }, true);
+  keys.bind(KEY_DC, "delete",
+            [](Window &, Buffer &front, int n, Changeset &change) {
+    change = front.do_delete(n);
+    return true;
+  }, true);
+  // in find in files results, enter opens the result on the line.
+  auto enter = [](Window &win, Buffer &front, int n, Changeset &change) {
+    if (!win.manager->is_results(win.buffer_id) ||
+        !win.open_result(front, change)) {
+      change = front.do_enter(n);
+    }
+    return true;
+  };
+  keys.bind('\n', "enter", enter, true);
+  keys.bind(KEY_ENTER, "enter", enter, true);  // for keypad enter
+  keys.bind(KEY_HOME, "home",
+            [](Window &, Buffer &front, int, Changeset &change) {
+    change = front.do_home();
+    return true;
+  });
+  keys.bind(KEY_END, "end",
+            [](Window &, Buffer &front, int, Changeset &change) {
+    change = front.do_end();
+    return true;
+  });
+  // the viewport moves by a page along with the cursor.
+  keys.bind(KEY_NPAGE, "page down",
+            [](Window &win, Buffer &front, int n, Changeset &change) {
+    change = front.do_down(n * win.screen.height());
+    win.view_top += n * win.screen.height();
+    return true;
+  }, true);
+  keys.bind(KEY_PPAGE, "page up",
+            [](Window &win, Buffer &front, int n, Changeset &change) {
+    change = front.do_up(n * win.screen.height());
+    win.view_top = utility::max(win.view_top - n * win.screen.height(), 0);
+    return true;
+  }, true);
+  // Ctrl-Z would suspend the editor, so undo is Ctrl-U.
+  keys.bind(KEY_CTRL_U, "undo",
+            [](Window &, Buffer &front, int n, Changeset &change) {
+    change = front.do_undo();
+    for (int i = 1; i < n; ++i) {
+      Changeset next = front.do_undo();
+      change.append(next);
+    }
+    return true;
+  }, true);
+  keys.bind(KEY_CTRL_R, "redo",
+            [](Window &, Buffer &front, int n, Changeset &change) {
+    change = front.do_redo();
+    for (int i = 1; i < n; ++i) {
+      Changeset next = front.do_redo();
+      change.append(next);
+    }
+    return true;
+  }, true);
+  keys.bind(KEY_CTRL_G, "goto line",
+            [](Window &win, Buffer &front, int, Changeset &change) {
+    // lines are numbered from 1 for people, 0 for Buffers.
+    int line_num = win.prompt_number("goto line: ");
+    if (line_num < 1) {
+      change = front.do_redraw(0);
+    } else {
+      change = front.do_goto_line(line_num - 1);
+    }
+    return true;
+  });
+  // Ctrl-S would stop the terminal, so save is Ctrl-O.
+  // the save carries on in the background; the status line follows it.
+  keys.bind(KEY_CTRL_O, "save",
+            [](Window &win, Buffer &front, int, Changeset &change) {
+    if (front.start_save()) {
+      win.watch_save(win.buffer_id);
+    } else {
+      win.status = front.is_saving() ? "already saving" :
+                                       "no file to save to";
+    }
+    change = front.do_redraw(0);
+    return true;
+  });
+  keys.bind(KEY_CTRL_F, "find",
+            [](Window &win, Buffer &front, int, Changeset &change) {
+    win.find_text(front, true, change);
+    return true;
+  });
+  keys.bind(KEY_CTRL_B, "find backward",
+            [](Window &win, Buffer &front, int, Changeset &change) {
+    win.find_text(front, false, change);
+    return true;
+  });
+  keys.bind(KEY_CTRL_W, "replace all",
+            [](Window &win, Buffer &front, int, Changeset &change) {
+    win.replace_text(front, change);
+    return true;
+  });
+  keys.bind(KEY_CTRL_P, "find in files",
+            [](Window &win, Buffer &front, int, Changeset &change) {
+    win.find_in_files(front, change);
+    return true;
+  });
+  // windows: split the window in two, showing the same buffer, one
+  // above the other or side by side; go to the next window; close it.
+  keys.bind(KEY_CTRL_X, "split",
+            [](Window &win, Buffer &front, int, Changeset &change) {
+    if (!win.manager->split(win, Compositor::Split::stacked)) {
+      win.status = "no room to split";
+    }
+    change = front.do_redraw(0);
+    return true;
+  });
+  keys.bind(KEY_CTRL_Y, "split beside",
+            [](Window &win, Buffer &front, int, Changeset &change) {
+    if (!win.manager->split(win, Compositor::Split::beside)) {
+      win.status = "no room to split";
+    }
+    change = front.do_redraw(0);
+    return true;
+  });
+  keys.bind(KEY_CTRL_N, "next window",
+            [](Window &win, Buffer &front, int, Changeset &change) {
+    win.switched = win.manager->select_next();
+    change = front.do_redraw(0);
+    return true;
+  });
+  keys.bind(KEY_CTRL_K, "close window",
+            [](Window &win, Buffer &front, int, Changeset &change) {
+    if (win.manager->close(win)) {
+      win.switched = true;
+    } else {
+      win.status = "the only window";
+    }
+    change = front.do_redraw(0);
+    return true;
+  });
+  // buffers: show the next one open in this window, after the last
+  // the first.
+  keys.bind(KEY_CTRL_D, "next buffer",
+            [](Window &win, Buffer &, int, Changeset &change) {
+    win.show_buffer((win.buffer_id + 1) % win.manager->buffer_count());
+    change = win.manager->get_buffer(win.buffer_id).do_redraw(0);
+    return true;
+  });
+  keys.bind(KEY_CTRL_T, "stats",
+            [](Window &win, Buffer &front, int, Changeset &change) {
+    std::string drawn;
+    if (Renderer *renderer = win.manager->renderer()) {
+      drawn = "\nframes: " + std::to_string(renderer->frames()) +
+              ", terminal refreshes: " +
+              std::to_string(renderer->refreshes());
+    }
+    win.show_text(win.latency->report() +
+                  "\nbuffer memory: " + front.memory().describe() + drawn);
+    change = front.do_redraw(0);
+    return true;
+  });
+  keys.bind(KEY_ESC, "quit",
+            [](Window &, Buffer &, int, Changeset &) {
+    return false;
+  });
+}
+
+// wait up to timeout milliseconds, or for ever if negative, for a key.
+// returns ERR if the time runs out or something happened in the
+// background that may need showing. a resize is followed here, so that
+// whoever is waiting only has to redraw.
+int Window::read_key(int timeout)
+{
+  if (events == nullptr) {
+    return ERR;
+  }
+  int key = events->next_key(timeout);
+  int rows, cols;
+  if (key == ERR && events->take_resize(rows, cols)) {
+    manager->resize(rows, cols);
+  }
+  return key;
+}
+
+// bring the status up to date now and then while the buffer with the
+// given ID saves, and once it is done: each time the timer goes off,
+// the loop wakes to show it.
+void Window::watch_save(int buff_id)
+{
+  if (events == nullptr) {
+    return;
+  }
+  save_timer = events->add_timer(status_interval, [this, buff_id] {
+    save_timer = -1;
+    if (manager->get_buffer(buff_id).is_saving()) {
+      watch_save(buff_id);
+    }
+  });
+}
+
+// move the window to the given place on the terminal and change it to
+// the given size. it is all drawn again by the next update.
+void Window::place(int top, int left, int height, int width)
+{
+  screen.place(top, left, height, width);
+  shown_top = -1;
+}
+
+// show the buffer with the given ID from its cursor.
+// ends the burst of input the command doing it is in.
+void Window::show_buffer(int buff_id)
+{
+  buffer_id = buff_id;
+  view_top = 0;
+  view_left = 0;
+  // the whole window has to be drawn.
+  shown_top = -1;
+  switched = true;
+}
+
+// what a save or a find in files running in the background has to say,
+// for the status line. a find in files is only talked about over its
+// results.
+std::string Window::background_status(Buffer &front)
+{
+  auto saving = front.save_status();
+  if (!saving.empty() || !manager->is_results(buffer_id)) {
+    return saving;
+  }
+  return manager->find_status();
+}
+
+// ask for a number on the bottom line of the window.
+// returns -1 if cancelled with ESC.
+int Window::prompt_number(const std::string &label)
+{
+  if (events == nullptr) {
+    return -1;
+  }
+  std::string digits;
+  int key;
+  do {
+    show_prompt(label + digits);
+    key = read_key(-1);
+    if (key >= '0' && key <= '9' && digits.size() < 9) {
+      digits.push_back(key);
+    } else if ((key == KEY_BACKSPACE || key == 127) && !digits.empty()) {
+      digits.pop_back();
+    }
+  } while (key != '\n' && key != KEY_ENTER && key != KEY_ESC);
+
+  if (key == KEY_ESC || digits.empty()) {
+    return -1;
   }
+  return std::stoi(digits);
 }
 
-// update active ncurses window to reflect Buffer changes.
-void Window::update(const std::unique_ptr<Buffer::Changeset> change)
+// ask for text on the bottom line of the window, starting from what is
+// in text already.
+// returns false if cancelled with ESC.
+bool Window::prompt_text(const std::string &label, std::string &text)
+{
+  if (events == nullptr) {
+    return false;
+  }
+  int key;
+  do {
+    show_prompt(label + text);
+    key = read_key(-1);
+    if (key >= ' ' && key < 127) {
+      text.push_back(static_cast<char>(key));
+    } else if ((key == KEY_BACKSPACE || key == 127 || key == 8) &&
+               !text.empty()) {
+      text.pop_back();
+    }
+  } while (key != '\n' && key != KEY_ENTER && key != KEY_ESC);
+  return key != KEY_ESC;
+}
+
+// show line on the bottom row of the window, with the cursor after it.
+// the row is the status's until the text is drawn back over it.
+void Window::show_prompt(const std::string &line)
+{
+  int bottom = screen.height() - 1;
+  screen.put_line(bottom, line.data(), line.size());
+  screen.set_cursor(bottom, utility::min(static_cast<int>(line.size()),
+                                         screen.width() - 1));
+  screen.flush();
+  status_shown = true;
+}
+
+// look for text as it is typed, forward from the cursor or backward,
+// moving to the nearest match as it is found and highlighting every
+// match in view.
+// each key typed narrows the search from the match shown; Ctrl-F and
+// Ctrl-B go on to the next match either way, or search again for the
+// last pattern if none is typed yet. Ctrl-E switches between looking
+// for the text as it is and as a Regex. ENTER stays at the match; ESC
+// goes back to where the search started.
+// matches in view are found at once, the rest in the background, and
+// the screen is brought up to date as they come in.
+void Window::find_text(Buffer &front, bool forward, Buffer::Changeset &change)
+{
+  change = front.do_redraw(0);
+  if (events == nullptr) {
+    return;
+  }
+  auto origin = front.cursor;
+  std::string pattern;
+  bool regex = last_regex;
+  // where the match to move to is looked for from, if there is one
+  // still to find.
+  bool moving = false;
+  Buffer::size_type from = origin;
+  Search::size_type shown_progress = 0;
+  int key = ERR;
+  do {
+    if (key == ERR) {
+      // nothing typed: check on the search.
+    } else if (key >= ' ' && key < 127) {
+      pattern.push_back(static_cast<char>(key));
+      start_search(front, pattern, forward, regex);
+      // the match shown may go on matching.
+      from = forward ? front.cursor : front.cursor + 1;
+      moving = true;
+    } else if ((key == KEY_BACKSPACE || key == 127 || key == 8) &&
+               !pattern.empty()) {
+      pattern.pop_back();
+      start_search(front, pattern, forward, regex);
+      from = forward ? origin : origin + 1;
+      moving = true;
+    } else if (key == KEY_CTRL_E) {
+      regex = !regex;
+      start_search(front, pattern, forward, regex);
+      from = forward ? origin : origin + 1;
+      moving = true;
+    } else if (key == KEY_CTRL_F || key == KEY_CTRL_B) {
+      forward = key == KEY_CTRL_F;
+      if (pattern.empty() && !last_pattern.empty()) {
+        pattern = last_pattern;
+        start_search(front, pattern, forward, regex);
+      }
+      from = forward ? front.cursor + 1 : front.cursor;
+      moving = true;
+    }
+
+    // move to the match, once it is known.
+    if (moving && search) {
+      Search::Match found;
+      auto result = forward ? search->next(from, found) :
+                              search->previous(from, found);
+      if (result != Search::Result::pending) {
+        moving = false;
+      }
+      if (result == Search::Result::found) {
+        Buffer::Changeset moved = front.do_goto_offset(found.start);
+        change.append(moved);
+      }
+    }
+
+    status = std::string(forward ? "find" : "find backward") +
+             (regex ? " regex: " : ": ") + pattern;
+    if (search && !search->error().empty()) {
+      status += " [" + search->error() + "]";
+    } else if (search) {
+      status += search->done() ? " [" + std::to_string(search->count()) +
+                                 " found]" :
+                                 " [searching]";
+    }
+    // new matches may be anywhere in view.
+    if (!search || search->progress() != shown_progress || key != ERR ||
+        shown_top < 0) {
+      shown_progress = search ? search->progress() : 0;
+      shown_top = -1;
+      update(front.do_redraw(0), front);
+    }
+
+    bool waiting = search && (!search->done() || moving);
+    key = read_key(waiting ? search_interval : -1);
+  } while (key != '\n' && key != KEY_ENTER && key != KEY_ESC);
+
+  if (key == KEY_ESC) {
+    Buffer::Changeset back = front.do_goto_offset(origin);
+    change.append(back);
+  }
+  if (!pattern.empty()) {
+    last_pattern = pattern;
+    last_regex = regex;
+  }
+  search.reset();
+  status.clear();
+  // the highlights have to be drawn out.
+  shown_top = -1;
+}
+
+// replace every match of a regex asked for with text asked for.
+// the whole text is searched in the background, with ESC to stop, and
+// every match replaced at once, as one edit: a single step to undo.
+// sets change to the edit made.
+void Window::replace_text(Buffer &front, Buffer::Changeset &change)
+{
+  change = front.do_redraw(0);
+  std::string pattern = last_regex ? last_pattern : std::string();
+  if (!prompt_text("replace regex: ", pattern) || pattern.empty()) {
+    return;
+  }
+  last_pattern = pattern;
+  last_regex = true;
+  Regex compiled(pattern);
+  if (!compiled.ok()) {
+    status = "bad regex: " + compiled.error();
+    return;
+  }
+  std::string with = last_replacement;
+  if (!prompt_text("replace \"" + pattern + "\" with: ", with)) {
+    return;
+  }
+  last_replacement = with;
+
+  start_search(front, pattern, true, true);
+  int key = ERR;
+  while (!search->done() && key != KEY_ESC) {
+    status = "replace: searching [" + std::to_string(search->count()) +
+             " found]";
+    update(front.do_redraw(0), front);
+    key = read_key(search_interval);
+  }
+  if (key == KEY_ESC) {
+    status = "replace cancelled";
+  } else {
+    std::vector<Search::Match> found;
+    search->matches(0, front.text.size(), found);
+    change = front.replace_all(found, with);
+    status = std::to_string(found.size()) + " replaced";
+  }
+  search.reset();
+  // the highlights have to be drawn out.
+  shown_top = -1;
+}
+
+// look for text asked for in the files under a directory asked for,
+// showing the results as they come in. the search runs in the
+// background; editing goes on meanwhile, and ENTER on a result opens it.
+// sets change to the move to them.
+void Window::find_in_files(Buffer &front, Buffer::Changeset &change)
+{
+  change = front.do_redraw(0);
+  std::string pattern = last_regex ? std::string() : last_pattern;
+  if (!prompt_text("find in files: ", pattern) || pattern.empty()) {
+    return;
+  }
+  std::string dir = last_directory;
+  if (!prompt_text("find \"" + pattern + "\" in: ", dir) || dir.empty()) {
+    return;
+  }
+  last_pattern = pattern;
+  last_regex = false;
+  last_directory = dir;
+  show_buffer(manager->find_in_files(dir, pattern));
+  change = manager->get_buffer(buffer_id).do_redraw(0);
+}
+
+// open the file named by the find in files result on the cursor's line,
+// at the line it names. results are "path:line: text"; the path ends at
+// the first colon followed by digits and a colon.
+// returns false, doing nothing, if the line is not a result.
+bool Window::open_result(Buffer &front, Buffer::Changeset &change)
+{
+  // the first line says what was looked for.
+  if (front.cursor_pos.y == 0) {
+    return false;
+  }
+  std::string line;
+  front.copy_line(front.local_first_char(), line);
+  for (auto colon = line.find(':'); colon != std::string::npos;
+       colon = line.find(':', colon + 1)) {
+    auto digits_end = line.find_first_not_of("0123456789", colon + 1);
+    if (digits_end == std::string::npos || digits_end == colon + 1 ||
+        digits_end - colon > 10 || line[digits_end] != ':') {
+      continue;
+    }
+    auto path = line.substr(0, colon);
+    int line_num = std::stoi(line.substr(colon + 1, digits_end - colon - 1));
+    show_buffer(manager->open(path));
+    // lines are numbered from 1 for people, 0 for Buffers.
+    change = manager->get_buffer(buffer_id).do_goto_line(line_num - 1);
+    return true;
+  }
+  return false;
+}
+
+// start searching the text for pattern, as a regex if regex, from the
+// lines in view.
+void Window::start_search(Buffer &front, const std::string &pattern,
+                          bool forward, bool regex)
+{
+  // the old search has to stop before the new one starts its jobs.
+  search.reset();
+  auto first = front.line_offset(view_top);
+  auto last = front.line_offset(view_top + screen.height());
+  search.reset(new Search(front.snapshot(), pattern, first, last, forward,
+                          regex));
+}
+
+// show text over the whole window until a key is pressed.
+// lines past the bottom are cut off.
+void Window::show_text(const std::string &text)
+{
+  if (events == nullptr) {
+    return;
+  }
+  std::string::size_type pos = 0;
+  for (int y = 0; y < screen.height(); ++y) {
+    if (pos < text.size()) {
+      auto endln = text.find('\n', pos);
+      if (endln == std::string::npos) {
+        endln = text.size();
+      }
+      screen.put_line(y, text.data() + pos, endln - pos);
+      pos = endln + 1;
+    } else {
+      screen.clear_line(y);
+    }
+  }
+  screen.set_cursor(0, 0);
+  screen.flush();
+  while (read_key(-1) == ERR) {
+    // wait for a key.
+  }
+  // the Buffer's text has to be drawn back in.
+  shown_top = -1;
+}
+
+// update the window to reflect Buffer changes.
+// only cells that actually changed are sent to the terminal.
+// only lines inside the viewport are ever read from the Buffer.
+void Window::update(const Buffer::Changeset &change, const Buffer &front)
 {
   //TODO: add an options lookup table.
   //If a certain option is set, type each character in a random color.
-  int y = change->top_line;
-  for (std::string line : change->changed) {
-    move(y, 0);
-    clrtoeol();
-    wprintw(active_window, line.c_str());
-    ++y;
-  }
-  move(change->cursor_final.y, change->cursor_final.x);
-  wrefresh(active_window);
+  auto start = Latency_stats::Clock::now();
+  scroll_to(change.cursor_final);
+  draw_change(change, front);
+  screen.set_cursor(change.cursor_final.y - view_top,
+                    change.cursor_final.x - view_left);
+  latency->record(Latency_stats::draw, Latency_stats::since(start));
+
+  start = Latency_stats::Clock::now();
+  screen.flush();
+  latency->record(Latency_stats::flush, Latency_stats::since(start));
+}
+
+// show change, made to the buffer shown from another window, without
+// moving the view: only the lines it touched in view are drawn again.
+// the cursor kept for when this window is selected again moves with the
+// text around it; if that text went, to where it was.
+void Window::mirror(const Buffer::Changeset &change)
+{
+  for (Buffer::size_type i = 0; i < change.num_deltas(); ++i) {
+    const Buffer::Delta &delta = change.delta(i);
+    if (own_cursor >= delta.offset + delta.removed) {
+      own_cursor = own_cursor - delta.removed + delta.inserted;
+    } else if (own_cursor > delta.offset) {
+      own_cursor = delta.offset;
+    }
+  }
+  draw_change(change, manager->get_buffer(buffer_id));
+  screen.flush();
+}
+
+// draw the whole window again, without moving the view.
+void Window::refresh()
+{
+  Buffer &front = manager->get_buffer(buffer_id);
+  shown_top = -1;
+  draw_change(front.do_redraw(0), front);
+  screen.flush();
+}
+
+// draw the lines change touched that are in view, or all of them if the
+// view has moved, and the status.
+void Window::draw_change(const Buffer::Changeset &change,
+                         const Buffer &front)
+{
+  int view_bottom = view_top + screen.height() - 1;
+
+  if (view_top != shown_top || view_left != shown_left) {
+    // scrolled: everything in view may have changed.
+    draw_lines(front, view_top, view_bottom, front.line_offset(view_top));
+    shown_top = view_top;
+    shown_left = view_left;
+  } else {
+    // only the changed lines that are in view.
+    int first = utility::max(change.top_line, view_top);
+    int last = change.redraw_below ?
+               view_bottom :
+               utility::min(change.bottom_line, view_bottom);
+    if (first <= last) {
+      auto pos = (first == change.top_line) ?
+                 change.top_offset :
+                 front.line_offset(first);
+      draw_lines(front, first, last, pos);
+    }
+  }
+
+  // the status covers the bottom row while there is something to say.
+  int bottom = screen.height() - 1;
+  if (!status.empty()) {
+    screen.put_line(bottom, status.data(), status.size());
+    status_shown = true;
+  } else if (status_shown) {
+    draw_lines(front, view_top + bottom, view_top + bottom,
+               front.line_offset(view_top + bottom));
+    status_shown = false;
+  }
+}
+
+// move the viewport as little as possible to show the given
+// cursor position.
+void Window::scroll_to(const Point &cursor)
+{
+  if (cursor.y < view_top) {
+    view_top = cursor.y;
+  } else if (cursor.y >= view_top + screen.height()) {
+    view_top = cursor.y - screen.height() + 1;
+  }
+  if (cursor.x < view_left) {
+    view_left = cursor.x;
+  } else if (cursor.x >= view_left + screen.width()) {
+    view_left = cursor.x - screen.width() + 1;
+  }
+}
+
+// draw lines [first, last] of the Buffer into the viewport.
+// pos is where line first starts.
+// lines are read one after another, and only their visible columns.
+// matches of the search, if there is one, are highlighted.
+void Window::draw_lines(const Buffer &front, int first, int last,
+                        Buffer::size_type pos)
+{
+  for (int y = first; y <= last; ++y) {
+    if (pos != Piece_table::npos) {
+      line_text.clear();
+      auto shown = pos + view_left;
+      pos = front.copy_line(pos, line_text, view_left, screen.width());
+      screen.put_line(y - view_top, line_text.data(), line_text.size());
+      if (search) {
+        line_matches.clear();
+        search->matches(shown, shown + line_text.size(), line_matches);
+        for (auto &match : line_matches) {
+          // a match may start off to the left.
+          int x = match.start >= shown ?
+                  static_cast<int>(match.start - shown) :
+                  -static_cast<int>(shown - match.start);
+          screen.highlight(y - view_top, x,
+                           x + static_cast<int>(match.length));
+        }
+      }
+    } else {
+      screen.clear_line(y - view_top);
+    }
+  }
 }
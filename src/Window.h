@@ -9,25 +9,64 @@
 
 #include "Window_manager.h"
 #include "Buffer.h"
-#include "Line.h"
+#include "Screen.h"
+#include "Keymap.h"
+#include "Latency.h"
+#include "Search.h"
 
 #define KEY_ESC 27
+#define KEY_CTRL_G 7
+#define KEY_CTRL_T 20
+#define KEY_CTRL_U 21
+#define KEY_CTRL_R 18
+#define KEY_CTRL_O 15
+#define KEY_CTRL_F 6
+#define KEY_CTRL_B 2
+#define KEY_CTRL_E 5
+#define KEY_CTRL_W 23
+#define KEY_CTRL_P 16
+#define KEY_CTRL_X 24
+#define KEY_CTRL_Y 25
+#define KEY_CTRL_N 14
+#define KEY_CTRL_K 11
+#define KEY_CTRL_D 4
 
 class Window_manager;
 
 class Window {
-  // window managers can set the active ncurses window.
+  // window managers and their compositors can move windows about the
+  // terminal, and draw them.
   friend class Window_manager;
+  friend class Compositor;
 
   public:
     // constructor:
-    // uses given ncurses window.
+    // a window of the given size with its top left corner at row top,
+    // column left of the terminal, drawn by the manager's renderer.
     // shows the given buffer.
-    Window(Window_manager *manager_, int buff_id, WINDOW *active);
+    Window(Window_manager *manager_, int buff_id, int top, int left,
+           int height, int width);
+
+    // constructor:
+    // headless: a window of the given size that draws to the manager's
+    // Null_backend and takes no input of its own, e.g. for benchmarks.
+    Window(Window_manager *manager_, int buff_id, int height, int width);
+
+    // stops the timers it has running.
+    ~Window();
 
     // do edit mode:
-    // interpret user input while updating buffer and screen.
-    void edit_text();
+    // interpret user input while updating buffer and screen, until
+    // editing stops or another window is selected.
+    // returns true if another window was selected.
+    bool edit_text();
+
+    // which command each key runs. can be changed at any time.
+    Keymap &keymap();
+
+    // act as though key was pressed count times in a row,
+    // and update the screen. returns false if editing should stop.
+    bool replay_key(int key, int count = 1);
 
   private:
     // this window's manager
@@ -36,17 +75,189 @@ class Window {
     // id of buffer currently shown
     int buffer_id;
 
-    // All operations will be performed using the active ncurses window.
-    // can be set by a window manager.
-    WINDOW* active_window;
+    // what is shown in the window, and what should be.
+    Screen screen;
+
+    // viewport: first line and column of the Buffer that are shown.
+    // the visible height and width are the Screen's.
+    int view_top;
+    int view_left;
+
+    // viewport as of the last update. -1 until something is drawn.
+    int shown_top;
+    int shown_left;
+
+    // set when a command shows another buffer or selects another
+    // window, ending the burst it was in: the keys after it are for the
+    // new buffer or window.
+    bool switched;
+
+    // where the cursor is in the buffer shown while another window has
+    // the buffer's cursor; edits made there move it along with the
+    // text around it.
+    Buffer::size_type own_cursor;
+
+    // set once the window has been closed: it is drawn no more, and
+    // goes once editing in it stops.
+    bool closing;
+
+    // message shown on the bottom row in place of the text, if any,
+    // and if one was shown by the last update.
+    std::string status;
+    bool status_shown;
+
+    // how often, in milliseconds, the status is brought up to date
+    // while a save runs.
+    static const int status_interval = 100;
+
+    // which command each key runs.
+    Keymap keys;
+
+    // where the time taken by input, commands and drawing is counted.
+    // the manager's.
+    Latency_stats *latency;
+
+    // where keys come from. the manager's; null if headless.
+    Event_loop *events;
+
+    // ID of the timer watching a save, or -1.
+    int save_timer;
+
+    // do a burst of input: the given key and every key already waiting
+    // behind it, e.g. a paste. runs of plain text become one insert.
+    // queued runs of a repeating command's key become one call.
+    // sets change to everything done; returns false on ESC.
+    bool do_burst(int key, Buffer &front, Buffer::Changeset &change);
+
+    // run the command bound to key, count times over.
+    // unbound keys are typed.
+    // sets change to what it did; returns false to stop editing.
+    bool do_keystroke(int key, int count, Buffer &front,
+                      Buffer::Changeset &change);
+
+    // the keys a new Window starts out with.
+    void bind_default_keys();
+
+    // move the window to the given place on the terminal and change it
+    // to the given size. it is all drawn again by the next update.
+    void place(int top, int left, int height, int width);
+
+    // wait up to timeout milliseconds, or for ever if negative, for a
+    // key.
+    // returns ERR if the time runs out or something happened in the
+    // background that may need showing.
+    int read_key(int timeout);
+
+    // bring the status up to date now and then while the buffer with
+    // the given ID saves, and once it is done.
+    void watch_save(int buff_id);
+
+    // show the buffer with the given ID from its cursor.
+    void show_buffer(int buff_id);
 
-    // choose and execute appropriate buffer-editing function.
-    // returns nullptr on ESC.
-    std::unique_ptr<Buffer::Changeset>
-    do_keystroke(const int &key, Buffer &front);
+    // what a save or a find in files running in the background has to
+    // say, for the status line.
+    std::string background_status(Buffer &front);
 
-    // update active ncurses window to reflect Buffer changes.
-    void update(const std::unique_ptr<Buffer::Changeset> change);
+    // ask for a number on the bottom line of the window.
+    // returns -1 if cancelled with ESC.
+    int prompt_number(const std::string &label);
+
+    // ask for text on the bottom line of the window, starting from
+    // what is in text already.
+    // returns false if cancelled with ESC.
+    bool prompt_text(const std::string &label, std::string &text);
+
+    // show line on the bottom row of the window, with the cursor
+    // after it.
+    void show_prompt(const std::string &line);
+
+    // show text over the whole window until a key is pressed.
+    void show_text(const std::string &text);
+
+    // look for text as it is typed, forward from the cursor or
+    // backward, moving to the nearest match as it is found and
+    // highlighting every match in view.
+    // sets change to the moves made.
+    void find_text(Buffer &front, bool forward, Buffer::Changeset &change);
+
+    // replace every match of a regex asked for with text asked for.
+    // sets change to the edit made.
+    void replace_text(Buffer &front, Buffer::Changeset &change);
+
+    // look for text asked for in the files under a directory asked
+    // for, showing the results as they come in.
+    // sets change to the move to them.
+    void find_in_files(Buffer &front, Buffer::Changeset &change);
+
+    // open the file named by the find in files result on the cursor's
+    // line, at the line it names.
+    // returns false, doing nothing, if the line is not a result.
+    bool open_result(Buffer &front, Buffer::Changeset &change);
+
+    // start searching the text for pattern, as a regex if regex, from
+    // the lines in view.
+    void start_search(Buffer &front, const std::string &pattern,
+                      bool forward, bool regex);
+
+    // update the window to reflect Buffer changes.
+    // only cells that actually changed are sent to the terminal.
+    void update(const Buffer::Changeset &change, const Buffer &front);
+
+    // show change, made to the buffer shown from another window,
+    // without moving the view.
+    void mirror(const Buffer::Changeset &change);
+
+    // draw the whole window again, without moving the view.
+    void refresh();
+
+    // draw the lines change touched that are in view, or all of them
+    // if the view has moved, and the status.
+    void draw_change(const Buffer::Changeset &change, const Buffer &front);
+
+    // move the viewport as little as possible to show the given
+    // cursor position.
+    void scroll_to(const Point &cursor);
+
+    // draw lines [first, last] of the Buffer into the viewport.
+    // pos is where line first starts.
+    void draw_lines(const Buffer &front, int first, int last,
+                    Buffer::size_type pos);
+
+    // text of the line being drawn.
+    // kept between updates so that drawing does not allocate.
+    std::string line_text;
+
+    // plain text gathered from a burst of input, not yet inserted.
+    std::string burst_text;
+
+    // search whose matches are highlighted, if any, and the last
+    // pattern searched for, and if it was a regex.
+    std::unique_ptr<Search> search;
+    std::string last_pattern;
+    bool last_regex;
+
+    // last text replaced by, for the next replace to start from.
+    std::string last_replacement;
+
+    // last directory looked in by find in files.
+    std::string last_directory;
+
+    // matches on the line being drawn.
+    // kept between updates so that drawing does not allocate.
+    std::vector<Search::Match> line_matches;
+
+    // how often, in milliseconds, the screen is brought up to date
+    // while a search runs.
+    static const int search_interval = 50;
 };
 
+// inline function definitions
+
+// which command each key runs. can be changed at any time.
+inline Keymap &Window::keymap()
+{
+  return keys;
+}
+
 #endif /* WINDOW_H */
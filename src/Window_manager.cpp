@@ -3,64 +3,314 @@
 // Represents a set of windows and tracks user interatcoin with them.
 
 #include <iostream>
+#include <utility>
+
+#include <sys/stat.h>
 
 #include "Window_manager.h"
 #include "Window.h"
 #include "Buffer.h"
+#include "Thread_pool.h"
+
+#include "Log.h"
+
+namespace {
 
-#ifndef NDEBUG
-#include "Debug.h"
-#endif /* NDEBUG */
+// where timings are written when editing ends.
+const char *const latency_file = "jpedit-latency.txt";
+
+// characters of each file read ahead as it is opened.
+const File_map::size_type read_ahead = 1 << 20;
+
+}
 
 // constructor:
-// creates a new window with a Buffer for the given file path,
-// and sets it as currently selected.
-// defualts to empty path.
-Window_manager::Window_manager(const std::string &path /* = "" */)
+// opens a Buffer for each of the given file paths, and a window showing
+// the first, or an unnamed Buffer if there are none. drawn on
+// terminal_, which must have been set up for editing and must outlive
+// the manager.
+// the files are all read at once, in the background; the window is
+// shown as soon as the first is in, while the rest go on.
+Window_manager::Window_manager(Backend &terminal_,
+                               const std::vector<std::string> &paths
+                               /* = std::vector<std::string>() */)
+  : terminal(&terminal_), loop(new Event_loop()),
+    render_thread(new Renderer(terminal_)),
+    compositor(terminal, render_thread.get()), finding_id(-1)
 {
-  open(path);
+  terminal->size(term_rows, term_cols);
+  if (paths.empty()) {
+    open("");
+  }
+  for (auto &path : paths) {
+    open(path);
+  }
   add_window();
   //TODO: if I want mulit-modality,
   //implement some sort of control that doesn't involve editing mode.
-#ifndef NDEBUG
-  Debug::log("about to edit text...");
-#endif /* NDEBUG */
-  (*selected)->edit_text();
+  LOG_TRACE("about to edit text...");
+  edit();
+  latency.dump(latency_file);
+}
+
+// constructor:
+// headless: opens the given file path in a window of the given size
+// that draws to a Null_backend. editing is left to the caller, e.g.
+// through Window::replay_key.
+Window_manager::Window_manager(const std::string &path, int height, int width)
+  : null_terminal(new Null_backend(height, width)),
+    terminal(null_terminal.get()), term_rows(height), term_cols(width),
+    compositor(terminal, nullptr), finding_id(-1)
+{
+  int buff_id = open(path);
+  std::unique_ptr<Window> p(new Window(this, buff_id, height, width));
+  windows.push_back(std::move(p));
+  selected = --end(windows);
+  compositor.start(selected->get());
 }
 
 // add and select a window to the list
-// with the given buffer and ncurses window.
-// defaults to first buffer and standard screen.
-void Window_manager::add_window(int buff_id /* = 0 */, 
-                                WINDOW *nc_win /* = stdscr */)
+// with the given buffer, filling the terminal.
+// defaults to first buffer.
+void Window_manager::add_window(int buff_id /* = 0 */)
 {
-  std::unique_ptr<Window> p(new Window(this, buff_id, nc_win));
+  std::unique_ptr<Window> p(new Window(this, buff_id, 0, 0, term_rows,
+                                       term_cols));
   windows.push_back(std::move(p));
   selected = --end(windows);
+  compositor.start(selected->get());
+}
+
+// edit in the selected window, and then in whichever is selected next,
+// until editing stops.
+// a window closed while it was being edited in goes once it is done.
+void Window_manager::edit()
+{
+  while ((*selected)->edit_text()) {
+    windows.remove_if([](const std::unique_ptr<Window> &window) {
+      return window->closing;
+    });
+  }
+}
+
+// split window in two, how is given, the new half showing the same
+// buffer from the same place.
+// returns false, doing nothing, if there is no room.
+// the window keeps its cursor, which the new one starts out at too.
+bool Window_manager::split(Window &window, Compositor::Split how)
+{
+  std::unique_ptr<Window> added(new Window(this, window.buffer_id, 0, 0,
+                                           1, 1));
+  if (!compositor.split(&window, added.get(), how)) {
+    return false;
+  }
+  added->view_top = window.view_top;
+  added->view_left = window.view_left;
+  windows.push_back(std::move(added));
+  relayout();
+  return true;
+}
+
+// select the window after the selected one.
+// returns false if there is no other window.
+bool Window_manager::select_next()
+{
+  Window *next = compositor.next(selected->get());
+  if (next == selected->get()) {
+    return false;
+  }
+  selected = std::find_if(windows.begin(), windows.end(),
+                          [next](const std::unique_ptr<Window> &window) {
+    return window.get() == next;
+  });
+  return true;
+}
+
+// close window, selecting the next one.
+// returns false, doing nothing, if it is the only one.
+// the window goes once editing in it stops.
+bool Window_manager::close(Window &window)
+{
+  if (selected->get() == &window && !select_next()) {
+    return false;
+  }
+  compositor.remove(&window);
+  window.closing = true;
+  relayout();
+  return true;
+}
+
+// show change, made to the buffer with the given ID from window from,
+// in every other window showing it.
+void Window_manager::show_change(int buffer_id,
+                                 const Buffer::Changeset &change,
+                                 Window *from)
+{
+  compositor.show_change(buffer_id, change, from);
+}
+
+// the terminal is now rows by cols: lay the windows out again.
+// the renderer hears of it first, so that the windows' next Frames are
+// drawn on the terminal at its new size.
+void Window_manager::resize(int rows, int cols)
+{
+  if (render_thread) {
+    render_thread->resize(rows, cols);
+  } else {
+    terminal->resize(rows, cols);
+  }
+  term_rows = rows;
+  term_cols = cols;
+  relayout();
+}
+
+// lay the windows out on the terminal again, and draw all but the
+// selected one, which draws itself when it next updates.
+void Window_manager::relayout()
+{
+  compositor.layout(term_rows, term_cols);
+  compositor.redraw(selected->get());
 }
 
 // open buffer for given path and bring it to front of selected window.
+// a file already open is not opened again, by the same path or another
+// naming the same device and inode.
+// the file starts being read on the shared Thread_pool; the Buffer is
+// only made when it is first asked for.
 int Window_manager::open(const std::string &path)
 {
-  //TODO: check that no buffer exists for requested file.
-  std::unique_ptr<Buffer> p(new Buffer(path));
-  buffers.push_back(std::move(p));
+  Buffer_slot slot;
+  slot.path = path;
+  slot.device = 0;
+  slot.inode = 0;
+  struct stat info;
+  if (!path.empty() && ::stat(path.c_str(), &info) == 0) {
+    slot.device = info.st_dev;
+    slot.inode = info.st_ino;
+  }
+  if (!path.empty()) {
+    for (std::size_t i = 0; i < buffers.size(); ++i) {
+      const Buffer_slot &other = buffers[i];
+      if (other.path == path) {
+        return i;
+      }
+      if (slot.inode != 0 && other.device == slot.device &&
+          other.inode == slot.inode) {
+        LOG_INFO("{} is already open as {}", path, other.path);
+        return i;
+      }
+    }
+    slot.contents = read_file(path);
+  }
+  buffers.push_back(std::move(slot));
   return buffers.size() - 1;
 }
 
 // get the buffer for the given ID.
+// the first time, the Buffer is made, waiting for its file to be read
+// if it is not in yet, and edits left in the file's journal by an
+// editor that died are recovered.
 Buffer &Window_manager::get_buffer(const int &buffer_id)
 {
-#ifndef NDEBUG
-  Debug::indent();
-  Debug::log("starting to get buffer");
-#endif /* NDEBUG */
   //TODO: what to do if not a valid id?
   //When a buffer is deleted, will all Windows be visited to make
   //sure that they aren't referring to an old one?
-#ifndef NDEBUG
-  Debug::log("finished getting buffer");
-  Debug::outdent();
-#endif /* NDEBUG */
-  return *buffers[buffer_id];
+  Buffer_slot &slot = buffers[buffer_id];
+  if (!slot.buffer) {
+    LOG_INDENT();
+    LOG_TRACE("making buffer for {}", slot.path);
+    File_map contents;
+    if (slot.contents.valid()) {
+      contents = slot.contents.get();
+    }
+    slot.buffer.reset(new Buffer(slot.path, std::move(contents)));
+    auto recovered = slot.buffer->start_journal();
+    if (recovered > 0) {
+      LOG_INFO("recovered {} edits to {} from its journal", recovered,
+               slot.path);
+    }
+  }
+  return *slot.buffer;
+}
+
+// start reading the file at path on the shared Thread_pool.
+// it is mapped, and the start of it, what is shown first, is read
+// ahead from disk.
+std::future<File_map> Window_manager::read_file(const std::string &path)
+{
+  std::shared_ptr<std::promise<File_map>> read(
+      new std::promise<File_map>());
+  Thread_pool::shared().submit([read, path] {
+    File_map contents(path);
+    contents.prefetch(read_ahead);
+    read->set_value(std::move(contents));
+  });
+  return read->get_future();
+}
+
+// start looking for pattern in every file under dir, in the background,
+// into a new results buffer. the first line of the buffer says what was
+// looked for; each line after it is a result, "path:line: text".
+// the results of earlier finds are kept: Windows may still be showing
+// them, or holding Changesets from them.
+// returns the results buffer's ID.
+int Window_manager::find_in_files(const std::string &dir,
+                                  const std::string &pattern)
+{
+  finding.reset();
+  find_ended.clear();
+  Buffer_slot results;
+  results.buffer.reset(new Buffer());
+  results.device = 0;
+  results.inode = 0;
+  std::string title = "find in files: \"" + pattern + "\" in " + dir + "\n";
+  results.buffer->append(title.data(), title.size());
+  buffers.push_back(std::move(results));
+  finding_id = buffers.size() - 1;
+  results_ids.push_back(finding_id);
+  // results are shown as they come in.
+  auto loop_ptr = loop.get();
+  finding.reset(new File_search(dir, pattern, [loop_ptr] {
+    if (loop_ptr != nullptr) {
+      loop_ptr->wake();
+    }
+  }));
+  LOG_DEBUG("find in files: {} in {}", pattern, dir);
+  return finding_id;
+}
+
+// add the results found since the last call to the results buffer.
+// returns false if no find in files is running.
+bool Window_manager::poll_find()
+{
+  if (!finding) {
+    return false;
+  }
+  std::string found;
+  bool running = finding->take(found);
+  if (!found.empty()) {
+    // the selected window draws itself.
+    auto change = buffers[finding_id].buffer->append(found.data(), found.size());
+    show_change(finding_id, change, selected->get());
+  }
+  if (!running) {
+    find_ended = "find in files: " + std::to_string(finding->count()) +
+                 " found in " + std::to_string(finding->files()) + " files";
+    finding.reset();
+  }
+  return true;
+}
+
+// how the find in files is going, for the status line.
+// how it ended is reported once; empty if there is nothing to report.
+std::string Window_manager::find_status()
+{
+  if (finding) {
+    return "find in files: " + std::to_string(finding->count()) +
+           " found in " + std::to_string(finding->files()) +
+           " files [searching]";
+  }
+  std::string ended;
+  ended.swap(find_ended);
+  return ended;
 }
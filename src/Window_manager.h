@@ -5,12 +5,22 @@
 //
 // Represents a set of windows and tracks user interatcoin with them.
 
+#include <algorithm>
+#include <future>
 #include <string>
 #include <vector>
 #include <list>
 #include <memory>
 
-#include <ncurses.h>
+#include <sys/types.h>
+
+#include "File_map.h"
+#include "Latency.h"
+#include "File_search.h"
+#include "Event_loop.h"
+#include "Backend.h"
+#include "Renderer.h"
+#include "Compositor.h"
 
 class Window;
 class Buffer;
@@ -21,10 +31,19 @@ class Window_manager {
     using window_list = std::list<std::unique_ptr<Window>>;
 
     // constructor:
-    // creates a new window with a Buffer for the given file path,
-    // and sets it as currently selected.
-    // TODO: figure out variadics and open an arbitrary number of buffers.
-    explicit Window_manager(const std::string &path = "");
+    // opens a Buffer for each of the given file paths, and a window
+    // showing the first, or an unnamed Buffer if there are none.
+    // drawn on terminal_, which must have been set up for editing and
+    // must outlive the manager.
+    explicit Window_manager(Backend &terminal_,
+                            const std::vector<std::string> &paths =
+                                std::vector<std::string>());
+
+    // constructor:
+    // headless: opens the given file path in a window of the given size
+    // that draws to a Null_backend. editing is left to the caller, e.g.
+    // through Window::replay_key.
+    Window_manager(const std::string &path, int height, int width);
 
     // currently selected window.
     // TODO: perhaps hide this and exit if no more windows.
@@ -32,23 +51,183 @@ class Window_manager {
     window_list::iterator selected;
 
     // add and select a window to the list
-    // with the given buffer and ncurses window.
-    // defaults to first buffer and standard screen.
-    void add_window(int buff_id = 0, WINDOW *nc_win = stdscr);
+    // with the given buffer, filling the terminal.
+    // defaults to first buffer.
+    void add_window(int buff_id = 0);
+
+    // edit in the selected window, and then in whichever is selected
+    // next, until editing stops.
+    void edit();
+
+    // split window in two, how is given, the new half showing the same
+    // buffer from the same place.
+    // returns false, doing nothing, if there is no room.
+    bool split(Window &window, Compositor::Split how);
+
+    // select the window after the selected one.
+    // returns false if there is no other window.
+    bool select_next();
+
+    // close window, selecting the next one.
+    // returns false, doing nothing, if it is the only one.
+    bool close(Window &window);
+
+    // show change, made to the buffer with the given ID from window
+    // from, in every other window showing it.
+    void show_change(int buffer_id, const Buffer::Changeset &change,
+                     Window *from);
+
+    // the terminal is now rows by cols: lay the windows out again.
+    void resize(int rows, int cols);
 
     // open buffer for given path and add it to the list.
-    // returns the new buffer's ID, aka the index of the buffer in the vector.
+    // a file already open, by whatever path, is not opened again.
+    // the file is read in the background; the Buffer is only made when
+    // it is first asked for.
+    // returns the buffer's ID, aka the index of the buffer in the vector.
     int open(const std::string &path);
 
     // get the buffer for the given ID.
+    // waits for its file to be read, if it is the first time.
     Buffer &get_buffer(const int &buffer_id);
 
+    // number of buffers open.
+    int buffer_count() const;
+
+    // how long input, commands and drawing take, in every window.
+    Latency_stats &stats();
+
+    // what keys, timers and wakeups come through.
+    // null if headless.
+    Event_loop *events();
+
+    // what the windows draw with.
+    Backend &backend();
+
+    // what draws on the terminal, on a thread of its own.
+    // null if headless.
+    Renderer *renderer();
+
+    // start looking for pattern in every file under dir, in the
+    // background, into a new results buffer.
+    // returns the results buffer's ID.
+    int find_in_files(const std::string &dir, const std::string &pattern);
+
+    // add the results found since the last call to the results buffer.
+    // returns false if no find in files is running.
+    bool poll_find();
+
+    // how the find in files is going, for the status line.
+    // how it ended is reported once; empty if there is nothing to report.
+    std::string find_status();
+
+    // if the buffer with the given ID holds find in files results.
+    bool is_results(int buffer_id) const;
+
   private:
-    // all the Windows managed by this manager
-    window_list windows;
+    // lay the windows out on the terminal again, and draw all but the
+    // selected one, which draws itself when it next updates.
+    void relayout();
+
+    // a Buffer, or the file it is to be made from.
+    struct Buffer_slot {
+      // null until first asked for.
+      std::unique_ptr<Buffer> buffer;
+
+      std::string path;
+
+      // the file path names, to know it by another path; both 0 if it
+      // does not exist.
+      dev_t device;
+      ino_t inode;
+
+      // the file's contents, being read on a worker.
+      std::future<File_map> contents;
+    };
+
+    // start reading the file at path on the shared Thread_pool.
+    static std::future<File_map> read_file(const std::string &path);
 
     // all the Buffers that this manager's Windows can be assigned to.
-    std::vector<std::unique_ptr<Buffer>> buffers;
+    std::vector<Buffer_slot> buffers;
+
+    // timings of all windows.
+    Latency_stats latency;
+
+    // what the windows draw with, and the Null_backend it is if
+    // headless.
+    std::unique_ptr<Backend> null_terminal;
+    Backend *terminal;
+
+    // the terminal's size, as the windows are laid out for.
+    // kept here: once the renderer draws, only it may ask the Backend.
+    int term_rows;
+    int term_cols;
+
+    // declared before what may wake it, so that it outlives them.
+    std::unique_ptr<Event_loop> loop;
+
+    std::unique_ptr<Renderer> render_thread;
+
+    // where the windows are on the terminal.
+    Compositor compositor;
+
+    // all the Windows managed by this manager.
+    // declared after the Buffers they show and what they draw and wait
+    // with, so that they go first.
+    window_list windows;
+
+    // the find in files running, if any, and the ID of the buffer its
+    // results go into.
+    std::unique_ptr<File_search> finding;
+    int finding_id;
+
+    // IDs of every buffer of find in files results.
+    std::vector<int> results_ids;
+
+    // what the last find in files found, to report once.
+    std::string find_ended;
 };
 
+// inline function definitions
+
+// how long input, commands and drawing take, in every window.
+inline Latency_stats &Window_manager::stats()
+{
+  return latency;
+}
+
+// what keys, timers and wakeups come through.
+// null if headless.
+inline Event_loop *Window_manager::events()
+{
+  return loop.get();
+}
+
+// what the windows draw with.
+inline Backend &Window_manager::backend()
+{
+  return *terminal;
+}
+
+// what draws on the terminal, on a thread of its own.
+// null if headless.
+inline Renderer *Window_manager::renderer()
+{
+  return render_thread.get();
+}
+
+// number of buffers open.
+inline int Window_manager::buffer_count() const
+{
+  return buffers.size();
+}
+
+// if the buffer with the given ID holds find in files results.
+inline bool Window_manager::is_results(int buffer_id) const
+{
+  return std::find(results_ids.begin(), results_ids.end(), buffer_id) !=
+         results_ids.end();
+}
+
 #endif /* WINDOW_MANAGER_H */
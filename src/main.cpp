@@ -1,4 +1,5 @@
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 #include <ncurses.h>
@@ -7,19 +8,18 @@
 #include "Window_manager.h"
 #include "Window.h"
 #include "Buffer.h"
+#include "Backend.h"
 
 void testFileIO(int argc, char *argv[]);
-void start_editor(const std::string &path);
+void start_editor(const std::vector<std::string> &paths);
 void old_start_editor();
 
 int main(int argc, char *argv[])
 {
-  std::string first;
-  if (argc > 1) {
-    first = argv[1];
-  }
+  // every file named is opened.
+  std::vector<std::string> paths(argv + 1, argv + argc);
 
-  start_editor(first);
+  start_editor(paths);
   //old_start_editor();
 
   return 0;
@@ -38,26 +38,22 @@ void testFileIO(int argc, char *argv[])
   }
 }
 
-void start_editor(const std::string &path)
+void start_editor(const std::vector<std::string> &paths)
 {
-  // ncurses pre-configuration:
-  // allocate needed screen memory. usually clears screen.
-  initscr();
-  // turn off echoing
-  noecho();
-  // make keypresses immediately. let interrupt sequences still work.
-  cbreak();
-  // set timeout for ESC
-  //timeout(100);
-  // allow arrow keys, function keys, etc.
-  // TODO: when using multiple screens, do this for all of them.
-  keypad(stdscr, true);
+  // set up the terminal: ncurses, or escape sequences written directly.
+  // ESC needs no timeout here: keys are read and parsed by the
+  // Window_manager's Event_loop, which takes ESC at once.
+  std::unique_ptr<Backend> terminal(Backend::open_terminal());
 
   //TODO: figure out some control loop
-  Window_manager wm(path);
+  // the editor has to stop drawing, on its thread, before the terminal
+  // is put back.
+  {
+    Window_manager wm(*terminal, paths);
+  }
 
-  // deallocate screen stuff. get back normal terminal mode.
-  endwin();
+  // get back normal terminal mode.
+  terminal.reset();
 }
 
 void old_start_editor()